@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -167,6 +168,62 @@ static void closeFile(int* fd)
     }
 }
 
+// Command line marker of a child process started by spawnRole.
+#define ROLE_ARGUMENT "--role"
+
+// Child processes are started from this file, which is the running program itself.
+#define SELF_EXECUTABLE "/proc/self/exe"
+
+extern char** environ;
+
+// Name the program was started with, passed on to child processes.
+static const char* program_name = "prog";
+
+// spawnRole: Starts this program in a child process that runs only the given role
+// (role_args[0]) with role_args[1..] as its arguments; role_args ends with NULL.
+// Unlike fork(), posix_spawn() doesn't copy the page tables of the parent
+// (glibc implements it with clone(CLONE_VM | CLONE_VFORK) followed by exec),
+// so the cost of starting a child doesn't grow with the size of the parent.
+// fds_to_close are closed in the child, all other fds are inherited.
+static pid_t spawnRole(char* const* role_args, const int* fds_to_close, size_t fds_to_close_count)
+{
+    char* argv[8];
+    size_t argc = 0;
+
+    argv[argc++] = (char*)program_name;
+    argv[argc++] = ROLE_ARGUMENT;
+    for (size_t i = 0; role_args[i] != NULL && argc < sizeof(argv) / sizeof(argv[0]) - 1; ++i) {
+        argv[argc++] = role_args[i];
+    }
+    argv[argc] = NULL;
+
+    posix_spawn_file_actions_t file_actions;
+    if ((errno = posix_spawn_file_actions_init(&file_actions)) != 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < fds_to_close_count; ++i) {
+        if (fds_to_close[i] != -1 && (errno = posix_spawn_file_actions_addclose(&file_actions, fds_to_close[i])) != 0) {
+            posix_spawn_file_actions_destroy(&file_actions);
+            return -1;
+        }
+    }
+
+    // Flush buffered output, so that logs of the parent and the child don't get mixed up.
+    fflush(stdout);
+
+    pid_t pid = -1;
+    const int result = posix_spawn(&pid, SELF_EXECUTABLE, &file_actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&file_actions);
+
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+
+    return pid;
+}
+
 // Data Handler: Computes string difference from input_fd_1 and input_fd_2
 // and dumps the result into output_fd_1 and output_fd_2.
 // Uses cyclic reading to avoid buffer overflow.
@@ -311,16 +368,14 @@ int readerWriter(
         return 1;
     }
 
-    // Fork for data handler process inside reader-writer.
-    int fork_result = fork();
-    if (fork_result == -1) {
-        return 1;
-    }
+    // Spawn data handler process inside reader-writer and pass input strings to it.
+    char* const handler_args[] = { "handler",
+        (char*)unhandled_data_pipe_name_1, (char*)unhandled_data_pipe_name_2,
+        (char*)handled_data_pipe_name_1, (char*)handled_data_pipe_name_2, NULL };
 
-    // Pass input strings to data handler.
-    if (fork_result == 0) {
-        return dataHandler(unhandled_data_pipe_name_1, unhandled_data_pipe_name_2,
-            handled_data_pipe_name_1, handled_data_pipe_name_2);
+    if (spawnRole(handler_args, NULL, 0) == -1) {
+        printf("[Reader-Writer Error] Failed to spawn data handler process: %s\n", strerror(errno));
+        return 1;
     }
 
     int input_fd_1 = -1;
@@ -418,21 +473,38 @@ void checkArgumentCount(bool arg_condition, const char* arg_name)
     }
 }
 
+// runRole: Entry point of a child process started by spawnRole.
+static int runRole(int argc, char** argv)
+{
+    if (argc == 5 && strcmp(argv[0], "reader-writer") == 0) {
+        return readerWriter(argv[1], argv[2], argv[3], argv[4]);
+    }
+
+    if (argc == 5 && strcmp(argv[0], "handler") == 0) {
+        return dataHandler(argv[1], argv[2], argv[3], argv[4]);
+    }
+
+    printf("[Error] Unknown process role '%s'\n", argc > 0 ? argv[0] : "");
+    return 1;
+}
+
 int main(int argc, char** argv)
 {
+    program_name = argv[0];
+    if (argc >= 2 && strcmp(argv[1], ROLE_ARGUMENT) == 0) {
+        return runRole(argc - 2, argv + 2);
+    }
+
     checkArgumentCount(argc < 2, "<input_file_1>");
     checkArgumentCount(argc < 3, "<input_file_2>");
     checkArgumentCount(argc < 4, "<output_file_1>");
     checkArgumentCount(argc < 5, "<output_file_1>");
 
-    int fork_result = fork();
-    if (fork_result == -1) {
-        printf("[Error] Failed to fork for reader-writer process: %s\n", strerror(errno));
-        return 1;
-    }
+    char* const reader_writer_args[] = { "reader-writer", argv[1], argv[2], argv[3], argv[4], NULL };
 
-    if (fork_result == 0) {
-        return readerWriter(argv[1], argv[2], argv[3], argv[4]);
+    if (spawnRole(reader_writer_args, NULL, 0) == -1) {
+        printf("[Error] Failed to spawn reader-writer process: %s\n", strerror(errno));
+        return 1;
     }
 
     int reader_writer_exit_status;
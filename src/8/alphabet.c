@@ -0,0 +1,211 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "alphabet.h"
+
+// Blocks are checked at once: long enough for the compares to dominate, short enough
+// for a block with a stray byte to cost little.
+#define ALPHABET_BLOCK 4096
+
+// The first chunk of a stream is sampled up to this many bytes to detect its alphabet.
+#define ALPHABET_SAMPLE 4096
+
+// The scan falls back to ALPHABET_ANY after this many failed checks in a row that taught it no new byte.
+#define ALPHABET_MAX_MISSES 4
+
+#define MAX_RANGES 8
+
+// Vectors of the SSE2 width, which every x86-64 has; other targets lower them as they can.
+typedef signed char byte_vector_t __attribute__((vector_size(16)));
+
+#define VECTOR_SIZE sizeof(byte_vector_t)
+
+typedef struct {
+    unsigned char first;
+    unsigned char last;
+} byte_range_t;
+
+// Alphabets as lists of byte ranges, expanded both into the range tables and into the compares of
+// their block checks, so every check is a fixed sequence of compares against constants.
+// Every alphabet allows line breaks, as most inputs of these alphabets come in lines.
+#define LINE_BREAK_RANGES(RANGE) RANGE('\n', '\n') RANGE('\r', '\r')
+#define DIGITS_RANGES(RANGE) RANGE('0', '9') LINE_BREAK_RANGES(RANGE)
+#define HEX_RANGES(RANGE) RANGE('0', '9') RANGE('a', 'f') RANGE('A', 'F') LINE_BREAK_RANGES(RANGE)
+#define BASE64_RANGES(RANGE) \
+    RANGE('A', 'Z') RANGE('a', 'z') RANGE('0', '9') RANGE('+', '+') RANGE('/', '/') RANGE('=', '=') LINE_BREAK_RANGES(RANGE)
+#define DNA_RANGES(RANGE) RANGE('A', 'A') RANGE('C', 'C') RANGE('G', 'G') RANGE('T', 'T') LINE_BREAK_RANGES(RANGE)
+
+#define RANGE_ENTRY(first, last) { first, last },
+
+static const byte_range_t digits_ranges[] = { DIGITS_RANGES(RANGE_ENTRY) };
+static const byte_range_t hex_ranges[] = { HEX_RANGES(RANGE_ENTRY) };
+static const byte_range_t base64_ranges[] = { BASE64_RANGES(RANGE_ENTRY) };
+static const byte_range_t dna_ranges[] = { DNA_RANGES(RANGE_ENTRY) };
+
+#define RANGE_COUNT(ranges) (sizeof(ranges) / sizeof(ranges[0]))
+
+// Mask of the bytes of vector within first..last, all ones for bytes in it. SSE2 compares signed bytes only,
+// so the unsigned "vector - first <= last - first" is made signed by moving both sides by 128.
+#define IN_RANGE(vector, first, last) ((vector) - (signed char)((first) - 128) <= (signed char)((last) - (first) - 128))
+
+// Checks whether a block of whole vectors has only bytes of the enabled ranges.
+typedef bool (*block_check_t)(const char* data, size_t length, const byte_vector_t enabled[MAX_RANGES]);
+
+#define ALLOW_RANGE(first, last) allowed |= IN_RANGE(vector, first, last) & enabled[range++];
+
+#define DEFINE_BLOCK_CHECK(name, RANGES)                                                          \
+    static bool name(const char* data, size_t length, const byte_vector_t enabled[MAX_RANGES])     \
+    {                                                                                             \
+        byte_vector_t outside = { 0 };                                                            \
+        for (size_t i = 0; i < length; i += VECTOR_SIZE) {                                        \
+            byte_vector_t vector;                                                                 \
+            memcpy(&vector, data + i, VECTOR_SIZE);                                               \
+            byte_vector_t allowed = { 0 };                                                        \
+            size_t range = 0;                                                                     \
+            RANGES(ALLOW_RANGE)                                                                   \
+            outside |= ~allowed;                                                                  \
+        }                                                                                         \
+        uint64_t words[VECTOR_SIZE / sizeof(uint64_t)];                                           \
+        memcpy(words, &outside, sizeof(words));                                                   \
+        return (words[0] | words[1]) == 0;                                                        \
+    }
+
+DEFINE_BLOCK_CHECK(checkDigits, DIGITS_RANGES)
+DEFINE_BLOCK_CHECK(checkHex, HEX_RANGES)
+DEFINE_BLOCK_CHECK(checkBase64, BASE64_RANGES)
+DEFINE_BLOCK_CHECK(checkDna, DNA_RANGES)
+
+typedef struct {
+    const char* name;
+    const byte_range_t* ranges;
+    size_t range_count;
+    block_check_t check;
+} alphabet_kernel_t;
+
+// In the order of alphabet_t.
+static const alphabet_kernel_t alphabet_kernels[ALPHABET_COUNT] = {
+    { "auto", NULL, 0, NULL },
+    { "any", NULL, 0, NULL },
+    { "digits", digits_ranges, RANGE_COUNT(digits_ranges), checkDigits },
+    { "hex", hex_ranges, RANGE_COUNT(hex_ranges), checkHex },
+    { "base64", base64_ranges, RANGE_COUNT(base64_ranges), checkBase64 },
+    { "dna", dna_ranges, RANGE_COUNT(dna_ranges), checkDna },
+};
+
+// Alphabets from the smallest one, detection takes the first one that fits.
+static const alphabet_t detection_order[] = { ALPHABET_DNA, ALPHABET_DIGITS, ALPHABET_HEX, ALPHABET_BASE64 };
+
+static bool rangePresent(const presence_t* presence, byte_range_t range)
+{
+    for (unsigned byte = range.first; byte <= range.last; ++byte) {
+        if (!presenceContains(presence, (unsigned char)byte)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool presenceEqual(const presence_t* presence_1, const presence_t* presence_2)
+{
+    return memcmp(presence_1->words, presence_2->words, sizeof(presence_1->words)) == 0;
+}
+
+int parseAlphabet(const char* text, alphabet_t* alphabet)
+{
+    for (int i = 0; i < ALPHABET_COUNT; ++i) {
+        if (strcmp(text, alphabet_kernels[i].name) == 0) {
+            *alphabet = (alphabet_t)i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+const char* alphabetName(alphabet_t alphabet)
+{
+    return alphabet_kernels[alphabet].name;
+}
+
+alphabet_t detectAlphabet(const char* data, size_t length)
+{
+    if (length == 0) {
+        return ALPHABET_ANY;
+    }
+
+    presence_t sample;
+    presenceClear(&sample);
+    presenceAdd(&sample, data, length);
+
+    for (size_t i = 0; i < sizeof(detection_order) / sizeof(detection_order[0]); ++i) {
+        const alphabet_kernel_t* kernel = &alphabet_kernels[detection_order[i]];
+
+        presence_t outside = sample;
+        for (size_t r = 0; r < kernel->range_count; ++r) {
+            for (unsigned byte = kernel->ranges[r].first; byte <= kernel->ranges[r].last; ++byte) {
+                outside.words[byte >> 6] &= ~((uint64_t)1 << (byte & 63));
+            }
+        }
+
+        if (presenceCount(&outside) == 0) {
+            return detection_order[i];
+        }
+    }
+
+    return ALPHABET_ANY;
+}
+
+void alphabetScanInit(alphabet_scan_t* scan, alphabet_t hint)
+{
+    scan->alphabet = hint;
+    scan->misses = 0;
+}
+
+void alphabetAdd(alphabet_scan_t* scan, presence_t* presence, const char* data, size_t length)
+{
+    if (scan->alphabet == ALPHABET_AUTO && length > 0) {
+        scan->alphabet = detectAlphabet(data, length < ALPHABET_SAMPLE ? length : ALPHABET_SAMPLE);
+    }
+
+    const alphabet_kernel_t* kernel = &alphabet_kernels[scan->alphabet];
+    if (kernel->check == NULL) {
+        presenceAdd(presence, data, length);
+        return;
+    }
+
+    for (size_t offset = 0; offset < length;) {
+        const size_t block = length - offset < ALPHABET_BLOCK ? length - offset : ALPHABET_BLOCK;
+        const size_t checked = block - block % VECTOR_SIZE;
+
+        // A range is enabled once all of its bytes are in the set: a block of enabled ranges only adds nothing.
+        byte_vector_t enabled[MAX_RANGES];
+        bool any_enabled = false;
+        for (size_t r = 0; r < kernel->range_count; ++r) {
+            const bool present = rangePresent(presence, kernel->ranges[r]);
+            for (size_t j = 0; j < VECTOR_SIZE; ++j) {
+                enabled[r][j] = present ? -1 : 0;
+            }
+            any_enabled |= present;
+        }
+
+        if (checked > 0 && any_enabled && kernel->check(data + offset, checked, enabled)) {
+            scan->misses = 0;
+            presenceAdd(presence, data + offset + checked, block - checked);
+            offset += block;
+            continue;
+        }
+
+        const presence_t before = *presence;
+        presenceAdd(presence, data + offset, block);
+        offset += block;
+
+        // Failing while the set still grows is how the alphabet is learned, failing without it is a miss.
+        if (checked > 0 && any_enabled && presenceEqual(&before, presence) && ++scan->misses >= ALPHABET_MAX_MISSES) {
+            scan->alphabet = ALPHABET_ANY;
+            presenceAdd(presence, data + offset, length - offset);
+            return;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "presence.h"
+
+// Byte set kernels specialized for inputs known to use a small alphabet.
+// Every alphabet is a few byte ranges fixed at compile time. Once the byte set of a stream
+// holds every byte of a range, a block made of such ranges can't add anything to it,
+// so it is only checked with a handful of vector compares instead of being added byte by byte.
+// Blocks with other bytes are added as usual: results are exact for any input,
+// a wrong alphabet only costs speed, and the scan gives up on it after a few such blocks.
+
+// Every alphabet also allows '\n' and '\r'.
+typedef enum {
+    // Detected from a sample of the first chunk of the stream.
+    ALPHABET_AUTO,
+    // Any bytes: plain presenceAdd.
+    ALPHABET_ANY,
+    // 0-9.
+    ALPHABET_DIGITS,
+    // 0-9, a-f and A-F.
+    ALPHABET_HEX,
+    // A-Z, a-z, 0-9, '+', '/' and the '=' padding.
+    ALPHABET_BASE64,
+    // A, C, G and T.
+    ALPHABET_DNA,
+    ALPHABET_COUNT
+} alphabet_t;
+
+// Parses "auto", "any", "digits", "hex", "base64" or "dna". Returns 0 on success.
+int parseAlphabet(const char* text, alphabet_t* alphabet);
+
+const char* alphabetName(alphabet_t alphabet);
+
+// Returns the smallest alphabet (line breaks allowed) that covers every byte of data, or ALPHABET_ANY.
+alphabet_t detectAlphabet(const char* data, size_t length);
+
+// Byte set scan of one stream with a specialized kernel.
+typedef struct {
+    alphabet_t alphabet;
+
+    // Failed checks in a row that added no new byte.
+    int misses;
+} alphabet_scan_t;
+
+void alphabetScanInit(alphabet_scan_t* scan, alphabet_t hint);
+
+// Marks every byte of data as present, like presenceAdd.
+void alphabetAdd(alphabet_scan_t* scan, presence_t* presence, const char* data, size_t length);
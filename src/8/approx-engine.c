@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bloom.h"
+#include "diff-engine.h"
+#include "spill.h"
+
+// Filters are sized for this many distinct tokens per stream unless told otherwise.
+#define APPROX_DEFAULT_EXPECTED_TOKENS ((size_t)1 << 20)
+
+// Spilled tokens are appended through a buffer of this size.
+#define APPROX_SPILL_BUFFER_SIZE ((size_t)256 << 10)
+
+// Approximate engine: every stream is summarized by a Bloom filter and its tokens
+// are spilled to disk as is. Each spilled stream is then replayed through the filter
+// of the other stream. Emitted tokens are deduplicated with one more filter per result.
+//
+// Bloom filters have no false negatives, so every emitted token is truly missing from
+// the other stream; false positives only drop tokens from the results.
+typedef struct {
+    diff_engine_t base;
+
+    const char* directory;
+    tokenizer_t tokenizers[2];
+    bloom_filter_t filters[2];
+    bloom_filter_t emitted[2];
+    spill_file_t spills[2];
+
+    char* read_buffer;
+    size_t read_buffer_size;
+} approx_engine_t;
+
+typedef struct {
+    bloom_filter_t* filter;
+    spill_file_t* spill;
+} approx_insert_t;
+
+static int insertApproximate(void* context, const char* token, size_t length)
+{
+    approx_insert_t* insert = context;
+    bloomFilterInsert(insert->filter, hashToken(token, length, 0));
+    return spillFileAppend(insert->spill, token, length);
+}
+
+static int approxEngineConsume(diff_engine_t* engine, int stream, const char* data, size_t length)
+{
+    approx_engine_t* approx_engine = (approx_engine_t*)engine;
+    approx_insert_t insert = { &approx_engine->filters[stream], &approx_engine->spills[stream] };
+    return tokenizerFeed(&approx_engine->tokenizers[stream], data, length, insertApproximate, &insert);
+}
+
+static int approxEngineFinish(diff_engine_t* engine, int stream)
+{
+    approx_engine_t* approx_engine = (approx_engine_t*)engine;
+    approx_insert_t insert = { &approx_engine->filters[stream], &approx_engine->spills[stream] };
+
+    return tokenizerFinish(&approx_engine->tokenizers[stream], insertApproximate, &insert)
+        || spillFileFinish(&approx_engine->spills[stream]);
+}
+
+typedef struct {
+    const bloom_filter_t* excluding;
+    bloom_filter_t* emitted;
+    token_writer_t* writer;
+} approx_emit_t;
+
+static int emitApproximate(void* context, const char* token, size_t length)
+{
+    approx_emit_t* emit = context;
+    const uint64_t hash = hashToken(token, length, 0);
+
+    if (bloomFilterContains(emit->excluding, hash) || bloomFilterTestAndInsert(emit->emitted, hash)) {
+        return 0;
+    }
+
+    return writeToken(emit->writer, token, length);
+}
+
+static int approxEngineEmit(diff_engine_t* engine, int result, int fd)
+{
+    approx_engine_t* approx_engine = (approx_engine_t*)engine;
+
+    static token_writer_t writer;
+    tokenWriterInit(&writer, fd);
+
+    approx_emit_t emit = { &approx_engine->filters[1 - result], &approx_engine->emitted[result], &writer };
+    if (spillFileForEach(&approx_engine->spills[result], &approx_engine->read_buffer,
+            &approx_engine->read_buffer_size, emitApproximate, &emit)
+            != 0
+        || flushTokens(&writer) != 0) {
+        return 1;
+    }
+
+    // A token unique to this stream is dropped if either the other stream's filter
+    // or the deduplication filter reports a false positive for it.
+    const double excluding_rate = bloomFilterFalsePositiveRate(emit.excluding);
+    const double emitted_rate = bloomFilterFalsePositiveRate(emit.emitted);
+    const size_t memory = bloomFilterMemoryUsage(&approx_engine->filters[0])
+        + bloomFilterMemoryUsage(&approx_engine->filters[1])
+        + bloomFilterMemoryUsage(&approx_engine->emitted[0])
+        + bloomFilterMemoryUsage(&approx_engine->emitted[1]);
+
+    printf("[Approx Engine] Result %d: ~%.0f distinct tokens in stream %d, ~%.0f in stream %d\n",
+        result + 1, bloomFilterEstimateCount(&approx_engine->filters[result]), result + 1,
+        bloomFilterEstimateCount(emit.excluding), 2 - result);
+    printf("[Approx Engine] Result %d: achieved false positive rates %.3g (stream %d filter) and %.3g "
+           "(deduplication filter), a unique token is missing with probability <= %.3g; "
+           "no token is included by mistake, %zu bytes of filters\n",
+        result + 1, excluding_rate, 2 - result, emitted_rate, excluding_rate + emitted_rate, memory);
+
+    return 0;
+}
+
+static void approxEngineDestroy(diff_engine_t* engine)
+{
+    approx_engine_t* approx_engine = (approx_engine_t*)engine;
+
+    for (int i = 0; i < 2; ++i) {
+        tokenizerFree(&approx_engine->tokenizers[i]);
+        bloomFilterFree(&approx_engine->filters[i]);
+        bloomFilterFree(&approx_engine->emitted[i]);
+        spillFileClose(&approx_engine->spills[i]);
+    }
+
+    free(approx_engine->read_buffer);
+    free(approx_engine);
+}
+
+diff_engine_t* createApproxEngine(const diff_engine_options_t* options)
+{
+    approx_engine_t* engine = calloc(1, sizeof(*engine));
+    if (engine == NULL) {
+        printf("[Engine Error] Failed to allocate approximate engine\n");
+        return NULL;
+    }
+
+    engine->base.consume = approxEngineConsume;
+    engine->base.finish = approxEngineFinish;
+    engine->base.emit = approxEngineEmit;
+    engine->base.destroy = approxEngineDestroy;
+    engine->directory = options->spill_directory;
+    engine->spills[0].fd = -1;
+    engine->spills[1].fd = -1;
+
+    const size_t expected_tokens = options->expected_tokens != 0
+        ? options->expected_tokens
+        : APPROX_DEFAULT_EXPECTED_TOKENS;
+
+    for (int i = 0; i < 2; ++i) {
+        tokenizerInit(&engine->tokenizers[i], options->tokenizer_mode, options->ngram_length);
+
+        if (bloomFilterInit(&engine->filters[i], expected_tokens, options->false_positive_rate) != 0
+            || bloomFilterInit(&engine->emitted[i], expected_tokens, options->false_positive_rate) != 0
+            || spillFileOpen(&engine->spills[i], engine->directory, APPROX_SPILL_BUFFER_SIZE) != 0) {
+            approxEngineDestroy(&engine->base);
+            return NULL;
+        }
+    }
+
+    printf("[Approx Engine] Filters for %zu tokens at false positive rate %g: %llu bits, %d hash functions each\n",
+        expected_tokens, options->false_positive_rate,
+        (unsigned long long)engine->filters[0].bit_count, engine->filters[0].hash_count);
+
+    return &engine->base;
+}
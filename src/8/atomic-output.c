@@ -0,0 +1,250 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "atomic-output.h"
+
+int parseDurability(const char* text, durability_t* durability)
+{
+    if (strcmp(text, "none") == 0) {
+        *durability = DURABILITY_NONE;
+    } else if (strcmp(text, "data") == 0) {
+        *durability = DURABILITY_DATA;
+    } else if (strcmp(text, "group") == 0) {
+        *durability = DURABILITY_GROUP;
+    } else {
+        return 1;
+    }
+
+    return 0;
+}
+
+// Copies the directory part of path into directory ("." if there is none).
+static void directoryOf(const char* path, char* directory, size_t size)
+{
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL) {
+        snprintf(directory, size, ".");
+    } else if (slash == path) {
+        snprintf(directory, size, "/");
+    } else {
+        snprintf(directory, size, "%.*s", (int)(slash - path), path);
+    }
+}
+
+int openAtomicOutput(atomic_output_t* output, const char* path)
+{
+    output->path = path;
+    output->temporary_path[0] = '\0';
+
+    char directory[4096];
+    directoryOf(path, directory, sizeof(directory));
+
+    // Unnamed files leave nothing behind if the program dies before publishing them.
+    if ((output->fd = open(directory, O_TMPFILE | O_WRONLY | O_CLOEXEC, 0666)) >= 0) {
+        return 0;
+    }
+
+    if (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL) {
+        printf("[Output Error] Failed to create file for '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    snprintf(output->temporary_path, sizeof(output->temporary_path), "%s.XXXXXX", path);
+    if ((output->fd = mkostemp(output->temporary_path, O_CLOEXEC)) < 0) {
+        printf("[Output Error] Failed to create temporary file for '%s': %s\n", path, strerror(errno));
+        output->temporary_path[0] = '\0';
+        return 1;
+    }
+
+    // mkostemp creates files readable by the owner only, outputs are as readable as with open(0666).
+    const mode_t mask = umask(0);
+    umask(mask);
+    fchmod(output->fd, 0666 & ~mask);
+
+    return 0;
+}
+
+void discardAtomicOutput(atomic_output_t* output)
+{
+    if (output->fd != -1) {
+        close(output->fd);
+        output->fd = -1;
+    }
+
+    if (output->temporary_path[0] != '\0') {
+        unlink(output->temporary_path);
+        output->temporary_path[0] = '\0';
+    }
+}
+
+// Gives an unnamed file a temporary name next to its path: linkat can't replace files, rename can.
+static int nameOutput(atomic_output_t* output)
+{
+    char fd_path[64];
+    snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", output->fd);
+
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        snprintf(output->temporary_path, sizeof(output->temporary_path), "%s.%d.%d", output->path, (int)getpid(), attempt);
+
+        if (linkat(AT_FDCWD, fd_path, AT_FDCWD, output->temporary_path, AT_SYMLINK_FOLLOW) == 0) {
+            return 0;
+        }
+
+        if (errno != EEXIST) {
+            break;
+        }
+    }
+
+    printf("[Output Error] Failed to link file for '%s': %s\n", output->path, strerror(errno));
+    output->temporary_path[0] = '\0';
+    return 1;
+}
+
+// Flushes the directory entries of the published outputs, once per directory in a row.
+static int syncDirectories(const atomic_output_t* outputs, size_t count)
+{
+    char previous[4096] = "";
+    int exit_code = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        char directory[4096];
+        directoryOf(outputs[i].path, directory, sizeof(directory));
+        if (strcmp(directory, previous) == 0) {
+            continue;
+        }
+
+        const int directory_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (directory_fd < 0 || fsync(directory_fd) != 0) {
+            printf("[Output Error] Failed to sync directory '%s': %s\n", directory, strerror(errno));
+            exit_code = 1;
+        }
+
+        if (directory_fd >= 0) {
+            close(directory_fd);
+        }
+
+        snprintf(previous, sizeof(previous), "%s", directory);
+    }
+
+    return exit_code;
+}
+
+// Flushes the data of the outputs: every file on its own or, for a group, every file system once.
+static int syncOutputs(const atomic_output_t* outputs, size_t count, durability_t durability)
+{
+    dev_t synced_device = 0;
+    bool synced_any = false;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (durability == DURABILITY_DATA) {
+            if (fdatasync(outputs[i].fd) != 0) {
+                printf("[Output Error] Failed to flush '%s': %s\n", outputs[i].path, strerror(errno));
+                return 1;
+            }
+            continue;
+        }
+
+        struct stat output_stat;
+        if (fstat(outputs[i].fd, &output_stat) == 0 && synced_any && output_stat.st_dev == synced_device) {
+            continue;
+        }
+
+        if (syncfs(outputs[i].fd) != 0) {
+            printf("[Output Error] Failed to flush file system of '%s': %s\n", outputs[i].path, strerror(errno));
+            return 1;
+        }
+
+        synced_device = output_stat.st_dev;
+        synced_any = true;
+    }
+
+    return 0;
+}
+
+int publishAtomicOutputs(atomic_output_t* outputs, size_t count, durability_t durability)
+{
+    int exit_code = 0;
+
+    if (durability != DURABILITY_NONE && syncOutputs(outputs, count, durability) != 0) {
+        for (size_t i = 0; i < count; ++i) {
+            discardAtomicOutput(&outputs[i]);
+        }
+        return 1;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if ((outputs[i].temporary_path[0] == '\0' && nameOutput(&outputs[i]) != 0)
+            || rename(outputs[i].temporary_path, outputs[i].path) != 0) {
+            if (outputs[i].temporary_path[0] != '\0') {
+                printf("[Output Error] Failed to publish '%s': %s\n", outputs[i].path, strerror(errno));
+            }
+            discardAtomicOutput(&outputs[i]);
+            exit_code = 1;
+            continue;
+        }
+
+        outputs[i].temporary_path[0] = '\0';
+        close(outputs[i].fd);
+        outputs[i].fd = -1;
+    }
+
+    if (durability != DURABILITY_NONE && syncDirectories(outputs, count) != 0) {
+        exit_code = 1;
+    }
+
+    return exit_code;
+}
+
+int writeVector(int fd, struct iovec* vector, int count)
+{
+    while (count > 0) {
+        const ssize_t written = writev(fd, vector, count < IOV_MAX ? count : IOV_MAX);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Output Error] Failed to write to fd %d: %s\n", fd, strerror(errno));
+            return 1;
+        }
+
+        // Skips what was written, the first unfinished buffer is advanced in place.
+        size_t left = (size_t)written;
+        while (count > 0 && left >= vector->iov_len) {
+            left -= vector->iov_len;
+            ++vector;
+            --count;
+        }
+
+        if (count > 0) {
+            vector->iov_base = (char*)vector->iov_base + left;
+            vector->iov_len -= left;
+        }
+    }
+
+    return 0;
+}
+
+int writeAtomicFile(const char* path, struct iovec* vector, int count, durability_t durability)
+{
+    atomic_output_t output;
+    if (openAtomicOutput(&output, path) != 0) {
+        return 1;
+    }
+
+    if (writeVector(output.fd, vector, count) != 0) {
+        discardAtomicOutput(&output);
+        return 1;
+    }
+
+    return publishAtomicOutputs(&output, 1, durability);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+// How hard publishing an output tries to survive a crash.
+typedef enum {
+    // Readers never see a partial file, but after a crash it may be empty or missing.
+    DURABILITY_NONE,
+    // Every output is flushed with fdatasync before it's published, its directory is synced after.
+    DURABILITY_DATA,
+    // Outputs published together are flushed with one syncfs per file system instead.
+    DURABILITY_GROUP
+} durability_t;
+
+// Parses "none", "data" or "group". Returns 0 on success.
+int parseDurability(const char* text, durability_t* durability);
+
+// Output file written aside and published under its path only when complete.
+typedef struct {
+    const char* path;
+    int fd;
+
+    // Name of the temporary file, empty for an unnamed O_TMPFILE one.
+    char temporary_path[4096 + 8];
+} atomic_output_t;
+
+// Creates an unnamed file (O_TMPFILE) in the directory of path, or a temporary one next to it
+// where O_TMPFILE isn't supported. path must stay valid until the output is published or discarded.
+int openAtomicOutput(atomic_output_t* output, const char* path);
+
+// Publishes the outputs under their paths, replacing existing files, and closes them.
+// Outputs that failed to publish are discarded.
+int publishAtomicOutputs(atomic_output_t* outputs, size_t count, durability_t durability);
+
+void discardAtomicOutput(atomic_output_t* output);
+
+// Writes the whole vector, retrying on partial writes.
+int writeVector(int fd, struct iovec* vector, int count);
+
+// Writes a file from a vector of buffers with a single writev and publishes it.
+int writeAtomicFile(const char* path, struct iovec* vector, int count, durability_t durability);
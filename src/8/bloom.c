@@ -0,0 +1,121 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bloom.h"
+
+int bloomFilterInit(bloom_filter_t* filter, size_t expected_count, double false_positive_rate)
+{
+    if (expected_count == 0) {
+        expected_count = 1;
+    }
+
+    // Optimal parameters: m = -n ln(p) / ln(2)^2 bits and k = m / n ln(2) hash functions.
+    const double ln2 = log(2.0);
+    const double bits = -(double)expected_count * log(false_positive_rate) / (ln2 * ln2);
+
+    filter->bit_count = ((uint64_t)ceil(bits) + 63) & ~(uint64_t)63;
+    if (filter->bit_count < 64) {
+        filter->bit_count = 64;
+    }
+
+    filter->hash_count = (int)lround((double)filter->bit_count / (double)expected_count * ln2);
+    if (filter->hash_count < 1) {
+        filter->hash_count = 1;
+    }
+
+    filter->bits = calloc(filter->bit_count / 64, sizeof(uint64_t));
+    if (filter->bits == NULL) {
+        printf("[Bloom Filter Error] Failed to allocate %llu bits\n", (unsigned long long)filter->bit_count);
+        return 1;
+    }
+
+    return 0;
+}
+
+void bloomFilterFree(bloom_filter_t* filter)
+{
+    free(filter->bits);
+    filter->bits = NULL;
+    filter->bit_count = 0;
+}
+
+// Second hash for double hashing, the finalizer of MurmurHash3.
+// Forced to be odd, so that it never degenerates into a single position.
+static uint64_t secondHash(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash | 1;
+}
+
+void bloomFilterInsert(bloom_filter_t* filter, uint64_t hash)
+{
+    bloomFilterTestAndInsert(filter, hash);
+}
+
+bool bloomFilterContains(const bloom_filter_t* filter, uint64_t hash)
+{
+    const uint64_t step = secondHash(hash);
+
+    for (int i = 0; i < filter->hash_count; ++i) {
+        const uint64_t position = (hash + (uint64_t)i * step) % filter->bit_count;
+        if ((filter->bits[position / 64] & ((uint64_t)1 << (position % 64))) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool bloomFilterTestAndInsert(bloom_filter_t* filter, uint64_t hash)
+{
+    const uint64_t step = secondHash(hash);
+    bool present = true;
+
+    for (int i = 0; i < filter->hash_count; ++i) {
+        const uint64_t position = (hash + (uint64_t)i * step) % filter->bit_count;
+        const uint64_t mask = (uint64_t)1 << (position % 64);
+
+        if ((filter->bits[position / 64] & mask) == 0) {
+            present = false;
+            filter->bits[position / 64] |= mask;
+        }
+    }
+
+    return present;
+}
+
+size_t bloomFilterMemoryUsage(const bloom_filter_t* filter)
+{
+    return filter->bit_count / 8;
+}
+
+static uint64_t countSetBits(const bloom_filter_t* filter)
+{
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < filter->bit_count / 64; ++i) {
+        count += __builtin_popcountll(filter->bits[i]);
+    }
+
+    return count;
+}
+
+double bloomFilterFalsePositiveRate(const bloom_filter_t* filter)
+{
+    const double fill = (double)countSetBits(filter) / (double)filter->bit_count;
+    return pow(fill, filter->hash_count);
+}
+
+double bloomFilterEstimateCount(const bloom_filter_t* filter)
+{
+    const double fill = (double)countSetBits(filter) / (double)filter->bit_count;
+    if (fill >= 1.0) {
+        return INFINITY;
+    }
+
+    return -(double)filter->bit_count / filter->hash_count * log(1.0 - fill);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bloom filter over 64-bit token hashes. Bit positions come from double hashing:
+// position_i = h1 + i * h2, where h2 is derived from h1 by a mixing function.
+typedef struct {
+    uint64_t* bits;
+    uint64_t bit_count;
+    int hash_count;
+} bloom_filter_t;
+
+// Sizes the filter for expected_count tokens at the given false positive rate.
+int bloomFilterInit(bloom_filter_t* filter, size_t expected_count, double false_positive_rate);
+void bloomFilterFree(bloom_filter_t* filter);
+
+void bloomFilterInsert(bloom_filter_t* filter, uint64_t hash);
+bool bloomFilterContains(const bloom_filter_t* filter, uint64_t hash);
+
+// Inserts the hash and returns whether it was (probably) present before.
+bool bloomFilterTestAndInsert(bloom_filter_t* filter, uint64_t hash);
+
+size_t bloomFilterMemoryUsage(const bloom_filter_t* filter);
+
+// False positive rate achieved by the current filling: (set bits / all bits) ^ hash_count.
+double bloomFilterFalsePositiveRate(const bloom_filter_t* filter);
+
+// Estimates the number of distinct inserted tokens from the number of set bits.
+double bloomFilterEstimateCount(const bloom_filter_t* filter);
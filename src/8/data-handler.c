@@ -1,104 +1,365 @@
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "common.h"
+#include "diff-engine.h"
+#include "incremental-state.h"
+#include "multiplexer.h"
+#include "placement.h"
+#include "presence-index.h"
+#include "rendezvous.h"
+#include "result-cache.h"
+#include "server.h"
+#include "session.h"
+#include "spill.h"
+
+#define DEFAULT_SPILL_PARTITIONS 16
+
+// One-vs-many mode runs at most this many worker processes.
+#define MAX_WORKERS 64
+
+// consumeFile: Maps a regular input file from offset to its end and feeds it to the engine without copying.
+static int consumeFile(diff_engine_t* engine, int stream, int input_fd, size_t offset, size_t size)
+{
+    if (size > offset) {
+        // Mappings start at a page boundary, the bytes before offset are skipped.
+        const size_t page_offset = offset % (size_t)sysconf(_SC_PAGESIZE);
+        const size_t mapped_size = size - offset + page_offset;
+
+        char* data = mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE, input_fd, (off_t)(offset - page_offset));
+        if (data == MAP_FAILED) {
+            printf("[Handler Error] Failed to map input file %d: %s\n", stream + 1, strerror(errno));
+            return 1;
+        }
 
-typedef enum {
-    STR_DIFF_UNKNOWN,
-    STR_DIFF_INCLUDED,
-    STR_DIFF_EXCLUDED
-} string_difference_t;
+        madvise(data, mapped_size, MADV_SEQUENTIAL);
 
-void updateStringDifference(
-    const char* including, size_t including_length,
-    const char* excluding, size_t excluding_length,
-    string_difference_t* result)
-{
-    for (size_t i = 0; i < including_length; ++i) {
-        if (result[(unsigned char)including[i]] != STR_DIFF_EXCLUDED) {
-            result[(unsigned char)including[i]] = STR_DIFF_INCLUDED;
+        const int exit_code = engine->consume(engine, stream, data + page_offset, size - offset);
+        munmap(data, mapped_size);
+
+        if (exit_code != 0) {
+            printf("[Handler Error] Failed to handle input file %d\n", stream + 1);
+            return 1;
         }
     }
 
-    for (size_t i = 0; i < excluding_length; ++i) {
-        result[(unsigned char)excluding[i]] = STR_DIFF_EXCLUDED;
+    if (engine->finish(engine, stream) != 0) {
+        printf("[Handler Error] Failed to finish handling input file %d\n", stream + 1);
+        return 1;
     }
+
+    printf("[Handler] Handled a string of length %zu from file fd %d\n", size - offset, input_fd);
+
+    return 0;
 }
 
-int handleStrings(int input_fd_1, int input_fd_2, int output_fd_1, int output_fd_2)
+// consumeIndexedFile: Takes the byte set of the part of a regular input file covered by its
+// presence index from the index and maps only the rest of the file. Falls back to scanning
+// the whole file if the index doesn't match it.
+static int consumeIndexedFile(diff_engine_t* engine, int stream, int input_fd, int index_fd, size_t size)
 {
-    printf("[Handler] Started with input fds %d and %d\n", input_fd_1, input_fd_2);
+    if (engine->restore == NULL) {
+        printf("[Handler] Only byte differences use presence indexes, scanning input file %d\n", stream + 1);
+        return consumeFile(engine, stream, input_fd, 0, size);
+    }
 
-    static char buffer_1[BUFFER_SIZE];
-    static char buffer_2[BUFFER_SIZE];
+    presence_index_t index;
+    if (readPresenceIndex(index_fd, &index) != 0) {
+        printf("[Handler] Index of input file %d is unreadable, scanning the file\n", stream + 1);
+        return consumeFile(engine, stream, input_fd, 0, size);
+    }
 
-    // Just to be sure, we'll be allocating an array of size 256.
-    static string_difference_t string_difference_1[256];
-    static string_difference_t string_difference_2[256];
+    const bool valid = checkFileMark(&index.header.mark, input_fd);
+    const size_t covered = (size_t)index.header.mark.size;
+    const unsigned long long block_count = (unsigned long long)index.header.block_count;
 
-    // Clearing potential leftover data.
-    memset(string_difference_1, STR_DIFF_UNKNOWN, sizeof(string_difference_1));
-    memset(string_difference_2, STR_DIFF_UNKNOWN, sizeof(string_difference_2));
+    presence_t presence;
+    presenceIndexUnion(&index, &presence);
+    freePresenceIndex(&index);
 
-    ssize_t read_result_1 = 0;
-    ssize_t read_result_2 = 0;
+    if (!valid) {
+        printf("[Handler] Index of input file %d doesn't match the file, scanning the file\n", stream + 1);
+        return consumeFile(engine, stream, input_fd, 0, size);
+    }
+
+    printf("[Handler] Took %d distinct bytes of the first %zu bytes of input file %d from %llu index blocks\n",
+        presenceCount(&presence), covered, stream + 1, block_count);
+
+    return engine->restore(engine, stream, &presence) || consumeFile(engine, stream, input_fd, covered, size);
+}
+
+// consumeCachedFile: Feeds a regular input file to the engine, taking its byte set from the cache
+// if the file didn't change since it was cached, and caching it otherwise.
+static int consumeCachedFile(diff_engine_t* engine, int stream, int input_fd, size_t size, result_cache_t* cache)
+{
+    cache_key_t key;
+    presence_t presence;
+
+    if (cacheKeyFromFd(input_fd, &key) != 0) {
+        return consumeFile(engine, stream, input_fd, 0, size);
+    }
+
+    if (resultCacheLookup(cache, &key, &presence)) {
+        printf("[Handler] Took %d distinct bytes of input file %d (length %zu) from the cache\n",
+            presenceCount(&presence), stream + 1, size);
+        return engine->restore(engine, stream, &presence) || engine->finish(engine, stream);
+    }
+
+    if (consumeFile(engine, stream, input_fd, 0, size) != 0) {
+        return 1;
+    }
+
+    return engine->summarize(engine, stream, &presence) || resultCacheStore(cache, &key, &presence);
+}
+
+// consumeRegularFile: Feeds the first size bytes of a regular input file to the engine. They're
+// taken from the presence index (index_fd, -1 if none) or looked up in the cache first if it's given.
+static int consumeRegularFile(diff_engine_t* engine, int stream, int input_fd, int index_fd, size_t size,
+    result_cache_t* cache)
+{
+    if (index_fd != -1) {
+        return consumeIndexedFile(engine, stream, input_fd, index_fd, size);
+    }
+
+    return cache != NULL
+        ? consumeCachedFile(engine, stream, input_fd, size, cache)
+        : consumeFile(engine, stream, input_fd, 0, size);
+}
+
+// consumeStream: Reads a stream from input_fd until its end and feeds it to the engine.
+// Uses cyclic reading to avoid buffer overflow. Regular files are mapped instead.
+int consumeStream(diff_engine_t* engine, int stream, int input_fd, int index_fd, result_cache_t* cache)
+{
+    struct stat input_stat;
+    if (fstat(input_fd, &input_stat) == 0 && S_ISREG(input_stat.st_mode)) {
+        return consumeRegularFile(engine, stream, input_fd, index_fd, (size_t)input_stat.st_size, cache);
+    }
+
+    static char buffer[BUFFER_SIZE];
+
+    ssize_t read_result = 0;
+    size_t read_bytes = 0;
 
-    // Computing string differences.
     do {
-        read_result_1 = read(input_fd_1, buffer_1, BUFFER_SIZE);
-        if (read_result_1 == -1) {
-            printf("[Handler Error] Failed to read another chunk from pipe 1: %s\n", strerror(errno));
+        read_result = read(input_fd, buffer, BUFFER_SIZE);
+        if (read_result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Handler Error] Failed to read another chunk from pipe %d: %s\n",
+                stream + 1, strerror(errno));
             return 1;
         }
 
-        read_result_2 = read(input_fd_2, buffer_2, BUFFER_SIZE);
-        if (read_result_2 == -1) {
-            printf("[Handler Error] Failed to read another chunk from pipe 2: %s\n", strerror(errno));
+        if (engine->consume(engine, stream, buffer, read_result) != 0) {
+            printf("[Handler Error] Failed to handle another chunk from pipe %d\n", stream + 1);
             return 1;
         }
 
-        updateStringDifference(buffer_1, read_result_1, buffer_2, read_result_2, string_difference_1);
-        updateStringDifference(buffer_2, read_result_2, buffer_1, read_result_1, string_difference_2);
-    } while (read_result_1 == BUFFER_SIZE || read_result_2 == BUFFER_SIZE);
+        read_bytes += read_result;
+    } while (read_result != 0);
 
-    // Compiling string results.
-    static char result_1[128];
-    static char result_2[128];
+    if (engine->finish(engine, stream) != 0) {
+        printf("[Handler Error] Failed to finish handling pipe %d\n", stream + 1);
+        return 1;
+    }
+
+    printf("[Handler] Handled a string of length %zu from fd %d\n", read_bytes, input_fd);
+
+    return 0;
+}
 
-    size_t result_1_length = 0;
-    for (int i = 0; i < 128; ++i) {
-        if (string_difference_1[i] == STR_DIFF_INCLUDED) {
-            result_1[result_1_length++] = (char)i;
+// consumeIncrementalFile: Feeds a regular input file to the engine, starting from where the previous
+// run stopped if the file only grew since then, and fills the state for the next run.
+static int consumeIncrementalFile(diff_engine_t* engine, int stream, int input_fd, int index_fd,
+    result_cache_t* cache, const input_state_t* previous, input_state_t* next)
+{
+    struct stat input_stat;
+    if (fstat(input_fd, &input_stat) != 0 || !S_ISREG(input_stat.st_mode)) {
+        printf("[Handler Error] Input %d of an incremental run isn't a regular file\n", stream + 1);
+        return 1;
+    }
+
+    const size_t size = (size_t)input_stat.st_size;
+    int exit_code = 0;
+
+    if (previous != NULL && checkFileMark(&previous->mark, input_fd)) {
+        printf("[Handler] Input file %d grew by %llu bytes since the previous run, handling only them\n",
+            stream + 1, (unsigned long long)(size - previous->mark.size));
+        exit_code = engine->restore(engine, stream, &previous->presence)
+            || consumeFile(engine, stream, input_fd, (size_t)previous->mark.size, size);
+    } else {
+        if (previous != NULL) {
+            printf("[Handler] Input file %d changed since the previous run, handling it whole\n", stream + 1);
         }
+        exit_code = consumeRegularFile(engine, stream, input_fd, index_fd, size, cache);
+    }
+
+    return exit_code
+        || engine->summarize(engine, stream, &next->presence)
+        || markFile(input_fd, size, &next->mark);
+}
+
+// consumeIncrementally: Consumes both input files of an incremental run and writes the new state into
+// state_out_fd. The previous state comes from state_in_fd, -1 if there was no previous run.
+static int consumeIncrementally(diff_engine_t* engine, const int input_fds[2], const int index_fds[2],
+    int state_in_fd, int state_out_fd, result_cache_t* cache)
+{
+    if (engine->restore == NULL || engine->summarize == NULL) {
+        printf("[Data Handler Error] Incremental mode is supported for byte differences only\n");
+        return 1;
     }
 
-    size_t result_2_length = 0;
-    for (int i = 0; i < 128; ++i) {
-        if (string_difference_2[i] == STR_DIFF_INCLUDED) {
-            result_2[result_2_length++] = (char)i;
+    incremental_state_t previous;
+    const bool has_previous = state_in_fd != -1 && readIncrementalState(state_in_fd, &previous) == 0;
+
+    input_state_t next[2];
+    for (int i = 0; i < 2; ++i) {
+        if (consumeIncrementalFile(engine, i, input_fds[i], index_fds[i], cache,
+                has_previous ? &previous.inputs[i] : NULL, &next[i])
+            != 0) {
+            return 1;
         }
     }
 
-    // Writing results.
-    if (write(output_fd_1, result_1, result_1_length) < 0) {
-        printf("[Handler Error] Failed to write result to pipe 1: %s\n", strerror(errno));
+    return writeIncrementalState(state_out_fd, next);
+}
+
+typedef struct {
+    char data[BUFFER_SIZE];
+    size_t length;
+    bool sent;
+} follow_frame_t;
+
+// publishFrame: Emits a result into scratch_fd and, if it differs from the last sent one,
+// writes it into output_fd as a frame: its length followed by its bytes.
+static int publishFrame(diff_engine_t* engine, int result, int scratch_fd, int output_fd, follow_frame_t* frame)
+{
+    static char buffer[sizeof(follow_frame_header_t) + BUFFER_SIZE];
+
+    if (ftruncate(scratch_fd, 0) != 0 || lseek(scratch_fd, 0, SEEK_SET) != 0
+        || engine->emit(engine, result, scratch_fd) != 0) {
+        printf("[Handler Error] Failed to compute result %d\n", result + 1);
+        return 1;
+    }
+
+    const off_t length = lseek(scratch_fd, 0, SEEK_CUR);
+    if (length < 0 || length > BUFFER_SIZE
+        || pread(scratch_fd, buffer + sizeof(follow_frame_header_t), (size_t)length, 0) != length) {
+        printf("[Handler Error] Failed to read back result %d\n", result + 1);
         return 1;
     }
 
-    if (write(output_fd_2, result_2, result_2_length) < 0) {
-        printf("[Handler Error] Failed to write result to pipe 2: %s\n", strerror(errno));
+    const char* data = buffer + sizeof(follow_frame_header_t);
+    if (frame->sent && frame->length == (size_t)length && memcmp(frame->data, data, frame->length) == 0) {
+        return 0;
+    }
+
+    const follow_frame_header_t header = { (uint32_t)length };
+    memcpy(buffer, &header, sizeof(header));
+
+    if (writeAll(output_fd, buffer, sizeof(header) + (size_t)length) != 0) {
         return 1;
     }
 
-    printf("[Handler] Passed results to output fds %d and %d\n", output_fd_1, output_fd_2);
+    memcpy(frame->data, data, (size_t)length);
+    frame->length = (size_t)length;
+    frame->sent = true;
 
+    printf("[Handler] Result %d changed, passed its new value of length %lld\n", result + 1, (long long)length);
     return 0;
 }
 
+// followStreams: Follow mode. Consumes whatever arrives on either input pipe and, once both of them
+// have nothing more for now, passes the results that changed since the last time. Runs until
+// reader-writer closes both inputs, then passes the final results.
+static int followStreams(diff_engine_t* engine, const int input_fds[2], const int output_fds[2])
+{
+    // Results are emitted many times, which only the byte engine supports.
+    if (engine->summarize == NULL) {
+        printf("[Data Handler Error] Follow mode is supported for byte differences only\n");
+        return 1;
+    }
+
+    const int scratch_fd = memfd_create("mark8-result", MFD_CLOEXEC);
+    if (scratch_fd < 0) {
+        printf("[Data Handler Error] Failed to create a scratch file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    static char buffer[BUFFER_SIZE];
+
+    // Pool handlers follow one connection after another, every one starts with nothing sent.
+    static follow_frame_t frames[2];
+    memset(frames, 0, sizeof(frames));
+    bool open_inputs[2] = { true, true };
+    int exit_code = 0;
+
+    while (exit_code == 0 && (open_inputs[0] || open_inputs[1])) {
+        struct pollfd poll_fds[2] = {
+            { open_inputs[0] ? input_fds[0] : -1, POLLIN, 0 },
+            { open_inputs[1] ? input_fds[1] : -1, POLLIN, 0 }
+        };
+
+        int ready = poll(poll_fds, 2, 0);
+        if (ready == 0) {
+            exit_code = publishFrame(engine, 0, scratch_fd, output_fds[0], &frames[0])
+                || publishFrame(engine, 1, scratch_fd, output_fds[1], &frames[1]);
+            ready = poll(poll_fds, 2, -1);
+        }
+
+        if (ready < 0) {
+            if (errno != EINTR) {
+                printf("[Handler Error] Failed to wait for input: %s\n", strerror(errno));
+                exit_code = 1;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < 2 && exit_code == 0; ++i) {
+            if ((poll_fds[i].revents & (POLLIN | POLLHUP)) == 0) {
+                continue;
+            }
+
+            const ssize_t read_bytes = read(input_fds[i], buffer, BUFFER_SIZE);
+            if (read_bytes < 0) {
+                if (errno != EINTR) {
+                    printf("[Handler Error] Failed to read another chunk from pipe %d: %s\n", i + 1, strerror(errno));
+                    exit_code = 1;
+                }
+            } else if (read_bytes == 0) {
+                open_inputs[i] = false;
+                exit_code = engine->finish(engine, i);
+                printf("[Handler] Input pipe %d is closed\n", i + 1);
+            } else {
+                exit_code = engine->consume(engine, i, buffer, (size_t)read_bytes);
+            }
+        }
+    }
+
+    if (exit_code == 0) {
+        exit_code = publishFrame(engine, 0, scratch_fd, output_fds[0], &frames[0])
+            || publishFrame(engine, 1, scratch_fd, output_fds[1], &frames[1]);
+    }
+
+    close(scratch_fd);
+    return exit_code;
+}
+
 // Helper function that closes a file descriptor and sets it to -1 only if it's not equal to -1.
 static void closeFile(int* fd)
 {
@@ -108,73 +369,629 @@ static void closeFile(int* fd)
     }
 }
 
-int main(int argc, char** argv)
+static void printUsage(void)
 {
-    // Data handler doesn't need argc, argv.
-    (void)argc;
-    (void)argv;
+    printf("Usage: ./mark8-h [--tokens=bytes|words|lines|ngrams:<N>] [--expected-tokens=<N>]\n"
+           "                 [--spill-partitions=<K>] [--memory-limit=<size>] [--spill-dir=<dir>]\n"
+           "                 [--approximate=<false_positive_rate>] [--format=text|bitmap|count]\n"
+           "                 [--alphabet=auto|any|digits|hex|base64|dna]\n"
+           "                 [--socket=<name> | --session[=<name>] | --serve=<name> [--multiplex]]\n"
+           "                 [--cache=<file>] [--workers=<N>] [--cpus=auto|<cpu_list>]\n"
+           "                 [--queue-depth=<N>] [--client-depth=<N>] [--max-wait=<ms>] [--metrics=<file>]\n");
+}
 
-    int input_fd_1 = -1;
-    if ((input_fd_1 = open(INPUT_FIFO_NAME_1, O_RDONLY)) < 0) {
+typedef struct {
+    // Pipes come over this rendezvous socket instead of FIFOs if set.
+    const char* socket_name;
+
+    // FIFOs are taken from a session directory if set: the named one or any unclaimed one if NULL.
+    bool use_session;
+    const char* session_name;
+
+    // Byte sets of input files are kept in this file between runs if set.
+    const char* cache_path;
+
+    // Server mode: connections at this rendezvous socket are served until the handler is stopped.
+    const char* serve_name;
+
+    // Server mode: every connection is served by one process as a state machine instead of by a pool.
+    bool multiplex;
+
+    // Server mode: admission limits of the connection queue and where its metrics go.
+    int queue_depth;
+    int client_depth;
+    int max_wait_ms;
+    const char* metrics_path;
+
+    // Number of processes handling candidates in one-vs-many mode, or connections in server mode.
+    int workers;
+
+    // CPUs the handler and its workers run on.
+    placement_t placement;
+} handler_options_t;
+
+// Server mode: what every pool handler needs to handle a connection.
+typedef struct {
+    const diff_engine_options_t* options;
+    handler_options_t handler_options;
+} served_request_t;
+
+// Parses handler options into engine options and options of how to meet reader-writer. Returns 0 on success.
+static int parseOptions(int argc, char** argv, diff_engine_options_t* options, handler_options_t* handler_options)
+{
+    static const struct option long_options[] = {
+        { "tokens", required_argument, NULL, 't' },
+        { "expected-tokens", required_argument, NULL, 'e' },
+        { "spill-partitions", required_argument, NULL, 'p' },
+        { "memory-limit", required_argument, NULL, 'm' },
+        { "spill-dir", required_argument, NULL, 'd' },
+        { "approximate", required_argument, NULL, 'a' },
+        { "format", required_argument, NULL, 'f' },
+        { "alphabet", required_argument, NULL, 'A' },
+        { "socket", required_argument, NULL, 's' },
+        { "session", optional_argument, NULL, 'S' },
+        { "cache", required_argument, NULL, 'c' },
+        { "serve", required_argument, NULL, 'v' },
+        { "multiplex", no_argument, NULL, 'x' },
+        { "queue-depth", required_argument, NULL, 'q' },
+        { "client-depth", required_argument, NULL, 'Q' },
+        { "max-wait", required_argument, NULL, 'W' },
+        { "metrics", required_argument, NULL, 'M' },
+        { "workers", required_argument, NULL, 'w' },
+        { "cpus", required_argument, NULL, 'C' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    memset(options, 0, sizeof(*options));
+    memset(handler_options, 0, sizeof(*handler_options));
+    options->tokenizer_mode = TOKENIZER_BYTES;
+
+    const long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    handler_options->workers = cpu_count < 1 ? 1 : cpu_count > MAX_WORKERS ? MAX_WORKERS : (int)cpu_count;
+    handler_options->queue_depth = SERVER_DEFAULT_QUEUE_DEPTH;
+
+    int option = 0;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+        case 't':
+            if (parseTokenizerSpec(optarg, &options->tokenizer_mode, &options->ngram_length) != 0) {
+                printf("[Data Handler Error] Unknown tokenizer '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'e':
+            options->expected_tokens = strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            if ((options->spill_partitions = strtoul(optarg, NULL, 10)) == 0) {
+                printf("[Data Handler Error] Invalid partition count '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'm':
+            if ((options->memory_limit = parseSize(optarg)) == 0) {
+                printf("[Data Handler Error] Invalid memory limit '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'd':
+            options->spill_directory = optarg;
+            break;
+        case 'a':
+            options->false_positive_rate = strtod(optarg, NULL);
+            if (!(options->false_positive_rate > 0 && options->false_positive_rate < 1)) {
+                printf("[Data Handler Error] False positive rate must be in (0, 1), got '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            if (parseResultFormat(optarg, &options->result_format) != 0) {
+                printf("[Data Handler Error] Result format must be text, bitmap or count, got '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'A':
+            if (parseAlphabet(optarg, &options->alphabet) != 0) {
+                printf("[Data Handler Error] Alphabet must be auto, any, digits, hex, base64 or dna, got '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 's':
+            handler_options->socket_name = optarg;
+            break;
+        case 'S':
+            handler_options->use_session = true;
+            handler_options->session_name = optarg;
+            break;
+        case 'v':
+            handler_options->serve_name = optarg;
+            break;
+        case 'x':
+            handler_options->multiplex = true;
+            break;
+        case 'q':
+        case 'Q':
+            if (atoi(optarg) < 1) {
+                printf("[Data Handler Error] Queue depth must be positive, got '%s'\n", optarg);
+                return 1;
+            }
+            *(option == 'q' ? &handler_options->queue_depth : &handler_options->client_depth) = atoi(optarg);
+            break;
+        case 'W':
+            if ((handler_options->max_wait_ms = atoi(optarg)) < 0) {
+                printf("[Data Handler Error] Wait limit must not be negative, got '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'M':
+            handler_options->metrics_path = optarg;
+            break;
+        case 'c':
+            handler_options->cache_path = optarg;
+            break;
+        case 'w':
+            handler_options->workers = atoi(optarg);
+            if (handler_options->workers < 1 || handler_options->workers > MAX_WORKERS) {
+                printf("[Data Handler Error] Worker count must be in [1, %d], got '%s'\n", MAX_WORKERS, optarg);
+                return 1;
+            }
+            break;
+        case 'C':
+            if (parsePlacement(optarg, &handler_options->placement) != 0) {
+                printf("[Data Handler Error] CPUs must be 'auto' or a list such as '0-3,8', got '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (optind != argc) {
+        printUsage();
+        return 1;
+    }
+
+    if ((handler_options->socket_name != NULL) + handler_options->use_session + (handler_options->serve_name != NULL) > 1) {
+        printf("[Data Handler Error] Only one of --socket, --session and --serve can be used\n");
+        return 1;
+    }
+
+    if (handler_options->serve_name == NULL && (handler_options->client_depth != 0 || handler_options->max_wait_ms != 0
+        || handler_options->metrics_path != NULL || handler_options->queue_depth != SERVER_DEFAULT_QUEUE_DEPTH)) {
+        printf("[Data Handler] Queue options only apply to --serve, they are ignored\n");
+    }
+
+    if (options->result_format != RESULT_TEXT && options->tokenizer_mode != TOKENIZER_BYTES) {
+        printf("[Data Handler Error] Token results are written as text only\n");
+        return 1;
+    }
+
+    if (options->alphabet != ALPHABET_AUTO && options->tokenizer_mode != TOKENIZER_BYTES) {
+        printf("[Data Handler Error] --alphabet applies to byte differences only\n");
+        return 1;
+    }
+
+    if (handler_options->multiplex && (handler_options->serve_name == NULL || options->tokenizer_mode != TOKENIZER_BYTES)) {
+        printf("[Data Handler Error] --multiplex needs --serve and byte differences\n");
+        return 1;
+    }
+
+    if (handler_options->multiplex && (handler_options->client_depth != 0 || handler_options->max_wait_ms != 0
+        || handler_options->queue_depth != SERVER_DEFAULT_QUEUE_DEPTH || handler_options->cache_path != NULL)) {
+        printf("[Data Handler] Connections aren't queued or cached with --multiplex, "
+               "queue and cache options are ignored\n");
+    }
+
+    // A client may take the whole queue unless limited.
+    if (handler_options->client_depth == 0 || handler_options->client_depth > handler_options->queue_depth) {
+        handler_options->client_depth = handler_options->queue_depth;
+    }
+
+    // A memory limit alone turns spilling on with the default partition count.
+    if (options->memory_limit != 0 && options->spill_partitions == 0) {
+        options->spill_partitions = DEFAULT_SPILL_PARTITIONS;
+    }
+
+    if ((options->spill_partitions != 0 || options->false_positive_rate != 0)
+        && options->tokenizer_mode == TOKENIZER_BYTES) {
+        printf("[Data Handler] Byte difference always fits into memory, "
+               "spilling and approximation are ignored\n");
+    }
+
+    if (handler_options->cache_path != NULL && options->tokenizer_mode != TOKENIZER_BYTES) {
+        printf("[Data Handler] Only byte differences are cached, --cache is ignored\n");
+        handler_options->cache_path = NULL;
+    }
+
+    return 0;
+}
+
+// Opens the input FIFOs, blocking until reader-writer opens them too.
+static int openInputFifos(const session_t* session, int* input_fd_1, int* input_fd_2)
+{
+    if ((*input_fd_1 = open(session->fifo_paths[SESSION_INPUT_1], O_RDONLY)) < 0) {
         printf("[Data Handler Error] Failed to open input pipe '%s': %s\n",
-            INPUT_FIFO_NAME_1, strerror(errno));
+            session->fifo_paths[SESSION_INPUT_1], strerror(errno));
         return 1;
     }
 
     printf("[Data Handler] Opened (reader-writer -> data handler) pipe '%s' with fd: %d\n",
-        INPUT_FIFO_NAME_1, input_fd_1);
-
-    int exit_code = 0;
+        session->fifo_paths[SESSION_INPUT_1], *input_fd_1);
 
-    int input_fd_2 = -1;
-    if ((input_fd_2 = open(INPUT_FIFO_NAME_2, O_RDONLY)) < 0) {
+    if ((*input_fd_2 = open(session->fifo_paths[SESSION_INPUT_2], O_RDONLY)) < 0) {
         printf("[Data Handler Error] Failed to open input pipe '%s': %s\n",
-            INPUT_FIFO_NAME_2, strerror(errno));
-        exit_code = 1;
-        goto cleanup;
+            session->fifo_paths[SESSION_INPUT_2], strerror(errno));
+        return 1;
     }
 
     printf("[Data Handler] Opened (reader-writer -> data handler) pipe '%s' with fd: %d\n",
-        INPUT_FIFO_NAME_2, input_fd_2);
+        session->fifo_paths[SESSION_INPUT_2], *input_fd_2);
 
-    int output_fd_1 = -1;
-    if ((output_fd_1 = open(OUTPUT_FIFO_NAME_1, O_WRONLY)) < 0) {
+    return 0;
+}
+
+// Opens the output FIFOs, blocking until reader-writer opens them too.
+static int openOutputFifos(const session_t* session, int* output_fd_1, int* output_fd_2)
+{
+    if ((*output_fd_1 = open(session->fifo_paths[SESSION_OUTPUT_1], O_WRONLY)) < 0) {
         printf("[Data Handler Error] Failed to open output pipe '%s': %s\n",
-            OUTPUT_FIFO_NAME_1, strerror(errno));
-        exit_code = 1;
-        goto cleanup;
+            session->fifo_paths[SESSION_OUTPUT_1], strerror(errno));
+        return 1;
     }
 
     printf("[Data Handler] Opened (data handler -> reader-writer) pipe '%s' with fd: %d\n",
-        OUTPUT_FIFO_NAME_1, output_fd_1);
+        session->fifo_paths[SESSION_OUTPUT_1], *output_fd_1);
 
-    int output_fd_2 = -1;
-    if ((output_fd_2 = open(OUTPUT_FIFO_NAME_2, O_WRONLY)) < 0) {
+    if ((*output_fd_2 = open(session->fifo_paths[SESSION_OUTPUT_2], O_WRONLY)) < 0) {
         printf("[Data Handler Error] Failed to open output pipe '%s': %s\n",
-            OUTPUT_FIFO_NAME_2, strerror(errno));
-        exit_code = 1;
+            session->fifo_paths[SESSION_OUTPUT_2], strerror(errno));
+        return 1;
+    }
+
+    printf("[Data Handler] Opened (data handler -> reader-writer) pipe '%s' with fd: %d\n",
+        session->fifo_paths[SESSION_OUTPUT_2], *output_fd_2);
+
+    return 0;
+}
+
+// handleCandidate: Diffs one candidate against the reference byte set already restored into
+// stream 0 and writes both results into the candidate's output files.
+static int handleCandidate(diff_engine_t* engine, const presence_t* reference,
+    const int fds[RENDEZVOUS_FD_COUNT], result_cache_t* cache)
+{
+    presence_t empty;
+    presenceClear(&empty);
+
+    if (engine->restore(engine, 0, reference) != 0 || engine->restore(engine, 1, &empty) != 0
+        || consumeStream(engine, 1, fds[RENDEZVOUS_INPUT_2], -1, cache) != 0) {
+        return 1;
+    }
+
+    return engine->emit(engine, 0, fds[RENDEZVOUS_OUTPUT_1])
+        || engine->emit(engine, 1, fds[RENDEZVOUS_OUTPUT_2]);
+}
+
+// runWorker: Takes candidates from the shared socket until reader-writer stops sending them
+// and reports the result of each one. Returns 1 only if the socket itself fails.
+static int runWorker(diff_engine_t* engine, int socket_fd, const presence_t* reference, result_cache_t* cache)
+{
+    int handled = 0;
+
+    for (;;) {
+        int fds[RENDEZVOUS_FD_COUNT];
+        rendezvous_kind_t kind = RENDEZVOUS_END;
+        uint32_t tag = 0;
+
+        if (receiveDescriptors(socket_fd, &kind, &tag, fds) != 0) {
+            return 1;
+        }
+
+        if (kind == RENDEZVOUS_END) {
+            break;
+        }
+
+        int exit_code = 1;
+        if (kind == RENDEZVOUS_CANDIDATE) {
+            exit_code = handleCandidate(engine, reference, fds, cache);
+        } else {
+            printf("[Data Handler Error] Unexpected message '%c' among candidates\n", (char)kind);
+        }
+
+        for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+            closeFile(&fds[i]);
+        }
+
+        // Outputs are closed first: reader-writer may use them as soon as it hears back.
+        if (sendStatus(socket_fd, tag, exit_code) != 0) {
+            return 1;
+        }
+
+        ++handled;
+    }
+
+    if (cache != NULL) {
+        resultCacheSave(cache);
+    }
+
+    printf("[Data Handler] Worker %d handled %d candidates\n", (int)getpid(), handled);
+    return 0;
+}
+
+// handleCandidates: One-vs-many mode. Consumes the reference input once, then forks workers
+// that share its byte set and take candidates from the socket one message at a time.
+static int handleCandidates(diff_engine_t* engine, int socket_fd, int reference_fd, int index_fd,
+    int workers, const placement_t* placement, result_cache_t* cache)
+{
+    if (engine->summarize == NULL || engine->restore == NULL) {
+        printf("[Data Handler Error] One-vs-many mode is supported for byte differences only\n");
+        return 1;
+    }
+
+    presence_t reference;
+    if (consumeStream(engine, 0, reference_fd, index_fd, cache) != 0 || engine->summarize(engine, 0, &reference) != 0) {
+        printf("[Data Handler Error] Failed to handle the reference input, exiting...\n");
+        return 1;
+    }
+
+    // Saved before forking, so that workers only save their own entries.
+    if (cache != NULL) {
+        resultCacheSave(cache);
+    }
+
+    printf("[Data Handler] Reference has %d distinct bytes, starting %d workers\n",
+        presenceCount(&reference), workers);
+    fflush(stdout);
+
+    int started = 0;
+    for (; started < workers; ++started) {
+        const pid_t pid = fork();
+        if (pid < 0) {
+            printf("[Data Handler Error] Failed to start worker: %s\n", strerror(errno));
+            break;
+        }
+
+        if (pid == 0) {
+            const int exit_code = pinWorker(placement, started) || runWorker(engine, socket_fd, &reference, cache);
+            fflush(stdout);
+            _exit(exit_code);
+        }
+    }
+
+    int exit_code = started == 0;
+    for (int i = 0; i < started; ++i) {
+        int status = 0;
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            exit_code = 1;
+        }
+    }
+
+    return exit_code;
+}
+
+// handleRequest: Handles one pair of inputs from reader-writer met at the socket or FIFOs of the
+// options, or from the already accepted connection_fd (closed here) if it's not -1.
+static int handleRequest(const diff_engine_options_t* options, handler_options_t* handler_options,
+    int connection_fd)
+{
+    const char* socket_name = handler_options->socket_name;
+
+    diff_engine_t* engine = createDiffEngine(options);
+    if (engine == NULL) {
+        closeFile(&connection_fd);
+        return 1;
+    }
+
+    int exit_code = 0;
+
+    result_cache_t cache;
+    result_cache_t* used_cache = NULL;
+    if (handler_options->cache_path != NULL) {
+        if (resultCacheOpen(&cache, handler_options->cache_path) != 0) {
+            engine->destroy(engine);
+            closeFile(&connection_fd);
+            return 1;
+        }
+        used_cache = &cache;
+    }
+
+    int input_fd_1 = -1;
+    int input_fd_2 = -1;
+    int output_fd_1 = -1;
+    int output_fd_2 = -1;
+    int index_fd_1 = -1;
+    int index_fd_2 = -1;
+    int state_in_fd = -1;
+    int state_out_fd = -1;
+
+    // Follow mode: inputs are pipes that keep growing, results are passed as frames on every change.
+    bool follow = false;
+
+    // In direct mode reader-writer waits for the exit code on this socket.
+    int status_fd = -1;
+
+    session_t session;
+    useCurrentDirectory(&session);
+
+    if (socket_name != NULL) {
+        int fds[RENDEZVOUS_FD_COUNT];
+        rendezvous_kind_t kind = RENDEZVOUS_PIPES;
+        uint32_t tag = 0;
+        int socket_fd = connection_fd != -1 ? connection_fd : acceptRendezvous(socket_name);
+
+        // Reader-writer is on the other end of every channel, the handler goes next to it.
+        exit_code = socket_fd < 0
+            || applyPlacement(&handler_options->placement, peerCpu(socket_fd), "Data handler") != 0
+            || sendStatus(socket_fd, 0, RENDEZVOUS_ADMITTED) != 0
+            || receiveDescriptors(socket_fd, &kind, &tag, fds) != 0;
+
+        if (exit_code == 0 && kind == RENDEZVOUS_REFERENCE) {
+            printf("[Data Handler] Received the reference input %d over socket '@%s'\n",
+                fds[RENDEZVOUS_INPUT_1], socket_name);
+
+            input_fd_1 = fds[RENDEZVOUS_INPUT_1];
+            index_fd_1 = fds[RENDEZVOUS_INDEX_1];
+            exit_code = handleCandidates(engine, socket_fd, input_fd_1, index_fd_1, handler_options->workers,
+                &handler_options->placement, used_cache);
+            closeFile(&socket_fd);
+            goto cleanup;
+        }
+
+        follow = kind == RENDEZVOUS_FOLLOW;
+
+        if (exit_code == 0 && kind != RENDEZVOUS_PIPES && kind != RENDEZVOUS_FILES && !follow) {
+            printf("[Data Handler Error] Unexpected first message over socket '@%s'\n", socket_name);
+            exit_code = 1;
+        }
+
+        if (exit_code == 0 && kind == RENDEZVOUS_FILES) {
+            status_fd = socket_fd;
+        } else {
+            closeFile(&socket_fd);
+        }
+
+        if (exit_code != 0) {
+            goto cleanup;
+        }
+
+        input_fd_1 = fds[RENDEZVOUS_INPUT_1];
+        input_fd_2 = fds[RENDEZVOUS_INPUT_2];
+        output_fd_1 = fds[RENDEZVOUS_OUTPUT_1];
+        output_fd_2 = fds[RENDEZVOUS_OUTPUT_2];
+        index_fd_1 = fds[RENDEZVOUS_INDEX_1];
+        index_fd_2 = fds[RENDEZVOUS_INDEX_2];
+        state_in_fd = fds[RENDEZVOUS_STATE_IN];
+        state_out_fd = fds[RENDEZVOUS_STATE_OUT];
+
+        printf("[Data Handler] Received %s over socket '@%s': inputs %d and %d, outputs %d and %d\n",
+            kind == RENDEZVOUS_FILES ? "files" : follow ? "followed pipes" : "pipes", socket_name,
+            input_fd_1, input_fd_2, output_fd_1, output_fd_2);
+    } else if ((exit_code = applyPlacement(&handler_options->placement, -1, "Data handler")) != 0) {
+        goto cleanup;
+    } else if (handler_options->use_session && (exit_code = claimSession(handler_options->session_name, &session)) != 0) {
+        goto cleanup;
+    } else if ((exit_code = openInputFifos(&session, &input_fd_1, &input_fd_2)) != 0) {
         goto cleanup;
     }
 
-    printf("[Data Handler] Opened (reader-writer -> data handler) pipe '%s' with fd: %d\n",
-        OUTPUT_FIFO_NAME_2, output_fd_2);
+    if (follow) {
+        const int input_fds[2] = { input_fd_1, input_fd_2 };
+        const int output_fds[2] = { output_fd_1, output_fd_2 };
+        exit_code = followStreams(engine, input_fds, output_fds);
+        goto cleanup;
+    }
 
-    exit_code = handleStrings(input_fd_1, input_fd_2, output_fd_1, output_fd_2);
+    // Streams are consumed one after another: reader-writer closes the first pipe
+    // before writing the second one, so inputs of any size can't deadlock.
+    // Only regular files can be cached, which the handler gets in direct mode.
+    if (state_out_fd != -1) {
+        const int input_fds[2] = { input_fd_1, input_fd_2 };
+        const int index_fds[2] = { index_fd_1, index_fd_2 };
+        exit_code = consumeIncrementally(engine, input_fds, index_fds, state_in_fd, state_out_fd, used_cache);
+    } else {
+        exit_code = consumeStream(engine, 0, input_fd_1, index_fd_1, used_cache)
+            || consumeStream(engine, 1, input_fd_2, index_fd_2, used_cache);
+    }
 
     if (exit_code != 0) {
-        printf("[Data Handler Error] Failed to handle strings, exiting...");
+        printf("[Data Handler Error] Failed to handle strings, exiting...\n");
         goto cleanup;
     }
 
+    // Output FIFOs are opened only after the inputs are consumed,
+    // since reader-writer opens them after passing the inputs.
+    if (output_fd_1 == -1 && (exit_code = openOutputFifos(&session, &output_fd_1, &output_fd_2)) != 0) {
+        goto cleanup;
+    }
+
+    // The first result pipe is closed before writing the second one:
+    // reader-writer reads the first result until its end.
+    exit_code = engine->emit(engine, 0, output_fd_1);
+    closeFile(&output_fd_1);
+
+    if (exit_code == 0) {
+        exit_code = engine->emit(engine, 1, output_fd_2);
+    }
+
+    if (exit_code != 0) {
+        printf("[Data Handler Error] Failed to write results, exiting...\n");
+        goto cleanup;
+    }
+
+    printf("[Handler] Passed results to output pipes\n");
+
 cleanup:
     closeFile(&input_fd_1);
     closeFile(&input_fd_2);
+    closeFile(&index_fd_1);
+    closeFile(&index_fd_2);
+    closeFile(&state_in_fd);
+    closeFile(&state_out_fd);
     closeFile(&output_fd_1);
     closeFile(&output_fd_2);
 
+    // Results are complete by now, so reader-writer may use them as soon as it hears back.
+    if (status_fd != -1) {
+        sendStatus(status_fd, 0, exit_code);
+        closeFile(&status_fd);
+    }
+
+    // A failed save only costs the next run a rescan.
+    if (used_cache != NULL) {
+        if (exit_code == 0) {
+            resultCacheSave(used_cache);
+        }
+        resultCacheClose(used_cache);
+    }
+
+    engine->destroy(engine);
+
     if (exit_code == 0) {
         printf("[Data Handler] Done!\n");
     }
 
     return exit_code;
 }
+
+// handleConnection: Server mode handler of one accepted connection, context is the served_request_t.
+static int handleConnection(int socket_fd, void* context)
+{
+    served_request_t* request = context;
+    return handleRequest(request->options, &request->handler_options, socket_fd);
+}
+
+int main(int argc, char** argv)
+{
+    diff_engine_options_t options;
+    handler_options_t handler_options;
+    if (parseOptions(argc, argv, &options, &handler_options) != 0) {
+        return 1;
+    }
+
+    if (handler_options.serve_name == NULL) {
+        return handleRequest(&options, &handler_options, -1);
+    }
+
+    // Pool handlers are pinned by the server and handle one-vs-many requests alone.
+    served_request_t request = { &options, handler_options };
+    request.handler_options.socket_name = handler_options.serve_name;
+    request.handler_options.workers = 1;
+    request.handler_options.placement.mode = PLACEMENT_NONE;
+
+    const server_options_t server_options = {
+        handler_options.serve_name,
+        handler_options.workers,
+        &handler_options.placement,
+        handler_options.queue_depth,
+        handler_options.client_depth,
+        handler_options.max_wait_ms,
+        handler_options.metrics_path
+    };
+
+    if (handler_options.multiplex) {
+        return runMultiplexer(&server_options, options.result_format, options.alphabet);
+    }
+
+    return runServer(&server_options, handleConnection, &request);
+}
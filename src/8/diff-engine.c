@@ -0,0 +1,154 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "diff-engine.h"
+
+// Byte engine: every stream is summarized by the set of bytes met in it,
+// result i holds the ASCII bytes present in stream i and missing from the other one.
+typedef struct {
+    diff_engine_t base;
+    presence_t presence[2];
+    alphabet_scan_t scans[2];
+    result_format_t format;
+} byte_engine_t;
+
+static int byteEngineConsume(diff_engine_t* engine, int stream, const char* data, size_t length)
+{
+    byte_engine_t* byte_engine = (byte_engine_t*)engine;
+    alphabetAdd(&byte_engine->scans[stream], &byte_engine->presence[stream], data, length);
+    return 0;
+}
+
+static int byteEngineFinish(diff_engine_t* engine, int stream)
+{
+    (void)engine;
+    (void)stream;
+    return 0;
+}
+
+static int byteEngineEmit(diff_engine_t* engine, int result, int fd)
+{
+    byte_engine_t* byte_engine = (byte_engine_t*)engine;
+    const presence_t* including = &byte_engine->presence[result];
+    const presence_t* excluding = &byte_engine->presence[1 - result];
+
+    // Compiling string result.
+    char result_string[RESULT_MAX_LENGTH];
+    const size_t result_length = formatResult(including, excluding, byte_engine->format, result_string);
+
+    return writeAll(fd, result_string, result_length);
+}
+
+static int byteEngineSummarize(diff_engine_t* engine, int stream, presence_t* presence)
+{
+    byte_engine_t* byte_engine = (byte_engine_t*)engine;
+    *presence = byte_engine->presence[stream];
+    return 0;
+}
+
+static int byteEngineRestore(diff_engine_t* engine, int stream, const presence_t* presence)
+{
+    byte_engine_t* byte_engine = (byte_engine_t*)engine;
+    byte_engine->presence[stream] = *presence;
+    return 0;
+}
+
+static void byteEngineDestroy(diff_engine_t* engine)
+{
+    free(engine);
+}
+
+diff_engine_t* createByteEngine(result_format_t format, alphabet_t alphabet)
+{
+    // Zeroed memory means both streams start with no bytes.
+    byte_engine_t* engine = calloc(1, sizeof(*engine));
+    if (engine == NULL) {
+        printf("[Engine Error] Failed to allocate byte engine\n");
+        return NULL;
+    }
+
+    engine->format = format;
+    alphabetScanInit(&engine->scans[0], alphabet);
+    alphabetScanInit(&engine->scans[1], alphabet);
+    engine->base.consume = byteEngineConsume;
+    engine->base.finish = byteEngineFinish;
+    engine->base.emit = byteEngineEmit;
+    engine->base.summarize = byteEngineSummarize;
+    engine->base.restore = byteEngineRestore;
+    engine->base.destroy = byteEngineDestroy;
+
+    return &engine->base;
+}
+
+diff_engine_t* createDiffEngine(const diff_engine_options_t* options)
+{
+    if (options->tokenizer_mode == TOKENIZER_BYTES) {
+        return createByteEngine(options->result_format, options->alphabet);
+    }
+
+    if (options->false_positive_rate > 0) {
+        return createApproxEngine(options);
+    }
+
+    if (options->spill_partitions > 0) {
+        return createSpillEngine(options);
+    }
+
+    return createTokenEngine(options);
+}
+
+int writeAll(int fd, const char* data, size_t length)
+{
+    while (length > 0) {
+        const ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Engine Error] Failed to write result to fd %d: %s\n", fd, strerror(errno));
+            return 1;
+        }
+
+        data += written;
+        length -= (size_t)written;
+    }
+
+    return 0;
+}
+
+void tokenWriterInit(token_writer_t* writer, int fd)
+{
+    writer->fd = fd;
+    writer->length = 0;
+}
+
+int flushTokens(token_writer_t* writer)
+{
+    const int result = writeAll(writer->fd, writer->buffer, writer->length);
+    writer->length = 0;
+    return result;
+}
+
+int writeToken(token_writer_t* writer, const char* token, size_t length)
+{
+    if (writer->length + length + 1 > sizeof(writer->buffer)) {
+        if (flushTokens(writer) != 0) {
+            return 1;
+        }
+
+        // Token doesn't fit even into an empty buffer.
+        if (length + 1 > sizeof(writer->buffer)) {
+            const char delimiter = '\n';
+            return writeAll(writer->fd, token, length) || writeAll(writer->fd, &delimiter, 1);
+        }
+    }
+
+    memcpy(writer->buffer + writer->length, token, length);
+    writer->length += length;
+    writer->buffer[writer->length++] = '\n';
+    return 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "alphabet.h"
+#include "common.h"
+#include "presence.h"
+#include "result-format.h"
+#include "token-set.h"
+#include "tokenizer.h"
+
+// Difference engine: computes "present in stream 0 but not in stream 1" (result 0)
+// and "present in stream 1 but not in stream 0" (result 1) over streaming input.
+// Streams are fed chunk by chunk in any order, results are written only after
+// both streams are finished.
+typedef struct diff_engine diff_engine_t;
+
+struct diff_engine {
+    // Feeds another chunk of the input stream (0 or 1).
+    int (*consume)(diff_engine_t* engine, int stream, const char* data, size_t length);
+
+    // Signals the end of the input stream (0 or 1).
+    int (*finish)(diff_engine_t* engine, int stream);
+
+    // Writes result (0 or 1) into fd.
+    int (*emit)(diff_engine_t* engine, int result, int fd);
+
+    // Optional, NULL if the engine state isn't a byte set: copy the summary of a finished
+    // stream out, or replace a stream with a summary saved earlier instead of consuming it.
+    int (*summarize)(diff_engine_t* engine, int stream, presence_t* presence);
+    int (*restore)(diff_engine_t* engine, int stream, const presence_t* presence);
+
+    void (*destroy)(diff_engine_t* engine);
+};
+
+typedef struct {
+    tokenizer_mode_t tokenizer_mode;
+    size_t ngram_length;
+
+    // Expected number of distinct tokens per stream, 0 if unknown.
+    size_t expected_tokens;
+
+    // Out-of-core mode: number of on-disk partitions per stream (0 disables spilling),
+    // peak memory for token sets and the directory for partition files (NULL for TMPDIR).
+    size_t spill_partitions;
+    size_t memory_limit;
+    const char* spill_directory;
+
+    // Approximate mode: target false positive rate of Bloom filters (0 disables it).
+    double false_positive_rate;
+
+    // How byte results are written, token results are always text.
+    result_format_t result_format;
+
+    // Alphabet hint for the byte set kernels of byte mode.
+    alphabet_t alphabet;
+} diff_engine_options_t;
+
+// Byte engine: single bytes, results contain every ASCII byte once, written in format.
+// Byte sets are built with the kernels of alphabet (see alphabet.h).
+diff_engine_t* createByteEngine(result_format_t format, alphabet_t alphabet);
+
+// Token engine: exact difference over tokens kept in in-memory hash sets.
+// Results contain every token once, each followed by '\n'.
+diff_engine_t* createTokenEngine(const diff_engine_options_t* options);
+
+// Spill engine: tokens are hash-partitioned into on-disk files per stream,
+// then every pair of partitions is diffed in memory within memory_limit.
+// Results are grouped by partition instead of following insertion order.
+diff_engine_t* createSpillEngine(const diff_engine_options_t* options);
+
+// Approximate engine: streams are summarized by Bloom filters of the chosen
+// false positive rate, results may miss some tokens but never contain extra ones.
+diff_engine_t* createApproxEngine(const diff_engine_options_t* options);
+
+// Creates the engine selected by options.
+diff_engine_t* createDiffEngine(const diff_engine_options_t* options);
+
+// Helper for engines: writes the whole buffer, retrying on partial writes.
+int writeAll(int fd, const char* data, size_t length);
+
+// Buffered writer of '\n'-terminated tokens.
+typedef struct {
+    int fd;
+    size_t length;
+    char buffer[BUFFER_SIZE];
+} token_writer_t;
+
+void tokenWriterInit(token_writer_t* writer, int fd);
+int writeToken(token_writer_t* writer, const char* token, size_t length);
+int flushTokens(token_writer_t* writer);
+
+// Writes tokens of including set missing from excluding set, in insertion order.
+int writeSetDifference(const token_set_t* including, const token_set_t* excluding, token_writer_t* writer);
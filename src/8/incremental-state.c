@@ -0,0 +1,48 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "incremental-state.h"
+
+#define INCREMENTAL_STATE_MAGIC 0x5453384dU /* "M8ST" */
+#define INCREMENTAL_STATE_VERSION 1
+
+int readIncrementalState(int state_fd, incremental_state_t* state)
+{
+    ssize_t read_bytes = 0;
+    while ((read_bytes = pread(state_fd, state, sizeof(*state), 0)) < 0 && errno == EINTR) {
+    }
+
+    if (read_bytes != (ssize_t)sizeof(*state) || state->magic != INCREMENTAL_STATE_MAGIC
+        || state->version != INCREMENTAL_STATE_VERSION) {
+        printf("[Incremental State] Previous state is unreadable or of another version, ignoring it\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int writeIncrementalState(int state_fd, const input_state_t inputs[2])
+{
+    incremental_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.magic = INCREMENTAL_STATE_MAGIC;
+    state.version = INCREMENTAL_STATE_VERSION;
+    state.inputs[0] = inputs[0];
+    state.inputs[1] = inputs[1];
+
+    // The state is far smaller than a page, a single write either fails or writes it whole.
+    ssize_t written = 0;
+    while ((written = pwrite(state_fd, &state, sizeof(state), 0)) < 0 && errno == EINTR) {
+    }
+
+    if (written != (ssize_t)sizeof(state)) {
+        printf("[Incremental State Error] Failed to write state: %s\n", written < 0 ? strerror(errno) : "short write");
+        return 1;
+    }
+
+    return 0;
+}
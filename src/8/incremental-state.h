@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "presence-index.h"
+#include "presence.h"
+
+// State files are kept next to the first output file under its name with this suffix.
+#define INCREMENTAL_STATE_SUFFIX ".m8state"
+
+// What the previous run knew about an input: how much of it was scanned and its byte set.
+typedef struct {
+    file_mark_t mark;
+    presence_t presence;
+} input_state_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    input_state_t inputs[2];
+} incremental_state_t;
+
+// Reads a state from state_fd. Returns 1 if it's not a state of this version.
+int readIncrementalState(int state_fd, incremental_state_t* state);
+
+// Writes a state of the given inputs into an empty state_fd.
+int writeIncrementalState(int state_fd, const input_state_t inputs[2]);
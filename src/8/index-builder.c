@@ -0,0 +1,80 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "presence-index.h"
+
+// Index builder: precomputes per-block byte sets of large data files, so that the data
+// handler can take the byte set of a file from its index instead of scanning it.
+// Running it again after the file was appended to only scans the new blocks.
+
+// Parses a block size with an optional K, M or G suffix. Returns 0 on failure.
+static uint64_t parseBlockSize(const char* text)
+{
+    char* end = NULL;
+    const unsigned long long size = strtoull(text, &end, 10);
+
+    switch (*end) {
+    case 'K':
+    case 'k':
+        return end[1] == '\0' ? (uint64_t)size << 10 : 0;
+    case 'M':
+    case 'm':
+        return end[1] == '\0' ? (uint64_t)size << 20 : 0;
+    case 'G':
+    case 'g':
+        return end[1] == '\0' ? (uint64_t)size << 30 : 0;
+    default:
+        return *end == '\0' ? (uint64_t)size : 0;
+    }
+}
+
+static void printUsage(void)
+{
+    printf("Usage: ./mark8-index [--block-size=<size>] <data_file> [<index_file>]\n"
+           "The index is written to <data_file>%s by default, where mark8-rw looks for it.\n",
+        PRESENCE_INDEX_SUFFIX);
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option long_options[] = {
+        { "block-size", required_argument, NULL, 'b' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    uint64_t block_size = PRESENCE_INDEX_DEFAULT_BLOCK_SIZE;
+
+    int option = 0;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+        case 'b':
+            if ((block_size = parseBlockSize(optarg)) == 0) {
+                printf("[Index Builder Error] Invalid block size '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc && optind + 2 != argc) {
+        printUsage();
+        return 1;
+    }
+
+    const char* data_path = argv[optind];
+
+    char index_path[4096];
+    if (optind + 2 == argc) {
+        snprintf(index_path, sizeof(index_path), "%s", argv[optind + 1]);
+    } else if (snprintf(index_path, sizeof(index_path), "%s%s", data_path, PRESENCE_INDEX_SUFFIX) >= (int)sizeof(index_path)) {
+        printf("[Index Builder Error] Data file path '%s' is too long\n", data_path);
+        return 1;
+    }
+
+    return updatePresenceIndex(data_path, index_path, block_size);
+}
@@ -0,0 +1,727 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "inflate.h"
+
+// Deflate (RFC 1951) decoder in gzip (RFC 1952) framing.
+// Output goes through the 32 KiB sliding window, which is flushed into the output fd
+// every time it fills up, so arbitrarily large inputs are decoded in constant memory.
+
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_INPUT_SIZE 65536
+
+#define HUFFMAN_MAX_BITS 15
+#define HUFFMAN_MAX_SYMBOLS 288
+
+// Codes up to this length are decoded by a single table lookup,
+// longer ones fall back to walking the canonical code bit by bit.
+#define HUFFMAN_FAST_BITS 10
+
+typedef struct {
+    uint16_t count[HUFFMAN_MAX_BITS + 1];
+    uint16_t symbol[HUFFMAN_MAX_SYMBOLS];
+
+    // Entry is (code length << 9) | symbol, 0 if the code is longer than HUFFMAN_FAST_BITS.
+    uint16_t fast[1 << HUFFMAN_FAST_BITS];
+} huffman_t;
+
+typedef struct {
+    int input_fd;
+    const unsigned char* prefix;
+    size_t prefix_length;
+    size_t prefix_position;
+
+    unsigned char input[INFLATE_INPUT_SIZE];
+    size_t input_position;
+    size_t input_length;
+    bool input_end;
+
+    // Bits are consumed starting from the least significant one.
+    uint64_t bits;
+    int bit_count;
+
+    unsigned char window[INFLATE_WINDOW_SIZE];
+    size_t window_position;
+    size_t flushed_position;
+
+    // Bytes produced by the current gzip member, bounds back-reference distances.
+    uint64_t member_bytes;
+    uint32_t crc;
+
+    int output_fd;
+    uint64_t output_bytes;
+
+    huffman_t lengths;
+    huffman_t distances;
+} inflate_state_t;
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8_t distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static uint32_t crc_table[256];
+
+static void initCrcTable(void)
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; ++j) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xedb88320U : crc >> 1;
+        }
+
+        crc_table[i] = crc;
+    }
+}
+
+static uint32_t updateCrc(uint32_t crc, const unsigned char* data, size_t length)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+compression_t detectCompression(const unsigned char* magic, size_t length)
+{
+    if (length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return COMPRESSION_GZIP;
+    }
+
+    if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+        return COMPRESSION_ZSTD;
+    }
+
+    return COMPRESSION_NONE;
+}
+
+// Returns the next input byte or -1 at the end of the input (or on a read error).
+static int nextByte(inflate_state_t* state)
+{
+    if (state->prefix_position < state->prefix_length) {
+        return state->prefix[state->prefix_position++];
+    }
+
+    while (state->input_position == state->input_length) {
+        if (state->input_end) {
+            return -1;
+        }
+
+        const ssize_t read_bytes = read(state->input_fd, state->input, sizeof(state->input));
+        if (read_bytes < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (read_bytes <= 0) {
+            if (read_bytes < 0) {
+                printf("[Decoder Error] Failed to read compressed input: %s\n", strerror(errno));
+            }
+
+            state->input_end = true;
+            return -1;
+        }
+
+        state->input_position = 0;
+        state->input_length = read_bytes;
+    }
+
+    return state->input[state->input_position++];
+}
+
+// Tops up the bit buffer with whole bytes while there's room and input.
+static void fillBits(inflate_state_t* state)
+{
+    while (state->bit_count <= 56) {
+        const int byte = nextByte(state);
+        if (byte < 0) {
+            return;
+        }
+
+        state->bits |= (uint64_t)byte << state->bit_count;
+        state->bit_count += 8;
+    }
+}
+
+// Makes sure count bits are buffered. Returns 0 on success.
+static int needBits(inflate_state_t* state, int count)
+{
+    if (state->bit_count < count) {
+        fillBits(state);
+    }
+
+    if (state->bit_count < count) {
+        printf("[Decoder Error] Unexpected end of compressed input\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// Takes count (at most 32) bits that must have been buffered with needBits.
+static uint32_t takeBits(inflate_state_t* state, int count)
+{
+    const uint32_t value = (uint32_t)(state->bits & (((uint64_t)1 << count) - 1));
+    state->bits >>= count;
+    state->bit_count -= count;
+    return value;
+}
+
+// Drops bits up to the next byte boundary.
+static void alignToByte(inflate_state_t* state)
+{
+    takeBits(state, state->bit_count % 8);
+}
+
+static int flushWindow(inflate_state_t* state)
+{
+    const unsigned char* data = state->window + state->flushed_position;
+    size_t length = state->window_position - state->flushed_position;
+
+    state->crc = updateCrc(state->crc, data, length);
+    state->output_bytes += length;
+
+    while (length > 0) {
+        const ssize_t written = write(state->output_fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Decoder Error] Failed to write decompressed data: %s\n", strerror(errno));
+            return 1;
+        }
+
+        data += written;
+        length -= written;
+    }
+
+    if (state->window_position == INFLATE_WINDOW_SIZE) {
+        state->window_position = 0;
+    }
+
+    state->flushed_position = state->window_position;
+    return 0;
+}
+
+static int putByte(inflate_state_t* state, unsigned char byte)
+{
+    state->window[state->window_position++] = byte;
+    ++state->member_bytes;
+
+    if (state->window_position == INFLATE_WINDOW_SIZE) {
+        return flushWindow(state);
+    }
+
+    return 0;
+}
+
+static uint32_t reverseBits(uint32_t code, int length)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; ++i) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+
+    return reversed;
+}
+
+// Builds canonical Huffman decoding tables from code lengths.
+// Returns a negative value for over-subscribed codes.
+static int buildHuffman(huffman_t* huffman, const uint8_t* lengths, int symbol_count)
+{
+    memset(huffman->count, 0, sizeof(huffman->count));
+    for (int i = 0; i < symbol_count; ++i) {
+        ++huffman->count[lengths[i]];
+    }
+
+    int left = 1;
+    for (int length = 1; length <= HUFFMAN_MAX_BITS; ++length) {
+        left <<= 1;
+        left -= huffman->count[length];
+        if (left < 0) {
+            return left;
+        }
+    }
+
+    uint16_t offsets[HUFFMAN_MAX_BITS + 1];
+    offsets[1] = 0;
+    for (int length = 1; length < HUFFMAN_MAX_BITS; ++length) {
+        offsets[length + 1] = offsets[length] + huffman->count[length];
+    }
+
+    for (int i = 0; i < symbol_count; ++i) {
+        if (lengths[i] != 0) {
+            huffman->symbol[offsets[lengths[i]]++] = (uint16_t)i;
+        }
+    }
+
+    // Codes are stored in the stream starting from their most significant bit,
+    // so table indices are bit-reversed codes.
+    memset(huffman->fast, 0, sizeof(huffman->fast));
+
+    uint32_t code = 0;
+    int index = 0;
+    for (int length = 1; length <= HUFFMAN_FAST_BITS; ++length) {
+        for (int i = 0; i < huffman->count[length]; ++i) {
+            const uint16_t entry = (uint16_t)((length << 9) | huffman->symbol[index + i]);
+            for (uint32_t j = reverseBits(code + i, length); j < (1U << HUFFMAN_FAST_BITS); j += 1U << length) {
+                huffman->fast[j] = entry;
+            }
+        }
+
+        code = (code + huffman->count[length]) << 1;
+        index += huffman->count[length];
+    }
+
+    return left;
+}
+
+// Decodes one symbol. Returns -1 on invalid codes or unexpected end of input.
+static int decodeSymbol(inflate_state_t* state, const huffman_t* huffman)
+{
+    if (state->bit_count < HUFFMAN_MAX_BITS) {
+        fillBits(state);
+    }
+
+    const uint16_t entry = huffman->fast[state->bits & ((1U << HUFFMAN_FAST_BITS) - 1)];
+    if (entry != 0 && (entry >> 9) <= state->bit_count) {
+        takeBits(state, entry >> 9);
+        return entry & 0x1ff;
+    }
+
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int length = 1; length <= HUFFMAN_MAX_BITS && length <= state->bit_count; ++length) {
+        code |= (int)((state->bits >> (length - 1)) & 1);
+
+        const int count = huffman->count[length];
+        if (code - count < first) {
+            takeBits(state, length);
+            return huffman->symbol[index + (code - first)];
+        }
+
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    printf("[Decoder Error] Invalid Huffman code in compressed input\n");
+    return -1;
+}
+
+static int inflateStored(inflate_state_t* state)
+{
+    alignToByte(state);
+
+    if (needBits(state, 32) != 0) {
+        return 1;
+    }
+
+    const uint32_t length = takeBits(state, 16);
+    const uint32_t complement = takeBits(state, 16);
+    if (length != (~complement & 0xffff)) {
+        printf("[Decoder Error] Corrupted stored block length\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < length; ++i) {
+        int byte = 0;
+        if (state->bit_count > 0) {
+            byte = (int)takeBits(state, 8);
+        } else if ((byte = nextByte(state)) < 0) {
+            printf("[Decoder Error] Unexpected end of compressed input\n");
+            return 1;
+        }
+
+        if (putByte(state, (unsigned char)byte) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Decodes literals and back-references until the end-of-block symbol.
+static int inflateCodes(inflate_state_t* state)
+{
+    for (;;) {
+        int symbol = decodeSymbol(state, &state->lengths);
+        if (symbol < 0) {
+            return 1;
+        }
+
+        if (symbol < 256) {
+            if (putByte(state, (unsigned char)symbol) != 0) {
+                return 1;
+            }
+            continue;
+        }
+
+        if (symbol == 256) {
+            return 0;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) {
+            printf("[Decoder Error] Invalid length symbol in compressed input\n");
+            return 1;
+        }
+
+        if (needBits(state, length_extra[symbol]) != 0) {
+            return 1;
+        }
+
+        const uint32_t length = length_base[symbol] + takeBits(state, length_extra[symbol]);
+
+        symbol = decodeSymbol(state, &state->distances);
+        if (symbol < 0) {
+            return 1;
+        }
+
+        if (symbol >= 30) {
+            printf("[Decoder Error] Invalid distance symbol in compressed input\n");
+            return 1;
+        }
+
+        if (needBits(state, distance_extra[symbol]) != 0) {
+            return 1;
+        }
+
+        const uint32_t distance = distance_base[symbol] + takeBits(state, distance_extra[symbol]);
+        if (distance > state->member_bytes) {
+            printf("[Decoder Error] Back-reference distance %u is too far back\n", distance);
+            return 1;
+        }
+
+        for (uint32_t i = 0; i < length; ++i) {
+            const size_t source = (state->window_position - distance) & (INFLATE_WINDOW_SIZE - 1);
+            if (putByte(state, state->window[source]) != 0) {
+                return 1;
+            }
+        }
+    }
+}
+
+static int inflateFixed(inflate_state_t* state)
+{
+    static huffman_t lengths;
+    static huffman_t distances;
+    static bool built = false;
+
+    if (!built) {
+        uint8_t code_lengths[HUFFMAN_MAX_SYMBOLS];
+        int i = 0;
+        for (; i < 144; ++i) {
+            code_lengths[i] = 8;
+        }
+        for (; i < 256; ++i) {
+            code_lengths[i] = 9;
+        }
+        for (; i < 280; ++i) {
+            code_lengths[i] = 7;
+        }
+        for (; i < HUFFMAN_MAX_SYMBOLS; ++i) {
+            code_lengths[i] = 8;
+        }
+        buildHuffman(&lengths, code_lengths, HUFFMAN_MAX_SYMBOLS);
+
+        for (i = 0; i < 30; ++i) {
+            code_lengths[i] = 5;
+        }
+        buildHuffman(&distances, code_lengths, 30);
+
+        built = true;
+    }
+
+    state->lengths = lengths;
+    state->distances = distances;
+    return inflateCodes(state);
+}
+
+static int inflateDynamic(inflate_state_t* state)
+{
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    if (needBits(state, 14) != 0) {
+        return 1;
+    }
+
+    const int length_count = (int)takeBits(state, 5) + 257;
+    const int distance_count = (int)takeBits(state, 5) + 1;
+    const int code_count = (int)takeBits(state, 4) + 4;
+
+    if (length_count > 286 || distance_count > 30) {
+        printf("[Decoder Error] Too many codes in dynamic block\n");
+        return 1;
+    }
+
+    uint8_t lengths[286 + 30];
+    memset(lengths, 0, sizeof(lengths));
+
+    for (int i = 0; i < code_count; ++i) {
+        if (needBits(state, 3) != 0) {
+            return 1;
+        }
+        lengths[order[i]] = (uint8_t)takeBits(state, 3);
+    }
+
+    huffman_t code_lengths;
+    if (buildHuffman(&code_lengths, lengths, 19) != 0) {
+        printf("[Decoder Error] Invalid code lengths code in dynamic block\n");
+        return 1;
+    }
+
+    memset(lengths, 0, sizeof(lengths));
+
+    int index = 0;
+    while (index < length_count + distance_count) {
+        const int symbol = decodeSymbol(state, &code_lengths);
+        if (symbol < 0) {
+            return 1;
+        }
+
+        if (symbol < 16) {
+            lengths[index++] = (uint8_t)symbol;
+            continue;
+        }
+
+        uint8_t length = 0;
+        uint32_t repeat = 0;
+
+        if (symbol == 16) {
+            if (index == 0) {
+                printf("[Decoder Error] Repeat with no previous length in dynamic block\n");
+                return 1;
+            }
+
+            length = lengths[index - 1];
+            if (needBits(state, 2) != 0) {
+                return 1;
+            }
+            repeat = 3 + takeBits(state, 2);
+        } else if (symbol == 17) {
+            if (needBits(state, 3) != 0) {
+                return 1;
+            }
+            repeat = 3 + takeBits(state, 3);
+        } else {
+            if (needBits(state, 7) != 0) {
+                return 1;
+            }
+            repeat = 11 + takeBits(state, 7);
+        }
+
+        if (index + (int)repeat > length_count + distance_count) {
+            printf("[Decoder Error] Too many code lengths in dynamic block\n");
+            return 1;
+        }
+
+        while (repeat-- > 0) {
+            lengths[index++] = length;
+        }
+    }
+
+    if (lengths[256] == 0) {
+        printf("[Decoder Error] Dynamic block has no end-of-block code\n");
+        return 1;
+    }
+
+    // Incomplete codes are tolerated: decodeSymbol rejects the unused ones.
+    if (buildHuffman(&state->lengths, lengths, length_count) < 0
+        || buildHuffman(&state->distances, lengths + length_count, distance_count) < 0) {
+        printf("[Decoder Error] Over-subscribed code in dynamic block\n");
+        return 1;
+    }
+
+    return inflateCodes(state);
+}
+
+static int inflateBlocks(inflate_state_t* state)
+{
+    bool last = false;
+
+    while (!last) {
+        if (needBits(state, 3) != 0) {
+            return 1;
+        }
+
+        last = takeBits(state, 1) != 0;
+        const uint32_t type = takeBits(state, 2);
+
+        int result = 0;
+        switch (type) {
+        case 0:
+            result = inflateStored(state);
+            break;
+        case 1:
+            result = inflateFixed(state);
+            break;
+        case 2:
+            result = inflateDynamic(state);
+            break;
+        default:
+            printf("[Decoder Error] Invalid block type in compressed input\n");
+            return 1;
+        }
+
+        if (result != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Reads a little-endian number of byte_count bytes.
+static int readBytes(inflate_state_t* state, int byte_count, uint32_t* value)
+{
+    *value = 0;
+    for (int i = 0; i < byte_count; ++i) {
+        if (needBits(state, 8) != 0) {
+            return 1;
+        }
+        *value |= takeBits(state, 8) << (8 * i);
+    }
+
+    return 0;
+}
+
+static int skipZeroTerminated(inflate_state_t* state)
+{
+    uint32_t byte = 0;
+    do {
+        if (readBytes(state, 1, &byte) != 0) {
+            return 1;
+        }
+    } while (byte != 0);
+
+    return 0;
+}
+
+static int readGzipHeader(inflate_state_t* state)
+{
+    enum {
+        GZIP_FLAG_HCRC = 0x02,
+        GZIP_FLAG_EXTRA = 0x04,
+        GZIP_FLAG_NAME = 0x08,
+        GZIP_FLAG_COMMENT = 0x10
+    };
+
+    uint32_t magic = 0;
+    uint32_t method = 0;
+    uint32_t flags = 0;
+    uint32_t ignored = 0;
+
+    if (readBytes(state, 2, &magic) != 0 || readBytes(state, 1, &method) != 0
+        || readBytes(state, 1, &flags) != 0 || readBytes(state, 4, &ignored) != 0
+        || readBytes(state, 2, &ignored) != 0) {
+        return 1;
+    }
+
+    if (magic != 0x8b1f || method != 8) {
+        printf("[Decoder Error] Not a deflate-compressed gzip member\n");
+        return 1;
+    }
+
+    if (flags & GZIP_FLAG_EXTRA) {
+        uint32_t extra_length = 0;
+        if (readBytes(state, 2, &extra_length) != 0) {
+            return 1;
+        }
+
+        while (extra_length-- > 0) {
+            if (readBytes(state, 1, &ignored) != 0) {
+                return 1;
+            }
+        }
+    }
+
+    if (((flags & GZIP_FLAG_NAME) && skipZeroTerminated(state) != 0)
+        || ((flags & GZIP_FLAG_COMMENT) && skipZeroTerminated(state) != 0)
+        || ((flags & GZIP_FLAG_HCRC) && readBytes(state, 2, &ignored) != 0)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int readGzipTrailer(inflate_state_t* state)
+{
+    alignToByte(state);
+
+    uint32_t crc = 0;
+    uint32_t size = 0;
+    if (readBytes(state, 4, &crc) != 0 || readBytes(state, 4, &size) != 0) {
+        return 1;
+    }
+
+    if (crc != state->crc) {
+        printf("[Decoder Error] CRC mismatch: expected %08x, got %08x\n", crc, state->crc);
+        return 1;
+    }
+
+    if (size != (uint32_t)state->member_bytes) {
+        printf("[Decoder Error] Size mismatch: expected %u, got %u\n", size, (uint32_t)state->member_bytes);
+        return 1;
+    }
+
+    return 0;
+}
+
+int gunzipStream(int input_fd, const unsigned char* prefix, size_t prefix_length,
+    int output_fd, uint64_t* output_bytes)
+{
+    static inflate_state_t state;
+
+    memset(&state, 0, sizeof(state));
+    state.input_fd = input_fd;
+    state.prefix = prefix;
+    state.prefix_length = prefix_length;
+    state.output_fd = output_fd;
+
+    initCrcTable();
+
+    // Concatenated gzip members form a single stream.
+    do {
+        state.crc = 0;
+        state.member_bytes = 0;
+
+        if (readGzipHeader(&state) != 0 || inflateBlocks(&state) != 0
+            || flushWindow(&state) != 0 || readGzipTrailer(&state) != 0) {
+            return 1;
+        }
+
+        fillBits(&state);
+    } while (state.bit_count >= 16 && (state.bits & 0xffff) == 0x8b1f);
+
+    if (state.bit_count > 0) {
+        printf("[Decoder] Ignoring trailing garbage after compressed data\n");
+    }
+
+    *output_bytes = state.output_bytes;
+    return 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+} compression_t;
+
+// Number of leading bytes detectCompression needs to look at.
+#define COMPRESSION_MAGIC_LENGTH 4
+
+// Detects the compression format by the magic number at the start of a file.
+compression_t detectCompression(const unsigned char* magic, size_t length);
+
+// Decompresses gzip data (possibly several concatenated members) read from input_fd
+// and writes it into output_fd. prefix holds bytes of the input that were already read.
+// Uses a bundled streaming inflate with a 32 KiB window, so memory use is constant.
+int gunzipStream(int input_fd, const unsigned char* prefix, size_t prefix_length,
+    int output_fd, uint64_t* output_bytes);
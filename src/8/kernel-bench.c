@@ -0,0 +1,750 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alphabet.h"
+#include "presence.h"
+
+// Microbenchmark of the difference kernel alone: every kernel turns two in-memory buffers into
+// the sets of bytes met in one and not in the other, without processes, pipes or files around it.
+// Reports ns/byte and, where perf events are available, cycles/byte and instructions per cycle.
+
+// Every measurement is repeated until it takes this long, the best of BENCH_ROUNDS rounds is reported.
+#define BENCH_MIN_ROUND_NS 50000000.0
+#define BENCH_ROUNDS 5
+
+#define MAX_SIZES 16
+#define MAX_THREADS 64
+
+// Buffers are sized up to this.
+#define MAX_BUFFER_SIZE ((size_t)1 << 30)
+
+// Kernel: fills difference[0] with bytes of data_1 missing from data_2 and difference[1] the other way.
+typedef void (*kernel_t)(const char* data_1, const char* data_2, size_t length, presence_t difference[2]);
+
+static int thread_count = 1;
+
+// Kernel of marks 4-7: a state per byte value, updated by both buffers in turn.
+typedef enum {
+    STR_DIFF_NONE = 0,
+    STR_DIFF_INCLUDED = 1,
+    STR_DIFF_EXCLUDED = 2
+} string_difference_t;
+
+static void updateStringDifference(
+    const char* including, size_t including_length,
+    const char* excluding, size_t excluding_length,
+    string_difference_t* result)
+{
+    for (size_t i = 0; i < including_length; ++i) {
+        if (result[(unsigned char)including[i]] != STR_DIFF_EXCLUDED) {
+            result[(unsigned char)including[i]] = STR_DIFF_INCLUDED;
+        }
+    }
+
+    for (size_t i = 0; i < excluding_length; ++i) {
+        result[(unsigned char)excluding[i]] = STR_DIFF_EXCLUDED;
+    }
+}
+
+static void tableKernel(const char* data_1, const char* data_2, size_t length, presence_t difference[2])
+{
+    string_difference_t results[2][256];
+    memset(results, 0, sizeof(results));
+
+    updateStringDifference(data_1, length, data_2, length, results[0]);
+    updateStringDifference(data_2, length, data_1, length, results[1]);
+
+    for (int i = 0; i < 2; ++i) {
+        presenceClear(&difference[i]);
+        for (int byte = 0; byte < 256; ++byte) {
+            if (results[i][byte] == STR_DIFF_INCLUDED) {
+                difference[i].words[byte >> 6] |= (uint64_t)1 << (byte & 63);
+            }
+        }
+    }
+}
+
+static void differenceOf(const presence_t presence[2], presence_t difference[2])
+{
+    for (int word = 0; word < 4; ++word) {
+        difference[0].words[word] = presence[0].words[word] & ~presence[1].words[word];
+        difference[1].words[word] = presence[1].words[word] & ~presence[0].words[word];
+    }
+}
+
+// Bitmap with a single accumulator: every byte depends on the previous one through the map.
+static void scalarKernel(const char* data_1, const char* data_2, size_t length, presence_t difference[2])
+{
+    presence_t presence[2];
+    const char* data[2] = { data_1, data_2 };
+
+    for (int i = 0; i < 2; ++i) {
+        presenceClear(&presence[i]);
+        const unsigned char* bytes = (const unsigned char*)data[i];
+        for (size_t j = 0; j < length; ++j) {
+            presence[i].words[bytes[j] >> 6] |= (uint64_t)1 << (bytes[j] & 63);
+        }
+    }
+
+    differenceOf(presence, difference);
+}
+
+// Kernel of mark8: presenceAdd with four independent accumulators.
+static void presenceKernel(const char* data_1, const char* data_2, size_t length, presence_t difference[2])
+{
+    presence_t presence[2];
+    presenceClear(&presence[0]);
+    presenceClear(&presence[1]);
+    presenceAdd(&presence[0], data_1, length);
+    presenceAdd(&presence[1], data_2, length);
+
+    differenceOf(presence, difference);
+}
+
+// Kernel specialized for the alphabet detected from the start of each buffer.
+static void alphabetKernel(const char* data_1, const char* data_2, size_t length, presence_t difference[2])
+{
+    const char* data[2] = { data_1, data_2 };
+    presence_t presence[2];
+    for (int i = 0; i < 2; ++i) {
+        alphabet_scan_t scan;
+        alphabetScanInit(&scan, ALPHABET_AUTO);
+        presenceClear(&presence[i]);
+        alphabetAdd(&scan, &presence[i], data[i], length);
+    }
+
+    differenceOf(presence, difference);
+}
+
+typedef struct {
+    pthread_t thread;
+    const char* data;
+    size_t length;
+    presence_t presence;
+} kernel_part_t;
+
+static void* addPart(void* argument)
+{
+    kernel_part_t* part = argument;
+    presenceClear(&part->presence);
+    presenceAdd(&part->presence, part->data, part->length);
+    return NULL;
+}
+
+// presenceAdd over thread_count slices of each buffer in parallel threads, merged with OR.
+static void parallelKernel(const char* data_1, const char* data_2, size_t length, presence_t difference[2])
+{
+    static kernel_part_t parts[2 * MAX_THREADS];
+    const char* data[2] = { data_1, data_2 };
+    const size_t slice = (length + thread_count - 1) / thread_count;
+
+    for (int i = 0; i < 2; ++i) {
+        for (int t = 0; t < thread_count; ++t) {
+            kernel_part_t* part = &parts[i * thread_count + t];
+            const size_t begin = slice * t < length ? slice * t : length;
+            part->data = data[i] + begin;
+            part->length = begin + slice < length ? slice : length - begin;
+
+            // The first slice of each buffer runs in the calling thread.
+            if (t == 0 || pthread_create(&part->thread, NULL, addPart, part) != 0) {
+                part->thread = 0;
+                addPart(part);
+            }
+        }
+    }
+
+    presence_t presence[2];
+    for (int i = 0; i < 2; ++i) {
+        presenceClear(&presence[i]);
+        for (int t = 0; t < thread_count; ++t) {
+            kernel_part_t* part = &parts[i * thread_count + t];
+            if (part->thread != 0) {
+                pthread_join(part->thread, NULL);
+            }
+
+            for (int word = 0; word < 4; ++word) {
+                presence[i].words[word] |= part->presence.words[word];
+            }
+        }
+    }
+
+    differenceOf(presence, difference);
+}
+
+typedef struct {
+    const char* name;
+    kernel_t run;
+} kernel_entry_t;
+
+// New kernels are added here, the first one is the reference the others are checked against.
+static const kernel_entry_t kernels[] = {
+    { "table", tableKernel },
+    { "scalar", scalarKernel },
+    { "presence", presenceKernel },
+    { "parallel", parallelKernel },
+    { "alphabet", alphabetKernel },
+};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+typedef enum {
+    // Every byte value equally likely.
+    DISTRIBUTION_UNIFORM,
+    // Printable ASCII, equally likely.
+    DISTRIBUTION_ASCII,
+    // Letters, spaces and punctuation with English-like frequencies.
+    DISTRIBUTION_TEXT,
+    // Four symbols, as in DNA sequences.
+    DISTRIBUTION_NARROW,
+    // A single repeated byte.
+    DISTRIBUTION_CONSTANT,
+    // Decimal digits.
+    DISTRIBUTION_DIGITS,
+    // Lowercase hex digits.
+    DISTRIBUTION_HEX,
+    // Base64 symbols.
+    DISTRIBUTION_BASE64,
+    DISTRIBUTION_COUNT
+} distribution_t;
+
+static const char* const distribution_names[DISTRIBUTION_COUNT] = {
+    "uniform", "ascii", "text", "narrow", "constant", "digits", "hex", "base64"
+};
+
+static uint64_t nextRandom(uint64_t* state)
+{
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Fills data with length bytes of the distribution. The two buffers of a pair use different seeds,
+// so for narrow alphabets their differences are usually empty and for wide ones they are not.
+static void fillBuffer(char* data, size_t length, distribution_t distribution, uint64_t seed)
+{
+    // Letters roughly by their English frequency, most common first, with space and punctuation.
+    static const char text_alphabet[] = "     eeeeeeettttttaaaaaoooooiiiiinnnnnsssssshhhhhrrrrrddddllllcccuuummwwffggyyppbbvkjxqz,,..EATR\n";
+    static const char narrow_alphabet[] = "ACGT";
+    static const char hex_alphabet[] = "0123456789abcdef";
+    static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    for (size_t i = 0; i < length; ++i) {
+        const uint64_t random = nextRandom(&state);
+
+        switch (distribution) {
+        case DISTRIBUTION_UNIFORM:
+            data[i] = (char)(random >> 56);
+            break;
+        case DISTRIBUTION_ASCII:
+            data[i] = (char)(' ' + (random >> 32) % 95);
+            break;
+        case DISTRIBUTION_TEXT:
+            data[i] = text_alphabet[(random >> 32) % (sizeof(text_alphabet) - 1)];
+            break;
+        case DISTRIBUTION_NARROW:
+            data[i] = narrow_alphabet[random >> 62];
+            break;
+        case DISTRIBUTION_DIGITS:
+            data[i] = (char)('0' + (random >> 32) % 10);
+            break;
+        case DISTRIBUTION_HEX:
+            data[i] = hex_alphabet[random >> 60];
+            break;
+        case DISTRIBUTION_BASE64:
+            data[i] = base64_alphabet[random >> 58];
+            break;
+        case DISTRIBUTION_CONSTANT:
+        case DISTRIBUTION_COUNT:
+            data[i] = (char)('a' + seed % 2);
+            break;
+        }
+    }
+}
+
+// Hardware counters of the process: cycles as the group leader, instructions in its group.
+typedef struct {
+    int cycles_fd;
+    int instructions_fd;
+} perf_counters_t;
+
+static int openCounter(uint64_t config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = group_fd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Threads of the parallel kernel are counted too.
+    attr.inherit = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+// Opens the counters, leaves both fds at -1 if perf events aren't available.
+static void openCounters(perf_counters_t* counters)
+{
+    counters->instructions_fd = -1;
+    counters->cycles_fd = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+
+    if (counters->cycles_fd < 0) {
+        printf("[Kernel Bench] Perf events aren't available (%s), reporting time only\n", strerror(errno));
+        return;
+    }
+
+    counters->instructions_fd = openCounter(PERF_COUNT_HW_INSTRUCTIONS, counters->cycles_fd);
+    if (counters->instructions_fd < 0) {
+        printf("[Kernel Bench] Instruction counter isn't available (%s), reporting no IPC\n", strerror(errno));
+    }
+}
+
+// Reads cycles and instructions counted since the last reset, 0 for those not available.
+static void readCounters(const perf_counters_t* counters, uint64_t* cycles, uint64_t* instructions)
+{
+    *cycles = 0;
+    *instructions = 0;
+
+    if (counters->cycles_fd >= 0 && read(counters->cycles_fd, cycles, sizeof(*cycles)) != sizeof(*cycles)) {
+        *cycles = 0;
+    }
+
+    if (counters->instructions_fd >= 0 && read(counters->instructions_fd, instructions, sizeof(*instructions)) != sizeof(*instructions)) {
+        *instructions = 0;
+    }
+}
+
+static double nowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+typedef struct {
+    double ns_per_byte;
+    double cycles_per_byte;
+    double instructions_per_cycle;
+} measurement_t;
+
+// Runs a kernel over the buffers in rounds of at least BENCH_MIN_ROUND_NS and keeps the fastest round.
+static void measureKernel(const kernel_entry_t* kernel, const char* data_1, const char* data_2, size_t length,
+    const perf_counters_t* counters, measurement_t* measurement)
+{
+    presence_t difference[2];
+    measurement->ns_per_byte = -1;
+
+    // Warms up caches and the branch predictor, and sizes the rounds.
+    double start = nowNs();
+    kernel->run(data_1, data_2, length, difference);
+    const double once_ns = nowNs() - start;
+    const long repetitions = once_ns >= BENCH_MIN_ROUND_NS ? 1 : (long)(BENCH_MIN_ROUND_NS / (once_ns + 1)) + 1;
+
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        if (counters->cycles_fd >= 0) {
+            ioctl(counters->cycles_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(counters->cycles_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        start = nowNs();
+        for (long i = 0; i < repetitions; ++i) {
+            kernel->run(data_1, data_2, length, difference);
+            __asm__ volatile("" : : "r"(difference) : "memory");
+        }
+        const double elapsed_ns = nowNs() - start;
+
+        if (counters->cycles_fd >= 0) {
+            ioctl(counters->cycles_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        readCounters(counters, &cycles, &instructions);
+
+        const double bytes = 2.0 * length * repetitions;
+        const double ns_per_byte = elapsed_ns / bytes;
+
+        if (measurement->ns_per_byte < 0 || ns_per_byte < measurement->ns_per_byte) {
+            measurement->ns_per_byte = ns_per_byte;
+            measurement->cycles_per_byte = cycles / bytes;
+            measurement->instructions_per_cycle = cycles > 0 ? (double)instructions / cycles : 0;
+        }
+    }
+}
+
+// Checks that every kernel agrees with the reference on the buffers.
+static int checkKernels(const char* data_1, const char* data_2, size_t length, const char* distribution_name)
+{
+    presence_t expected[2];
+    kernels[0].run(data_1, data_2, length, expected);
+
+    int exit_code = 0;
+    for (size_t k = 1; k < KERNEL_COUNT; ++k) {
+        presence_t difference[2];
+        kernels[k].run(data_1, data_2, length, difference);
+
+        if (memcmp(difference, expected, sizeof(expected)) != 0) {
+            printf("[Kernel Bench Error] Kernel '%s' disagrees with '%s' on %s data of %zu bytes\n",
+                kernels[k].name, kernels[0].name, distribution_name, length);
+            exit_code = 1;
+        }
+    }
+
+    return exit_code;
+}
+
+// Baseline: one "<kernel> <distribution> <size> <ns_per_byte>" line per measurement.
+typedef struct {
+    char kernel[32];
+    char distribution[32];
+    size_t size;
+    double ns_per_byte;
+} baseline_entry_t;
+
+typedef struct {
+    baseline_entry_t* entries;
+    size_t count;
+} baseline_t;
+
+static int readBaseline(const char* path, baseline_t* baseline)
+{
+    baseline->entries = NULL;
+    baseline->count = 0;
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("[Kernel Bench Error] Failed to open baseline '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    size_t capacity = 0;
+    baseline_entry_t entry;
+    while (fscanf(file, "%31s %31s %zu %lf", entry.kernel, entry.distribution, &entry.size, &entry.ns_per_byte) == 4) {
+        if (baseline->count == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            baseline_entry_t* entries = realloc(baseline->entries, capacity * sizeof(*entries));
+            if (entries == NULL) {
+                printf("[Kernel Bench Error] Failed to allocate baseline\n");
+                fclose(file);
+                return 1;
+            }
+            baseline->entries = entries;
+        }
+
+        baseline->entries[baseline->count++] = entry;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static const baseline_entry_t* findBaseline(const baseline_t* baseline, const char* kernel, const char* distribution, size_t size)
+{
+    for (size_t i = 0; i < baseline->count; ++i) {
+        const baseline_entry_t* entry = &baseline->entries[i];
+        if (entry->size == size && strcmp(entry->kernel, kernel) == 0 && strcmp(entry->distribution, distribution) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+// Parses a size with an optional K, M or G suffix (powers of 1024).
+static int parseSize(const char* text, size_t* size)
+{
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || value == 0) {
+        return 1;
+    }
+
+    unsigned shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+    } else if (*end == 'G' || *end == 'g') {
+        shift = 30;
+    } else if (*end != '\0') {
+        return 1;
+    }
+
+    if (shift != 0 && *++end != '\0') {
+        return 1;
+    }
+
+    if (value > (MAX_BUFFER_SIZE >> shift)) {
+        return 1;
+    }
+
+    *size = (size_t)value << shift;
+    return 0;
+}
+
+// Parses a comma-separated list of sizes.
+static int parseSizes(char* text, size_t* sizes, int* count)
+{
+    *count = 0;
+    for (char* token = strtok(text, ","); token != NULL; token = strtok(NULL, ",")) {
+        if (*count == MAX_SIZES || parseSize(token, &sizes[*count]) != 0) {
+            return 1;
+        }
+        ++*count;
+    }
+
+    return *count == 0;
+}
+
+// Selects the entries of a comma-separated list of names, all of them if list is NULL.
+static int selectNames(const char* list, const char* const* names, size_t name_count, bool* selected)
+{
+    for (size_t i = 0; i < name_count; ++i) {
+        selected[i] = list == NULL;
+    }
+
+    if (list == NULL) {
+        return 0;
+    }
+
+    char copy[1024];
+    snprintf(copy, sizeof(copy), "%s", list);
+
+    for (char* token = strtok(copy, ","); token != NULL; token = strtok(NULL, ",")) {
+        size_t i = 0;
+        while (i < name_count && strcmp(names[i], token) != 0) {
+            ++i;
+        }
+
+        if (i == name_count) {
+            printf("[Kernel Bench Error] Unknown name '%s'\n", token);
+            return 1;
+        }
+
+        selected[i] = true;
+    }
+
+    return 0;
+}
+
+static void printUsage(void)
+{
+    printf("Usage: ./mark8-kbench [--kernels=<k1,k2,...>] [--distributions=<d1,d2,...>] [--sizes=<s1,s2,...>]\n"
+           "                      [--threads=<N>] [--save-baseline=<file>] [--baseline=<file> [--tolerance=<percent>]]\n"
+           "Kernels: table, scalar, presence, parallel, alphabet.\n"
+           "Distributions: uniform, ascii, text, narrow, constant, digits, hex, base64.\n"
+           "Sizes are bytes per buffer with an optional K, M or G suffix, 4K,64K,1M,16M by default.\n"
+           "With --baseline, a kernel slower than its baseline by more than the tolerance (10%% by default)\n"
+           "is reported as a regression and the exit code is 1.\n");
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option long_options[] = {
+        { "kernels", required_argument, NULL, 'k' },
+        { "distributions", required_argument, NULL, 'd' },
+        { "sizes", required_argument, NULL, 's' },
+        { "threads", required_argument, NULL, 't' },
+        { "save-baseline", required_argument, NULL, 'S' },
+        { "baseline", required_argument, NULL, 'b' },
+        { "tolerance", required_argument, NULL, 'T' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    const char* kernel_list = NULL;
+    const char* distribution_list = NULL;
+    const char* save_path = NULL;
+    const char* baseline_path = NULL;
+    double tolerance = 10;
+
+    char default_sizes[] = "4K,64K,1M,16M";
+    size_t sizes[MAX_SIZES];
+    int size_count = 0;
+    parseSizes(default_sizes, sizes, &size_count);
+
+    const long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cpu_count < 1 ? 1 : cpu_count > MAX_THREADS ? MAX_THREADS : (int)cpu_count;
+
+    int option = 0;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+        case 'k':
+            kernel_list = optarg;
+            break;
+        case 'd':
+            distribution_list = optarg;
+            break;
+        case 's':
+            if (parseSizes(optarg, sizes, &size_count) != 0) {
+                printf("[Kernel Bench Error] Invalid sizes '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 't':
+            thread_count = atoi(optarg);
+            if (thread_count < 1 || thread_count > MAX_THREADS) {
+                printf("[Kernel Bench Error] Thread count must be in [1, %d], got '%s'\n", MAX_THREADS, optarg);
+                return 1;
+            }
+            break;
+        case 'S':
+            save_path = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 'T':
+            tolerance = atof(optarg);
+            if (tolerance <= 0) {
+                printf("[Kernel Bench Error] Invalid tolerance '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (optind != argc) {
+        printUsage();
+        return 1;
+    }
+
+    const char* kernel_names[KERNEL_COUNT];
+    for (size_t k = 0; k < KERNEL_COUNT; ++k) {
+        kernel_names[k] = kernels[k].name;
+    }
+
+    bool selected_kernels[KERNEL_COUNT];
+    bool selected_distributions[DISTRIBUTION_COUNT];
+    if (selectNames(kernel_list, kernel_names, KERNEL_COUNT, selected_kernels) != 0
+        || selectNames(distribution_list, distribution_names, DISTRIBUTION_COUNT, selected_distributions) != 0) {
+        return 1;
+    }
+
+    baseline_t baseline = { NULL, 0 };
+    if (baseline_path != NULL && readBaseline(baseline_path, &baseline) != 0) {
+        return 1;
+    }
+
+    FILE* save_file = NULL;
+    if (save_path != NULL && (save_file = fopen(save_path, "w")) == NULL) {
+        printf("[Kernel Bench Error] Failed to create baseline '%s': %s\n", save_path, strerror(errno));
+        free(baseline.entries);
+        return 1;
+    }
+
+    size_t max_size = 0;
+    for (int i = 0; i < size_count; ++i) {
+        max_size = sizes[i] > max_size ? sizes[i] : max_size;
+    }
+
+    char* data_1 = malloc(max_size);
+    char* data_2 = malloc(max_size);
+    int exit_code = data_1 == NULL || data_2 == NULL;
+    if (exit_code != 0) {
+        printf("[Kernel Bench Error] Failed to allocate two buffers of %zu bytes\n", max_size);
+    }
+
+    perf_counters_t counters;
+    openCounters(&counters);
+
+    printf("[Kernel Bench] %d threads for the parallel kernel\n", thread_count);
+
+    int regressions = 0;
+
+    for (int d = 0; d < DISTRIBUTION_COUNT && exit_code == 0; ++d) {
+        if (!selected_distributions[d]) {
+            continue;
+        }
+
+        for (int s = 0; s < size_count && exit_code == 0; ++s) {
+            fillBuffer(data_1, sizes[s], d, 1);
+            fillBuffer(data_2, sizes[s], d, 2);
+
+            if (checkKernels(data_1, data_2, sizes[s], distribution_names[d]) != 0) {
+                exit_code = 1;
+                break;
+            }
+
+            for (size_t k = 0; k < KERNEL_COUNT; ++k) {
+                if (!selected_kernels[k]) {
+                    continue;
+                }
+
+                measurement_t measurement;
+                measureKernel(&kernels[k], data_1, data_2, sizes[s], &counters, &measurement);
+
+                char counters_text[64] = "";
+                if (measurement.cycles_per_byte > 0) {
+                    snprintf(counters_text, sizeof(counters_text), ", %.3f cycles/byte, IPC %.2f",
+                        measurement.cycles_per_byte, measurement.instructions_per_cycle);
+                }
+
+                char baseline_text[64] = "";
+                const baseline_entry_t* entry = findBaseline(&baseline, kernels[k].name, distribution_names[d], sizes[s]);
+                if (entry != NULL) {
+                    const double change = (measurement.ns_per_byte / entry->ns_per_byte - 1) * 100;
+                    const bool regressed = change > tolerance;
+                    regressions += regressed;
+                    snprintf(baseline_text, sizeof(baseline_text), ", %+.1f%% vs baseline%s",
+                        change, regressed ? " REGRESSION" : "");
+                }
+
+                printf("[Kernel Bench] %-8s %-8s %10zu bytes: %.4f ns/byte%s%s\n", kernels[k].name,
+                    distribution_names[d], sizes[s], measurement.ns_per_byte, counters_text, baseline_text);
+
+                if (save_file != NULL) {
+                    fprintf(save_file, "%s %s %zu %.6f\n", kernels[k].name, distribution_names[d], sizes[s],
+                        measurement.ns_per_byte);
+                }
+            }
+        }
+    }
+
+    if (save_file != NULL && fclose(save_file) != 0) {
+        printf("[Kernel Bench Error] Failed to save baseline '%s'\n", save_path);
+        exit_code = 1;
+    } else if (save_file != NULL && exit_code == 0) {
+        printf("[Kernel Bench] Saved baseline to '%s'\n", save_path);
+    }
+
+    if (regressions > 0) {
+        printf("[Kernel Bench Error] %d measurements regressed by more than %.1f%% against '%s'\n",
+            regressions, tolerance, baseline_path);
+        exit_code = 1;
+    }
+
+    if (counters.instructions_fd >= 0) {
+        close(counters.instructions_fd);
+    }
+    if (counters.cycles_fd >= 0) {
+        close(counters.cycles_fd);
+    }
+
+    free(data_1);
+    free(data_2);
+    free(baseline.entries);
+
+    return exit_code;
+}
@@ -0,0 +1,285 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+
+// Latency benchmark of a full mark8 run: launches mark8-h and mark8-rw,
+// receives the first result through a FIFO and measures the time from launch
+// to the first byte of the result and to the exit of both programs.
+
+#define DEFAULT_RUNS 200
+
+extern char** environ;
+
+typedef enum {
+    RENDEZVOUS_MODE_FIFO,
+    RENDEZVOUS_MODE_SOCKET
+} rendezvous_mode_t;
+
+static double nowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+// Starts a program with its output thrown away. Returns -1 on failure.
+static pid_t spawnQuiet(char* const* argv)
+{
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    pid_t pid = -1;
+    const int result = posix_spawn(&pid, argv[0], &file_actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&file_actions);
+
+    if (result != 0) {
+        printf("[Latency Bench Error] Failed to start '%s': %s\n", argv[0], strerror(result));
+        return -1;
+    }
+
+    return pid;
+}
+
+static int waitProgram(pid_t pid, const char* name)
+{
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 1;
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("[Latency Bench Error] %s failed\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Runs the pipeline once, result_fifo receives the first result.
+static int runOnce(const char* bin_dir, rendezvous_mode_t mode, int run,
+    const char* input_1, const char* input_2, const char* result_fifo,
+    double* first_byte_ms, double* done_ms)
+{
+    char handler_path[4096];
+    char reader_writer_path[4096];
+    char socket_option[128];
+
+    snprintf(handler_path, sizeof(handler_path), "%s/mark8-h", bin_dir);
+    snprintf(reader_writer_path, sizeof(reader_writer_path), "%s/mark8-rw", bin_dir);
+    snprintf(socket_option, sizeof(socket_option), "--socket=mark8-lbench-%d-%d", (int)getpid(), run);
+
+    char* handler_argv[] = { handler_path, socket_option, NULL };
+    char* reader_writer_argv[] = { reader_writer_path, socket_option,
+        (char*)input_1, (char*)input_2, (char*)result_fifo, "/dev/null", NULL };
+
+    if (mode == RENDEZVOUS_MODE_FIFO) {
+        handler_argv[1] = NULL;
+        memmove(reader_writer_argv + 1, reader_writer_argv + 2, 5 * sizeof(char*));
+    }
+
+    // Programs start in the documented order: over FIFOs reader-writer goes first,
+    // over the socket the handler does, as reader-writer only connects to it.
+    const bool reader_writer_first = mode == RENDEZVOUS_MODE_FIFO;
+    char* const* first_argv = reader_writer_first ? reader_writer_argv : handler_argv;
+    char* const* second_argv = reader_writer_first ? handler_argv : reader_writer_argv;
+
+    const double start_ms = nowMs();
+
+    const pid_t first_pid = spawnQuiet(first_argv);
+    if (first_pid < 0) {
+        return 1;
+    }
+
+    const pid_t second_pid = spawnQuiet(second_argv);
+    if (second_pid < 0) {
+        kill(first_pid, SIGTERM);
+        waitpid(first_pid, NULL, 0);
+        return 1;
+    }
+
+    const pid_t handler_pid = reader_writer_first ? second_pid : first_pid;
+    const pid_t reader_writer_pid = reader_writer_first ? first_pid : second_pid;
+
+    int exit_code = 0;
+
+    // Blocks until reader-writer opens the result for writing.
+    const int result_fd = open(result_fifo, O_RDONLY);
+    if (result_fd < 0) {
+        printf("[Latency Bench Error] Failed to open result pipe '%s': %s\n", result_fifo, strerror(errno));
+        exit_code = 1;
+    } else {
+        static char buffer[BUFFER_SIZE];
+        ssize_t read_bytes = 0;
+        bool first = true;
+
+        // An empty result counts as arriving at its end.
+        do {
+            read_bytes = read(result_fd, buffer, sizeof(buffer));
+            if (first && read_bytes >= 0) {
+                *first_byte_ms = nowMs() - start_ms;
+                first = false;
+            }
+        } while (read_bytes > 0 || (read_bytes < 0 && errno == EINTR));
+
+        close(result_fd);
+    }
+
+    exit_code |= waitProgram(reader_writer_pid, "mark8-rw");
+    exit_code |= waitProgram(handler_pid, "mark8-h");
+    *done_ms = nowMs() - start_ms;
+
+    return exit_code;
+}
+
+static int compareDoubles(const void* left, const void* right)
+{
+    const double a = *(const double*)left;
+    const double b = *(const double*)right;
+    return (a > b) - (a < b);
+}
+
+static double percentile(const double* sorted, int count, double fraction)
+{
+    int index = (int)(fraction * count + 0.5) - 1;
+    if (index < 0) {
+        index = 0;
+    }
+    if (index >= count) {
+        index = count - 1;
+    }
+
+    return sorted[index];
+}
+
+static void printLatencies(const char* mode_name, const char* what, double* latencies, int count)
+{
+    qsort(latencies, count, sizeof(double), compareDoubles);
+
+    double sum = 0;
+    for (int i = 0; i < count; ++i) {
+        sum += latencies[i];
+    }
+
+    printf("[Latency Bench] %s, %s: mean %.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        mode_name, what, sum / count, percentile(latencies, count, 0.5), percentile(latencies, count, 0.9),
+        percentile(latencies, count, 0.99), latencies[count - 1]);
+}
+
+static void printUsage(void)
+{
+    printf("Usage: ./mark8-lbench [--runs=<N>] [--mode=fifo|socket] [--bin-dir=<dir>] <input_file_1> <input_file_2>\n");
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option long_options[] = {
+        { "runs", required_argument, NULL, 'r' },
+        { "mode", required_argument, NULL, 'm' },
+        { "bin-dir", required_argument, NULL, 'b' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int runs = DEFAULT_RUNS;
+    rendezvous_mode_t mode = RENDEZVOUS_MODE_FIFO;
+    const char* bin_dir = ".";
+
+    int option = 0;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+        case 'r':
+            if ((runs = atoi(optarg)) < 1) {
+                printf("[Latency Bench Error] Invalid run count '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'm':
+            if (strcmp(optarg, "fifo") == 0) {
+                mode = RENDEZVOUS_MODE_FIFO;
+            } else if (strcmp(optarg, "socket") == 0) {
+                mode = RENDEZVOUS_MODE_SOCKET;
+            } else {
+                printf("[Latency Bench Error] Unknown mode '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b':
+            bin_dir = optarg;
+            break;
+        default:
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (argc - optind != 2) {
+        printUsage();
+        return 1;
+    }
+
+    char result_fifo[] = "/tmp/mark8-lbench-XXXXXX";
+    if (mkdtemp(result_fifo) == NULL) {
+        printf("[Latency Bench Error] Failed to create temporary directory: %s\n", strerror(errno));
+        return 1;
+    }
+
+    char result_path[sizeof(result_fifo) + 16];
+    snprintf(result_path, sizeof(result_path), "%s/result", result_fifo);
+
+    if (mkfifo(result_path, 0600) < 0) {
+        printf("[Latency Bench Error] Failed to create result pipe: %s\n", strerror(errno));
+        rmdir(result_fifo);
+        return 1;
+    }
+
+    // The handler opens the FIFOs right away and fails if reader-writer hasn't made them yet,
+    // so they are made beforehand, as they are left by any earlier run.
+    const char* fifo_names[] = { INPUT_FIFO_NAME_1, INPUT_FIFO_NAME_2, OUTPUT_FIFO_NAME_1, OUTPUT_FIFO_NAME_2 };
+    for (size_t i = 0; mode == RENDEZVOUS_MODE_FIFO && i < sizeof(fifo_names) / sizeof(fifo_names[0]); ++i) {
+        if (mkfifo(fifo_names[i], 0666) < 0 && errno != EEXIST) {
+            printf("[Latency Bench Error] Failed to create pipe '%s': %s\n", fifo_names[i], strerror(errno));
+            unlink(result_path);
+            rmdir(result_fifo);
+            return 1;
+        }
+    }
+
+    double* first_byte_ms = calloc(runs, sizeof(double));
+    double* done_ms = calloc(runs, sizeof(double));
+    int exit_code = first_byte_ms == NULL || done_ms == NULL;
+
+    for (int run = 0; run < runs && exit_code == 0; ++run) {
+        exit_code = runOnce(bin_dir, mode, run, argv[optind], argv[optind + 1], result_path,
+            &first_byte_ms[run], &done_ms[run]);
+    }
+
+    if (exit_code == 0) {
+        const char* mode_name = mode == RENDEZVOUS_MODE_FIFO ? "fifo" : "socket";
+        printf("[Latency Bench] %d runs\n", runs);
+        printLatencies(mode_name, "launch to first result byte", first_byte_ms, runs);
+        printLatencies(mode_name, "launch to exit", done_ms, runs);
+    }
+
+    free(first_byte_ms);
+    free(done_ms);
+    unlink(result_path);
+    rmdir(result_fifo);
+
+    return exit_code;
+}
@@ -0,0 +1,536 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "atomic-output.h"
+#include "common.h"
+#include "diff-engine.h"
+#include "multiplexer.h"
+#include "presence.h"
+#include "rendezvous.h"
+
+// Connections waiting to be accepted at most, reader-writers beyond it wait in connect().
+#define MULTIPLEXER_BACKLOG 4096
+
+#define MULTIPLEXER_EVENTS 256
+#define METRICS_INTERVAL_MS 1000
+
+// An input pipe gets at most this many reads per wakeup, so that a fast reader-writer doesn't
+// hold up the rest. The pipe stays registered and epoll reports it again on the next round.
+#define READS_PER_WAKEUP 16
+
+// A file input gets as many bytes per wakeup as a pipe at most. Files never make epoll report them,
+// so a connection with a file left to read goes to the ready list and runs again on the next round.
+#define FILE_SLICE (READS_PER_WAKEUP * sizeof(read_buffer))
+
+// Descriptors a connection in flight holds: its socket and four pipes.
+#define CONNECTION_FDS 5
+
+// Descriptors kept for the listening socket, epoll, the metrics file and logs.
+#define RESERVED_FDS 32
+
+typedef enum {
+    CONNECTION_RECEIVING,
+    CONNECTION_READING,
+    CONNECTION_WRITING
+} connection_state_t;
+
+typedef struct connection {
+    // Kept until the descriptors come for pipes and until the status is sent for files.
+    int socket_fd;
+    int fds[RENDEZVOUS_FD_COUNT];
+
+    // The only descriptor of the connection registered in epoll, -1 if none.
+    int waiting_fd;
+
+    unsigned char kind;
+    unsigned char state;
+
+    // Input being read or result being written.
+    unsigned char stream;
+
+    // Bytes of the current file input read so far.
+    off_t offset;
+
+    // Next connection on the ready list.
+    struct connection* next_ready;
+
+    presence_t presence[2];
+    alphabet_scan_t scans[2];
+} connection_t;
+
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+    int limit;
+    result_format_t format;
+    alphabet_t alphabet;
+
+    // Connections with a file left to read, run once per round in the order they came.
+    connection_t* ready_head;
+    connection_t* ready_tail;
+
+    int in_flight;
+    int in_flight_max;
+    unsigned long accepted;
+    unsigned long rejected;
+    unsigned long handled;
+    unsigned long failed;
+} multiplexer_t;
+
+// Shared by every connection: a wakeup reads one input at a time.
+static char read_buffer[BUFFER_SIZE * 8];
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void requestStop(int signal_number)
+{
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+// Helper function that closes a file descriptor and sets it to -1 only if it's not equal to -1.
+static void closeFile(int* fd)
+{
+    if (*fd != -1) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+static bool isRegularFile(int fd)
+{
+    struct stat info;
+    return fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+}
+
+// waitFor: Makes fd the descriptor the connection waits on for events.
+static int waitFor(multiplexer_t* multiplexer, connection_t* connection, int fd, uint32_t events)
+{
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = connection;
+
+    if (connection->waiting_fd == fd) {
+        return epoll_ctl(multiplexer->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    }
+
+    if (connection->waiting_fd != -1) {
+        epoll_ctl(multiplexer->epoll_fd, EPOLL_CTL_DEL, connection->waiting_fd, NULL);
+    }
+
+    connection->waiting_fd = fd;
+    return epoll_ctl(multiplexer->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void stopWaiting(multiplexer_t* multiplexer, connection_t* connection)
+{
+    if (connection->waiting_fd != -1) {
+        epoll_ctl(multiplexer->epoll_fd, EPOLL_CTL_DEL, connection->waiting_fd, NULL);
+        connection->waiting_fd = -1;
+    }
+}
+
+// makeReady: Puts the connection at the end of the ready list, it waits on no descriptor meanwhile.
+static void makeReady(multiplexer_t* multiplexer, connection_t* connection)
+{
+    stopWaiting(multiplexer, connection);
+
+    connection->next_ready = NULL;
+    if (multiplexer->ready_tail != NULL) {
+        multiplexer->ready_tail->next_ready = connection;
+    } else {
+        multiplexer->ready_head = connection;
+    }
+    multiplexer->ready_tail = connection;
+}
+
+// closeConnection: Closes everything the connection holds, reports the exit code for files and frees it.
+static void closeConnection(multiplexer_t* multiplexer, connection_t* connection, int exit_code)
+{
+    stopWaiting(multiplexer, connection);
+
+    for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+        closeFile(&connection->fds[i]);
+    }
+
+    // Results are complete by now, so reader-writer may use them as soon as it hears back.
+    if (connection->socket_fd != -1 && connection->kind == RENDEZVOUS_FILES) {
+        sendStatus(connection->socket_fd, 0, exit_code);
+    }
+    closeFile(&connection->socket_fd);
+
+    --multiplexer->in_flight;
+    ++multiplexer->handled;
+    multiplexer->failed += exit_code != 0;
+    free(connection);
+}
+
+// receiveRequest: Takes the descriptors of a connection. Returns 0 on success.
+static int receiveRequest(connection_t* connection)
+{
+    rendezvous_kind_t kind = RENDEZVOUS_END;
+    uint32_t tag = 0;
+
+    if (receiveDescriptors(connection->socket_fd, &kind, &tag, connection->fds) != 0) {
+        return 1;
+    }
+
+    connection->kind = (unsigned char)kind;
+
+    if (kind == RENDEZVOUS_END) {
+        return 1;
+    }
+
+    if ((kind != RENDEZVOUS_PIPES && kind != RENDEZVOUS_FILES) || connection->fds[RENDEZVOUS_STATE_OUT] != -1) {
+        printf("[Multiplexer Error] Only byte differences of pipes and files are multiplexed, got '%c'\n", (char)kind);
+        return 1;
+    }
+
+    // Indexes only speed up files the multiplexer maps anyway.
+    closeFile(&connection->fds[RENDEZVOUS_INDEX_1]);
+    closeFile(&connection->fds[RENDEZVOUS_INDEX_2]);
+    closeFile(&connection->fds[RENDEZVOUS_STATE_IN]);
+
+    // Reader-writer doesn't wait for a status over pipes.
+    if (kind == RENDEZVOUS_PIPES) {
+        closeFile(&connection->socket_fd);
+    }
+
+    for (int i = RENDEZVOUS_INPUT_1; i <= RENDEZVOUS_OUTPUT_2; ++i) {
+        if (!isRegularFile(connection->fds[i]) && fcntl(connection->fds[i], F_SETFL, O_NONBLOCK) != 0) {
+            printf("[Multiplexer Error] Failed to make fd %d non-blocking: %s\n", connection->fds[i], strerror(errno));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// readInput: Reads what's available of the current input, a file one slice at a time. Returns 0 once
+// it's read to its end, 1 if the connection waits for more or for its next slice and -1 on failure.
+static int readInput(multiplexer_t* multiplexer, connection_t* connection)
+{
+    const int fd = connection->fds[RENDEZVOUS_INPUT_1 + connection->stream];
+    presence_t* presence = &connection->presence[connection->stream];
+    alphabet_scan_t* scan = &connection->scans[connection->stream];
+
+    if (isRegularFile(fd)) {
+        for (size_t sliced = 0; sliced < FILE_SLICE;) {
+            const ssize_t bytes_read = pread(fd, read_buffer, sizeof(read_buffer), connection->offset);
+
+            if (bytes_read > 0) {
+                alphabetAdd(scan, presence, read_buffer, (size_t)bytes_read);
+                connection->offset += bytes_read;
+                sliced += (size_t)bytes_read;
+            } else if (bytes_read == 0) {
+                connection->offset = 0;
+                return 0;
+            } else if (errno != EINTR) {
+                printf("[Multiplexer Error] Failed to read input file %d: %s\n", connection->stream + 1, strerror(errno));
+                return -1;
+            }
+        }
+
+        makeReady(multiplexer, connection);
+        return 1;
+    }
+
+    for (int reads = 0; reads < READS_PER_WAKEUP; ++reads) {
+        const ssize_t bytes_read = read(fd, read_buffer, sizeof(read_buffer));
+
+        if (bytes_read > 0) {
+            alphabetAdd(scan, presence, read_buffer, (size_t)bytes_read);
+        } else if (bytes_read == 0) {
+            return 0;
+        } else if (errno == EAGAIN) {
+            break;
+        } else if (errno != EINTR) {
+            printf("[Multiplexer Error] Failed to read input %d: %s\n", connection->stream + 1, strerror(errno));
+            return -1;
+        }
+    }
+
+    return waitFor(multiplexer, connection, fd, EPOLLIN) == 0 ? 1 : -1;
+}
+
+// writeResult: Writes the current result. Returns 0 once it's written, 1 if the connection waits
+// for the output to drain and -1 on failure.
+static int writeResult(multiplexer_t* multiplexer, connection_t* connection)
+{
+    const int fd = connection->fds[RENDEZVOUS_OUTPUT_1 + connection->stream];
+
+    char result[RESULT_MAX_LENGTH];
+    const size_t length = formatResult(&connection->presence[connection->stream],
+        &connection->presence[1 - connection->stream], multiplexer->format, result);
+
+    if (length == 0) {
+        return 0;
+    }
+
+    if (isRegularFile(fd)) {
+        return writeAll(fd, result, length) == 0 ? 0 : -1;
+    }
+
+    // A result is shorter than PIPE_BUF, so a non-blocking pipe takes all of it or nothing.
+    const ssize_t written = write(fd, result, length);
+    if (written == (ssize_t)length) {
+        return 0;
+    }
+
+    if (written < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return waitFor(multiplexer, connection, fd, EPOLLOUT) == 0 ? 1 : -1;
+    }
+
+    printf("[Multiplexer Error] Failed to write result %d: %s\n", connection->stream + 1,
+        written < 0 ? strerror(errno) : "short write");
+    return -1;
+}
+
+// advanceConnection: Runs the connection's state machine until it has to wait or is done.
+static void advanceConnection(multiplexer_t* multiplexer, connection_t* connection)
+{
+    for (;;) {
+        int step = 0;
+
+        switch (connection->state) {
+        case CONNECTION_RECEIVING:
+            stopWaiting(multiplexer, connection);
+            if (receiveRequest(connection) != 0) {
+                closeConnection(multiplexer, connection, 1);
+                return;
+            }
+
+            connection->state = CONNECTION_READING;
+            connection->stream = 0;
+            continue;
+        case CONNECTION_READING:
+            step = readInput(multiplexer, connection);
+            break;
+        case CONNECTION_WRITING:
+            step = writeResult(multiplexer, connection);
+            break;
+        }
+
+        if (step != 0) {
+            if (step < 0) {
+                closeConnection(multiplexer, connection, 1);
+            }
+            return;
+        }
+
+        // The stream is done: its descriptor is of no more use.
+        const int slot = (connection->state == CONNECTION_READING ? RENDEZVOUS_INPUT_1 : RENDEZVOUS_OUTPUT_1)
+            + connection->stream;
+        if (connection->waiting_fd == connection->fds[slot]) {
+            stopWaiting(multiplexer, connection);
+        }
+        closeFile(&connection->fds[slot]);
+
+        if (++connection->stream < 2) {
+            continue;
+        }
+
+        if (connection->state == CONNECTION_WRITING) {
+            closeConnection(multiplexer, connection, 0);
+            return;
+        }
+
+        connection->state = CONNECTION_WRITING;
+        connection->stream = 0;
+    }
+}
+
+// admitConnections: Accepts every waiting connection, rejecting the ones beyond the limit.
+static void admitConnections(multiplexer_t* multiplexer)
+{
+    for (;;) {
+        const int connection_fd = accept4(multiplexer->listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (connection_fd < 0) {
+            if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+                printf("[Multiplexer Error] Failed to accept connection: %s\n", strerror(errno));
+            }
+            return;
+        }
+
+        ++multiplexer->accepted;
+
+        connection_t* connection = multiplexer->in_flight < multiplexer->limit ? calloc(1, sizeof(*connection)) : NULL;
+        if (connection == NULL) {
+            ++multiplexer->rejected;
+            sendStatus(connection_fd, 0, RENDEZVOUS_OVERLOADED);
+            close(connection_fd);
+            continue;
+        }
+
+        connection->socket_fd = connection_fd;
+        connection->waiting_fd = -1;
+        clearDescriptors(connection->fds);
+        connection->state = CONNECTION_RECEIVING;
+        alphabetScanInit(&connection->scans[0], multiplexer->alphabet);
+        alphabetScanInit(&connection->scans[1], multiplexer->alphabet);
+
+        ++multiplexer->in_flight;
+        if (multiplexer->in_flight > multiplexer->in_flight_max) {
+            multiplexer->in_flight_max = multiplexer->in_flight;
+        }
+
+        if (sendStatus(connection_fd, 0, RENDEZVOUS_ADMITTED) != 0
+            || waitFor(multiplexer, connection, connection_fd, EPOLLIN) != 0) {
+            closeConnection(multiplexer, connection, 1);
+        }
+    }
+}
+
+// formatMetrics: Prints the connection counters as "<name> <value>" lines. Returns the length.
+static int formatMetrics(const multiplexer_t* multiplexer, char* text, size_t size)
+{
+    const int length = snprintf(text, size,
+        "connections_in_flight %d\nconnections_in_flight_max %d\nconnections_limit %d\n"
+        "connections_accepted %lu\nconnections_rejected %lu\nconnections_handled %lu\nconnections_failed %lu\n",
+        multiplexer->in_flight, multiplexer->in_flight_max, multiplexer->limit,
+        multiplexer->accepted, multiplexer->rejected, multiplexer->handled, multiplexer->failed);
+
+    return length < 0 ? 0 : length >= (int)size ? (int)size - 1 : length;
+}
+
+static void writeMetrics(const multiplexer_t* multiplexer, const char* path)
+{
+    char text[512];
+    struct iovec vector = { text, (size_t)formatMetrics(multiplexer, text, sizeof(text)) };
+
+    // A failed write is retried with fresh metrics a second later.
+    writeAtomicFile(path, &vector, 1, DURABILITY_NONE);
+}
+
+static double nowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000 + (double)now.tv_nsec / 1000000;
+}
+
+int runMultiplexer(const server_options_t* options, result_format_t format, alphabet_t alphabet)
+{
+    multiplexer_t multiplexer;
+    memset(&multiplexer, 0, sizeof(multiplexer));
+    multiplexer.listen_fd = -1;
+    multiplexer.format = format;
+    multiplexer.alphabet = alphabet;
+
+    // Every connection in flight takes descriptors, so their limit is the limit of connections.
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    getrlimit(RLIMIT_NOFILE, &limit);
+    multiplexer.limit = limit.rlim_cur > (rlim_t)RESERVED_FDS + CONNECTION_FDS
+        ? (int)((limit.rlim_cur > 1 << 24 ? 1 << 24 : limit.rlim_cur) - RESERVED_FDS) / CONNECTION_FDS
+        : 1;
+
+    if ((multiplexer.epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        printf("[Multiplexer Error] Failed to create epoll instance: %s\n", strerror(errno));
+        return 1;
+    }
+
+    struct epoll_event listen_event;
+    listen_event.events = EPOLLIN;
+    listen_event.data.ptr = NULL;
+
+    if ((multiplexer.listen_fd = listenRendezvous(options->name, MULTIPLEXER_BACKLOG)) < 0
+        || fcntl(multiplexer.listen_fd, F_SETFL, O_NONBLOCK) != 0
+        || epoll_ctl(multiplexer.epoll_fd, EPOLL_CTL_ADD, multiplexer.listen_fd, &listen_event) != 0
+        || applyPlacement(options->placement, -1, "Multiplexer") != 0) {
+        closeFile(&multiplexer.listen_fd);
+        close(multiplexer.epoll_fd);
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // A reader-writer gone in the middle fails its own connection, not the whole process.
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("[Multiplexer] Serving socket '@%s' with up to %d connections in flight\n",
+        options->name, multiplexer.limit);
+    fflush(stdout);
+
+    int exit_code = 0;
+    double metrics_ms = 0;
+    struct epoll_event events[MULTIPLEXER_EVENTS];
+
+    while (!stop_requested || multiplexer.in_flight > 0) {
+        // Once stopped, new reader-writers are refused and the ones in flight are still served.
+        if (stop_requested && multiplexer.listen_fd != -1) {
+            closeFile(&multiplexer.listen_fd);
+            printf("[Multiplexer] Stopping, %d connections are in flight\n", multiplexer.in_flight);
+            fflush(stdout);
+        }
+
+        // Connections on the ready list only let epoll be polled, not waited on.
+        const int ready = epoll_wait(multiplexer.epoll_fd, events, MULTIPLEXER_EVENTS,
+            multiplexer.ready_head != NULL ? 0 : options->metrics_path != NULL ? METRICS_INTERVAL_MS : -1);
+        if (ready < 0 && errno != EINTR) {
+            printf("[Multiplexer Error] Failed to wait for events: %s\n", strerror(errno));
+            exit_code = 1;
+            break;
+        }
+
+        // Every connection waits on one descriptor, so it comes at most once per round.
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.ptr == NULL) {
+                admitConnections(&multiplexer);
+            } else {
+                advanceConnection(&multiplexer, events[i].data.ptr);
+            }
+        }
+
+        // Connections put on the list during this pass run on the next round, after epoll is polled again.
+        connection_t* connection = multiplexer.ready_head;
+        multiplexer.ready_head = NULL;
+        multiplexer.ready_tail = NULL;
+
+        while (connection != NULL) {
+            connection_t* next = connection->next_ready;
+            advanceConnection(&multiplexer, connection);
+            connection = next;
+        }
+
+        if (options->metrics_path != NULL && nowMs() - metrics_ms >= METRICS_INTERVAL_MS) {
+            writeMetrics(&multiplexer, options->metrics_path);
+            metrics_ms = nowMs();
+        }
+    }
+
+    closeFile(&multiplexer.listen_fd);
+    close(multiplexer.epoll_fd);
+
+    char metrics[512];
+    formatMetrics(&multiplexer, metrics, sizeof(metrics));
+    printf("[Multiplexer] Metrics:\n%s", metrics);
+
+    if (options->metrics_path != NULL) {
+        writeMetrics(&multiplexer, options->metrics_path);
+    }
+
+    return exit_code;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "alphabet.h"
+#include "result-format.h"
+#include "server.h"
+
+// Multiplexed server mode: a single process serves every connection at the socket name as a
+// resumable state machine driven by epoll, instead of a handler process per connection.
+// A connection in flight holds its descriptors, the two byte sets of its streams and the
+// state it stopped in; all of them share one read buffer. Only byte differences of pipes and
+// files are supported, one-vs-many, follow and incremental requests fail.
+//
+// Connections in flight are bounded by the descriptor limit (raised to the hard one),
+// the ones beyond it are rejected with RENDEZVOUS_OVERLOADED.
+
+// Serves connections until SIGINT or SIGTERM, then finishes the ones in flight.
+// Results are written in format, byte sets are built with the kernels of alphabet. Returns 0 on success.
+int runMultiplexer(const server_options_t* options, result_format_t format, alphabet_t alphabet);
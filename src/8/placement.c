@@ -0,0 +1,287 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "placement.h"
+
+// Parses a CPU list such as "0-3,8" of the sysfs and command line format into cpus.
+static int parseCpuList(const char* text, cpu_set_t* cpus)
+{
+    CPU_ZERO(cpus);
+
+    const char* cursor = text;
+    while (*cursor != '\0' && *cursor != '\n') {
+        char* end = NULL;
+        const long first = strtol(cursor, &end, 10);
+        long last = first;
+
+        if (end == cursor || first < 0) {
+            return 1;
+        }
+
+        if (*end == '-') {
+            cursor = end + 1;
+            last = strtol(cursor, &end, 10);
+            if (end == cursor || last < first) {
+                return 1;
+            }
+        }
+
+        if (last >= CPU_SETSIZE) {
+            return 1;
+        }
+
+        for (long cpu = first; cpu <= last; ++cpu) {
+            CPU_SET(cpu, cpus);
+        }
+
+        cursor = end;
+        if (*cursor == ',') {
+            ++cursor;
+        } else if (*cursor != '\0' && *cursor != '\n') {
+            return 1;
+        }
+    }
+
+    return CPU_COUNT(cpus) == 0;
+}
+
+// Formats cpus as a CPU list for logs.
+static const char* formatCpuList(const cpu_set_t* cpus, char* text, size_t size)
+{
+    size_t length = 0;
+    text[0] = '\0';
+
+    for (int cpu = 0; cpu < CPU_SETSIZE && length < size; ++cpu) {
+        if (!CPU_ISSET(cpu, cpus)) {
+            continue;
+        }
+
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus)) {
+            ++last;
+        }
+
+        length += snprintf(text + length, size - length, last > cpu ? "%s%d-%d" : "%s%d",
+            length > 0 ? "," : "", cpu, last);
+        cpu = last;
+    }
+
+    return text;
+}
+
+int parsePlacement(const char* text, placement_t* placement)
+{
+    CPU_ZERO(&placement->cpus);
+
+    if (strcmp(text, "auto") == 0) {
+        placement->mode = PLACEMENT_AUTO;
+        return 0;
+    }
+
+    placement->mode = PLACEMENT_CPUS;
+    return parseCpuList(text, &placement->cpus);
+}
+
+// Reads a short sysfs file into text. Returns 0 on success.
+static int readSysfs(const char* path, char* text, size_t size)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return 1;
+    }
+
+    const int exit_code = fgets(text, (int)size, file) == NULL;
+    fclose(file);
+    return exit_code;
+}
+
+// cacheDomainOf: Finds the CPUs sharing the highest level cache with cpu, just cpu if unknown.
+static void cacheDomainOf(int cpu, cpu_set_t* domain)
+{
+    CPU_ZERO(domain);
+    CPU_SET(cpu, domain);
+
+    int best_level = 0;
+    for (int index = 0;; ++index) {
+        char path[128];
+        char text[4096];
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+        if (readSysfs(path, text, sizeof(text)) != 0) {
+            break;
+        }
+
+        const int level = atoi(text);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+
+        cpu_set_t shared;
+        if (level > best_level && readSysfs(path, text, sizeof(text)) == 0 && parseCpuList(text, &shared) == 0) {
+            best_level = level;
+            *domain = shared;
+        }
+    }
+}
+
+// Returns the NUMA node of cpu, or -1 if unknown.
+static int nodeOf(int cpu)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR* directory = opendir(path);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    int node = -1;
+    struct dirent* entry = NULL;
+    while (node == -1 && (entry = readdir(directory)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+        }
+    }
+
+    closedir(directory);
+    return node;
+}
+
+int peerCpu(int socket_fd)
+{
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+        return -1;
+    }
+
+    char path[64];
+    char stat[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)credentials.pid);
+    if (readSysfs(path, stat, sizeof(stat)) != 0) {
+        return -1;
+    }
+
+    // The processor is the 39th field, the 2nd one (the command) may contain spaces.
+    const char* cursor = strrchr(stat, ')');
+    for (int field = 2; cursor != NULL && field < 39; ++field) {
+        cursor = strchr(cursor + 1, ' ');
+    }
+
+    return cursor != NULL ? atoi(cursor + 1) : -1;
+}
+
+// preferNode: Makes new memory of the process come from the node of its CPUs if they share one.
+static int preferNode(const cpu_set_t* cpus)
+{
+    int node = -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, cpus)) {
+            continue;
+        }
+
+        const int cpu_node = nodeOf(cpu);
+        if (cpu_node < 0 || (node != -1 && cpu_node != node)) {
+            return -1;
+        }
+        node = cpu_node;
+    }
+
+    if (node < 0 || node >= (int)(8 * sizeof(unsigned long))) {
+        return -1;
+    }
+
+    const unsigned long node_mask = 1UL << node;
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &node_mask, 8 * sizeof(node_mask)) != 0) {
+        return -1;
+    }
+
+    return node;
+}
+
+int applyPlacement(placement_t* placement, int near_cpu, const char* stage)
+{
+    if (placement->mode == PLACEMENT_NONE) {
+        return 0;
+    }
+
+    char text[256];
+    char near_text[64] = "";
+
+    if (placement->mode == PLACEMENT_AUTO) {
+        const bool near_peer = near_cpu >= 0;
+        if (!near_peer && (near_cpu = sched_getcpu()) < 0) {
+            printf("[Placement Error] Failed to find the current CPU: %s\n", strerror(errno));
+            return 1;
+        }
+
+        cacheDomainOf(near_cpu, &placement->cpus);
+        snprintf(near_text, sizeof(near_text), " sharing cache with CPU %d", near_cpu);
+
+        // The other end of the channels runs on near_cpu, this stage takes its cache siblings.
+        cpu_set_t siblings = placement->cpus;
+        CPU_CLR(near_cpu, &siblings);
+        if (near_peer && CPU_COUNT(&siblings) > 0) {
+            placement->cpus = siblings;
+        }
+    }
+
+    // CPUs the process isn't allowed to use (cgroups, taskset) are left out.
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        CPU_AND(&allowed, &allowed, &placement->cpus);
+        if (CPU_COUNT(&allowed) > 0) {
+            placement->cpus = allowed;
+        }
+    }
+
+    if (sched_setaffinity(0, sizeof(placement->cpus), &placement->cpus) != 0) {
+        printf("[Placement Error] Failed to pin %s to CPUs %s: %s\n", stage,
+            formatCpuList(&placement->cpus, text, sizeof(text)), strerror(errno));
+        return 1;
+    }
+
+    const int node = preferNode(&placement->cpus);
+    char node_text[64] = "";
+    if (node >= 0) {
+        snprintf(node_text, sizeof(node_text), ", memory preferred on node %d", node);
+    }
+
+    printf("[Placement] %s runs on CPUs %s%s%s\n", stage, formatCpuList(&placement->cpus, text, sizeof(text)),
+        near_text, node_text);
+    return 0;
+}
+
+int pinWorker(const placement_t* placement, int worker)
+{
+    if (placement->mode == PLACEMENT_NONE) {
+        return 0;
+    }
+
+    const int count = CPU_COUNT(&placement->cpus);
+    int seen = 0;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &placement->cpus) && seen++ == worker % count) {
+            cpu_set_t single;
+            CPU_ZERO(&single);
+            CPU_SET(cpu, &single);
+
+            if (sched_setaffinity(0, sizeof(single), &single) != 0) {
+                printf("[Placement Error] Failed to pin worker %d to CPU %d: %s\n", worker, cpu, strerror(errno));
+                return 1;
+            }
+
+            return 0;
+        }
+    }
+
+    return 0;
+}
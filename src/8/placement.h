@@ -0,0 +1,36 @@
+#pragma once
+
+// cpu_set_t needs _GNU_SOURCE defined by the including file.
+#include <sched.h>
+#include <stdbool.h>
+
+typedef enum {
+    // CPUs are picked by the scheduler.
+    PLACEMENT_NONE,
+    // The stage runs on the given CPUs.
+    PLACEMENT_CPUS,
+    // The stage runs on CPUs sharing the last level cache with the other end of its channels.
+    PLACEMENT_AUTO
+} placement_mode_t;
+
+typedef struct {
+    placement_mode_t mode;
+
+    // CPUs the stage runs on: the given ones, or the chosen ones once the placement is applied.
+    cpu_set_t cpus;
+} placement_t;
+
+// Parses "auto" or a CPU list such as "0-3,8". Returns 0 on success.
+int parsePlacement(const char* text, placement_t* placement);
+
+// Returns the CPU the process on the other end of a Unix socket last ran on, or -1 if unknown.
+int peerCpu(int socket_fd);
+
+// Applies the placement to the calling process and its future children. In auto mode the CPUs
+// are those sharing the largest cache with near_cpu (the current CPU if -1), without near_cpu
+// itself when there are others. Memory is then preferably allocated on the NUMA node of the
+// CPUs if they are all on one. stage names the process in logs. Returns 0 on success.
+int applyPlacement(placement_t* placement, int near_cpu, const char* stage);
+
+// Pins a worker process to one CPU of an applied placement, workers go round-robin over them.
+int pinWorker(const placement_t* placement, int worker);
@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "presence-index.h"
+
+#define PRESENCE_INDEX_MAGIC 0x5849384dU /* "M8IX" */
+#define PRESENCE_INDEX_VERSION 1
+
+// Number of bytes at the end of the covered part that the fingerprint hashes.
+#define FINGERPRINT_LENGTH 4096
+
+// Data is scanned through a buffer of this size.
+#define SCAN_BUFFER_SIZE ((size_t)1 << 20)
+
+static int readAllAt(int fd, void* data, size_t length, uint64_t offset)
+{
+    char* bytes = data;
+    while (length > 0) {
+        const ssize_t result = pread(fd, bytes, length, (off_t)offset);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (result <= 0) {
+            return 1;
+        }
+
+        bytes += result;
+        length -= (size_t)result;
+        offset += (uint64_t)result;
+    }
+
+    return 0;
+}
+
+static int writeAllBytes(int fd, const void* data, size_t length)
+{
+    const char* bytes = data;
+    while (length > 0) {
+        const ssize_t result = write(fd, bytes, length);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (result < 0) {
+            return 1;
+        }
+
+        bytes += result;
+        length -= (size_t)result;
+    }
+
+    return 0;
+}
+
+// FNV-1a over the last FINGERPRINT_LENGTH bytes before end. Returns 1 if they can't be read.
+static int computeFingerprint(int data_fd, uint64_t end, uint64_t* fingerprint)
+{
+    unsigned char buffer[FINGERPRINT_LENGTH];
+    const size_t length = end < FINGERPRINT_LENGTH ? (size_t)end : FINGERPRINT_LENGTH;
+
+    if (readAllAt(data_fd, buffer, length, end - length) != 0) {
+        return 1;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ buffer[i]) * 0x100000001b3ULL;
+    }
+
+    *fingerprint = hash;
+    return 0;
+}
+
+int readPresenceIndex(int index_fd, presence_index_t* index)
+{
+    memset(index, 0, sizeof(*index));
+
+    presence_index_header_t* header = &index->header;
+    if (readAllAt(index_fd, header, sizeof(*header), 0) != 0
+        || header->magic != PRESENCE_INDEX_MAGIC || header->version != PRESENCE_INDEX_VERSION
+        || header->block_size == 0
+        || header->block_count != (header->mark.size + header->block_size - 1) / header->block_size) {
+        printf("[Presence Index Error] Not an index of this version\n");
+        return 1;
+    }
+
+    index->blocks = malloc((header->block_count == 0 ? 1 : header->block_count) * sizeof(presence_t));
+    if (index->blocks == NULL) {
+        printf("[Presence Index Error] Failed to allocate %llu blocks\n", (unsigned long long)header->block_count);
+        return 1;
+    }
+
+    if (readAllAt(index_fd, index->blocks, header->block_count * sizeof(presence_t), sizeof(*header)) != 0) {
+        printf("[Presence Index Error] Index is truncated\n");
+        freePresenceIndex(index);
+        return 1;
+    }
+
+    return 0;
+}
+
+void freePresenceIndex(presence_index_t* index)
+{
+    free(index->blocks);
+    index->blocks = NULL;
+}
+
+int markFile(int data_fd, uint64_t size, file_mark_t* mark)
+{
+    struct stat data_stat;
+    if (fstat(data_fd, &data_stat) != 0 || computeFingerprint(data_fd, size, &mark->fingerprint) != 0) {
+        return 1;
+    }
+
+    mark->size = size;
+    mark->modified_seconds = (int64_t)data_stat.st_mtim.tv_sec;
+    mark->modified_nanoseconds = (int64_t)data_stat.st_mtim.tv_nsec;
+    return 0;
+}
+
+bool checkFileMark(const file_mark_t* mark, int data_fd)
+{
+    struct stat data_stat;
+    if (fstat(data_fd, &data_stat) != 0 || !S_ISREG(data_stat.st_mode)) {
+        return false;
+    }
+
+    const uint64_t size = (uint64_t)data_stat.st_size;
+
+    if (size == mark->size
+        && (int64_t)data_stat.st_mtim.tv_sec == mark->modified_seconds
+        && (int64_t)data_stat.st_mtim.tv_nsec == mark->modified_nanoseconds) {
+        return true;
+    }
+
+    // Anything but growth is a rewrite. Growth is trusted to be an append
+    // if the end of the marked part didn't change.
+    uint64_t fingerprint = 0;
+    return size > mark->size
+        && computeFingerprint(data_fd, mark->size, &fingerprint) == 0
+        && fingerprint == mark->fingerprint;
+}
+
+void presenceIndexUnion(const presence_index_t* index, presence_t* presence)
+{
+    presenceClear(presence);
+
+    for (uint64_t block = 0; block < index->header.block_count; ++block) {
+        for (int word = 0; word < 4; ++word) {
+            presence->words[word] |= index->blocks[block].words[word];
+        }
+    }
+}
+
+// Loads the old index if it's still valid for the data file and uses the same block size.
+// Returns the number of its leading full blocks that can be kept.
+static uint64_t loadValidBlocks(const char* index_path, int data_fd, uint64_t block_size, presence_index_t* index)
+{
+    const int index_fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (index_fd < 0) {
+        return 0;
+    }
+
+    const int read_result = readPresenceIndex(index_fd, index);
+    close(index_fd);
+
+    if (read_result != 0) {
+        return 0;
+    }
+
+    if (index->header.block_size != block_size || !checkFileMark(&index->header.mark, data_fd)) {
+        printf("[Presence Index] Old index of a different file state or block size, rebuilding\n");
+        return 0;
+    }
+
+    return index->header.mark.size / block_size;
+}
+
+// Atomically replaces index_path with the header and blocks.
+static int writeIndexFile(const char* index_path, const presence_index_header_t* header, const presence_t* blocks)
+{
+    char temporary_path[4096];
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.XXXXXX", index_path) >= (int)sizeof(temporary_path)) {
+        printf("[Presence Index Error] Index path '%s' is too long\n", index_path);
+        return 1;
+    }
+
+    const int fd = mkstemp(temporary_path);
+    if (fd < 0) {
+        printf("[Presence Index Error] Failed to create '%s': %s\n", temporary_path, strerror(errno));
+        return 1;
+    }
+
+    const int write_failed = fchmod(fd, 0644) != 0
+        || writeAllBytes(fd, header, sizeof(*header))
+        || writeAllBytes(fd, blocks, header->block_count * sizeof(presence_t));
+    const int close_failed = close(fd);
+
+    if (write_failed || close_failed || rename(temporary_path, index_path) != 0) {
+        printf("[Presence Index Error] Failed to write '%s': %s\n", index_path, strerror(errno));
+        unlink(temporary_path);
+        return 1;
+    }
+
+    return 0;
+}
+
+int updatePresenceIndex(const char* data_path, const char* index_path, uint64_t block_size)
+{
+    presence_index_t old_index = { { 0 }, NULL };
+    presence_t* blocks = NULL;
+    char* buffer = NULL;
+    int exit_code = 0;
+
+    const int data_fd = open(data_path, O_RDONLY | O_CLOEXEC);
+    if (data_fd < 0) {
+        printf("[Presence Index Error] Failed to open '%s': %s\n", data_path, strerror(errno));
+        return 1;
+    }
+
+    struct stat data_stat;
+    if (fstat(data_fd, &data_stat) != 0 || !S_ISREG(data_stat.st_mode)) {
+        printf("[Presence Index Error] '%s' isn't a regular file\n", data_path);
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    const uint64_t size = (uint64_t)data_stat.st_size;
+    const uint64_t block_count = (size + block_size - 1) / block_size;
+    const uint64_t kept_blocks = loadValidBlocks(index_path, data_fd, block_size, &old_index);
+
+    blocks = calloc(block_count == 0 ? 1 : block_count, sizeof(*blocks));
+    buffer = malloc(SCAN_BUFFER_SIZE);
+    if (blocks == NULL || buffer == NULL) {
+        printf("[Presence Index Error] Failed to allocate %llu blocks\n", (unsigned long long)block_count);
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    if (kept_blocks != 0) {
+        memcpy(blocks, old_index.blocks, kept_blocks * sizeof(*blocks));
+    }
+
+    // Blocks are scanned from the first one the old index didn't cover completely.
+    for (uint64_t offset = kept_blocks * block_size; offset < size;) {
+        const uint64_t block_end = (offset / block_size + 1) * block_size;
+        const uint64_t chunk_end = block_end < size ? block_end : size;
+        const size_t length = chunk_end - offset < SCAN_BUFFER_SIZE ? (size_t)(chunk_end - offset) : SCAN_BUFFER_SIZE;
+
+        if (readAllAt(data_fd, buffer, length, offset) != 0) {
+            printf("[Presence Index Error] Failed to read '%s' at %llu\n", data_path, (unsigned long long)offset);
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        presenceAdd(&blocks[offset / block_size], buffer, length);
+        offset += length;
+    }
+
+    presence_index_header_t header = { PRESENCE_INDEX_MAGIC, PRESENCE_INDEX_VERSION, block_size, block_count, { 0, 0, 0, 0 } };
+
+    if (markFile(data_fd, size, &header.mark) != 0) {
+        printf("[Presence Index Error] Failed to read the end of '%s'\n", data_path);
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    if ((exit_code = writeIndexFile(index_path, &header, blocks)) != 0) {
+        goto cleanup;
+    }
+
+    printf("[Presence Index] Indexed %llu bytes of '%s' in %llu blocks of %llu bytes, %llu blocks kept, into '%s'\n",
+        (unsigned long long)size, data_path, (unsigned long long)block_count, (unsigned long long)block_size,
+        (unsigned long long)kept_blocks, index_path);
+
+cleanup:
+    close(data_fd);
+    freePresenceIndex(&old_index);
+    free(blocks);
+    free(buffer);
+
+    return exit_code;
+}
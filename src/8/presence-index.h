@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "presence.h"
+
+// Index files are looked up next to the data file under its name with this suffix.
+#define PRESENCE_INDEX_SUFFIX ".m8idx"
+
+#define PRESENCE_INDEX_DEFAULT_BLOCK_SIZE ((uint64_t)64 << 20)
+
+// State of a data file at the moment its first size bytes were scanned.
+typedef struct {
+    uint64_t size;
+    int64_t modified_seconds;
+    int64_t modified_nanoseconds;
+
+    // Hash of the last bytes of the scanned part, used to accept files that were appended to.
+    uint64_t fingerprint;
+} file_mark_t;
+
+// Marks the first size bytes of a data file, modification time is taken as of now.
+int markFile(int data_fd, uint64_t size, file_mark_t* mark);
+
+// Checks that the marked part is still a prefix of the data file: either the file
+// is unchanged, or it only grew and the bytes at the end of the marked part are the same.
+bool checkFileMark(const file_mark_t* mark, int data_fd);
+
+// Byte sets of consecutive fixed-size blocks of a data file. The index covers the first
+// mark.size bytes of the file, the last block may be partial.
+//
+// On disk it's this header followed by block_count 256-bit maps.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t block_size;
+    uint64_t block_count;
+
+    // State of the data file when it was indexed, mark.size bytes are covered.
+    file_mark_t mark;
+} presence_index_header_t;
+
+typedef struct {
+    presence_index_header_t header;
+    presence_t* blocks;
+} presence_index_t;
+
+// Reads a whole index from index_fd.
+int readPresenceIndex(int index_fd, presence_index_t* index);
+void freePresenceIndex(presence_index_t* index);
+
+// Union of all block maps, the byte set of the covered part.
+void presenceIndexUnion(const presence_index_t* index, presence_t* presence);
+
+// Builds or updates the index of data_path in index_path. Blocks of a valid old index
+// are kept except for the last one, so an appended file is only scanned from there.
+int updatePresenceIndex(const char* data_path, const char* index_path, uint64_t block_size);
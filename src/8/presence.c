@@ -0,0 +1,59 @@
+#include <string.h>
+
+#include "presence.h"
+
+void presenceClear(presence_t* presence)
+{
+    memset(presence, 0, sizeof(*presence));
+}
+
+void presenceAdd(presence_t* presence, const char* data, size_t length)
+{
+    // Four independent accumulators per word break the dependency chain of a single map,
+    // then they are merged once per call.
+    uint64_t maps[4][4] = { { 0 } };
+    const unsigned char* bytes = (const unsigned char*)data;
+
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        maps[0][bytes[i] >> 6] |= (uint64_t)1 << (bytes[i] & 63);
+        maps[1][bytes[i + 1] >> 6] |= (uint64_t)1 << (bytes[i + 1] & 63);
+        maps[2][bytes[i + 2] >> 6] |= (uint64_t)1 << (bytes[i + 2] & 63);
+        maps[3][bytes[i + 3] >> 6] |= (uint64_t)1 << (bytes[i + 3] & 63);
+    }
+
+    for (; i < length; ++i) {
+        maps[0][bytes[i] >> 6] |= (uint64_t)1 << (bytes[i] & 63);
+    }
+
+    for (int word = 0; word < 4; ++word) {
+        presence->words[word] |= maps[0][word] | maps[1][word] | maps[2][word] | maps[3][word];
+    }
+}
+
+bool presenceContains(const presence_t* presence, unsigned char byte)
+{
+    return (presence->words[byte >> 6] >> (byte & 63)) & 1;
+}
+
+size_t presenceDifference(const presence_t* including, const presence_t* excluding, char result[128])
+{
+    size_t length = 0;
+    for (int i = 0; i < 128; ++i) {
+        if (presenceContains(including, (unsigned char)i) && !presenceContains(excluding, (unsigned char)i)) {
+            result[length++] = (char)i;
+        }
+    }
+
+    return length;
+}
+
+int presenceCount(const presence_t* presence)
+{
+    int count = 0;
+    for (int word = 0; word < 4; ++word) {
+        count += __builtin_popcountll(presence->words[word]);
+    }
+
+    return count;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Set of byte values met in a stream: bit i of the 256-bit map is set if byte i occurred.
+typedef struct {
+    uint64_t words[4];
+} presence_t;
+
+void presenceClear(presence_t* presence);
+
+// Marks every byte of data as present.
+void presenceAdd(presence_t* presence, const char* data, size_t length);
+
+bool presenceContains(const presence_t* presence, unsigned char byte);
+
+// Writes the ASCII bytes of including missing from excluding into result in byte order.
+// Returns their number, at most 128.
+size_t presenceDifference(const presence_t* including, const presence_t* excluding, char result[128]);
+
+// Number of distinct bytes in the set.
+int presenceCount(const presence_t* presence);
@@ -1,21 +1,122 @@
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "atomic-output.h"
 #include "common.h"
+#include "incremental-state.h"
+#include "inflate.h"
+#include "placement.h"
+#include "presence-index.h"
+#include "rendezvous.h"
+#include "sampler.h"
+#include "session.h"
+#include "shards.h"
+
+// Shards are read by at most this many processes at once.
+#define MAX_SHARD_JOBS 64
+
+// Each shard reader may run ahead of the stream by this many bytes of its pipe.
+#define SHARD_PIPE_SIZE (1 << 20)
+
+// One-vs-many mode keeps at most this many candidates passed to data handler and not yet reported.
+#define MAX_CANDIDATES_IN_FLIGHT 64
+
+// With group durability, outputs of written candidates are published once this many pile up.
+#define CANDIDATE_PUBLISH_BATCH (MAX_CANDIDATES_IN_FLIGHT / 2)
+
+// Decoder processes started for compressed inputs, at most one per input.
+static pid_t decoder_pids[2];
+static int decoder_count = 0;
+
+// startDecoder: Decompresses input_fd into fd in a child process, so that decompression
+// overlaps with the data handler consuming the string and with reading the other input.
+static int startDecoder(const char* file_path, int input_fd,
+    const unsigned char* prefix, size_t prefix_length, int fd)
+{
+    fflush(stdout);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        printf("[Reader Error] Failed to start decoder for file '%s': %s\n", file_path, strerror(errno));
+        return 1;
+    }
+
+    if (pid == 0) {
+        uint64_t output_bytes = 0;
+        const int exit_code = gunzipStream(input_fd, prefix, prefix_length, fd, &output_bytes);
+
+        if (exit_code == 0) {
+            printf("[Reader] Passed a decompressed string of length %llu from file '%s' to fd %d\n",
+                (unsigned long long)output_bytes, file_path, fd);
+        } else {
+            printf("[Reader Error] Failed to decompress file '%s'\n", file_path);
+        }
+
+        fflush(stdout);
+        _exit(exit_code);
+    }
+
+    decoder_pids[decoder_count++] = pid;
+    return 0;
+}
+
+// waitDecoders: Waits for all decoder processes, returns 1 if any of them failed.
+static int waitDecoders(void)
+{
+    int exit_code = 0;
+
+    for (int i = 0; i < decoder_count; ++i) {
+        int status = 0;
+        while (waitpid(decoder_pids[i], &status, 0) < 0) {
+            if (errno != EINTR) {
+                printf("[Reader-Writer Error] Failed to wait for decoder %d: %s\n",
+                    (int)decoder_pids[i], strerror(errno));
+                return 1;
+            }
+        }
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            exit_code = 1;
+        }
+    }
+
+    decoder_count = 0;
+    return exit_code;
+}
+
+// Standard output of results when some output is "-", logs go to standard error then.
+static int standard_output_fd = STDOUT_FILENO;
+
+// Inputs and outputs named "-" are standard input and standard output.
+static bool isStandardStream(const char* path)
+{
+    return strcmp(path, "-") == 0;
+}
 
 // readString: Reads a string from file_path and dumps it into fd.
 // Uses cyclic reading-writing to avoid buffer overflow.
+// gzip-compressed files are detected by their magic number and handed to a decoder process.
 int readString(const char* file_path, int fd)
 {
     printf("[Reader] Started with file '%s'\n", file_path);
 
-    const int input_fd = open(file_path, O_RDONLY);
+    const int input_fd = isStandardStream(file_path) ? dup(STDIN_FILENO) : open(file_path, O_RDONLY);
     if (input_fd == -1) {
         printf("[Reader Error] Failed to open file '%s': %s\n", file_path, strerror(errno));
         return 1;
@@ -28,9 +129,66 @@ int readString(const char* file_path, int fd)
     ssize_t read_bytes = 0;
     size_t written_bytes = 0;
 
+    unsigned char magic[COMPRESSION_MAGIC_LENGTH];
+    size_t magic_length = 0;
+    bool decompressing = false;
+
+    while (magic_length < COMPRESSION_MAGIC_LENGTH) {
+        read_bytes = read(input_fd, magic + magic_length, COMPRESSION_MAGIC_LENGTH - magic_length);
+        if (read_bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Reader Error] Failed to read file '%s': %s\n", file_path, strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        if (read_bytes == 0) {
+            break;
+        }
+
+        magic_length += read_bytes;
+    }
+
+    switch (detectCompression(magic, magic_length)) {
+    case COMPRESSION_GZIP:
+        exit_code = startDecoder(file_path, input_fd, magic, magic_length, fd);
+        decompressing = exit_code == 0;
+        if (decompressing) {
+            printf("[Reader] Started decompressing gzip file '%s' to fd %d\n", file_path, fd);
+        }
+        goto cleanup;
+    case COMPRESSION_ZSTD:
+        printf("[Reader Error] File '%s' is zstd-compressed, which is not supported: "
+               "decompress it with 'zstd -d' first\n",
+            file_path);
+        exit_code = 1;
+        goto cleanup;
+    case COMPRESSION_NONE:
+        break;
+    }
+
+    if (write(fd, magic, magic_length) < 0) {
+        printf("[Reader Error] Failed to write another chunk of file '%s' to pipe: '%s'\n", file_path, strerror(errno));
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    written_bytes += magic_length;
+    if (magic_length < COMPRESSION_MAGIC_LENGTH) {
+        goto cleanup;
+    }
+
     do {
         read_bytes = read(input_fd, buffer, BUFFER_SIZE);
         if (read_bytes == -1) {
+            // Goes to the loop condition, which holds for -1.
+            if (errno == EINTR) {
+                continue;
+            }
+
             printf("[Reader Error] Failed to read another chunk of file '%s': %s\n",
                 file_path, strerror(errno));
             exit_code = 1;
@@ -44,7 +202,7 @@ int readString(const char* file_path, int fd)
         }
 
         written_bytes += read_bytes;
-    } while (read_bytes == BUFFER_SIZE);
+    } while (read_bytes != 0);
 
 cleanup:
     // Close no longer needed input_fd.
@@ -53,7 +211,7 @@ cleanup:
         return 1;
     }
 
-    if (exit_code == 0) {
+    if (exit_code == 0 && !decompressing) {
         printf("[Reader] Passed a string of length %zu from file '%s' to fd %d\n",
             written_bytes, file_path, fd);
     }
@@ -61,56 +219,350 @@ cleanup:
     return exit_code;
 }
 
-// writeString: Reads a string from fd and dumps it into file_path.
-// Uses cyclic reading-writing to avoid buffer overflow.
-int writeString(const char* file_path, int fd)
+typedef struct {
+    pid_t pid;
+    int read_fd;
+} shard_reader_t;
+
+// startShardReader: Passes a shard file into a new pipe in a child process.
+static int startShardReader(const char* file_path, shard_reader_t* reader)
+{
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        printf("[Reader Error] Failed to create pipe for shard '%s': %s\n", file_path, strerror(errno));
+        return 1;
+    }
+
+    // Enlarging the pipe is best-effort: it only lets the reader get further ahead.
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, SHARD_PIPE_SIZE);
+
+    fflush(stdout);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        printf("[Reader Error] Failed to start reader for shard '%s': %s\n", file_path, strerror(errno));
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return 1;
+    }
+
+    if (pid == 0) {
+        close(pipe_fds[0]);
+
+        decoder_count = 0;
+        int exit_code = readString(file_path, pipe_fds[1]);
+        close(pipe_fds[1]);
+
+        if (waitDecoders() != 0) {
+            exit_code = 1;
+        }
+
+        fflush(stdout);
+        _exit(exit_code);
+    }
+
+    close(pipe_fds[1]);
+    reader->pid = pid;
+    reader->read_fd = pipe_fds[0];
+    return 0;
+}
+
+// finishShardReader: Waits for a shard reader, returns 1 if it failed.
+static int finishShardReader(shard_reader_t* reader)
+{
+    if (reader->read_fd != -1) {
+        close(reader->read_fd);
+        reader->read_fd = -1;
+    }
+
+    int status = 0;
+    while (waitpid(reader->pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 1;
+        }
+    }
+
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+// drainPipe: Moves everything from pipe_fd into fd without copying through user space.
+static int drainPipe(int pipe_fd, int fd, uint64_t* passed_bytes)
+{
+    for (;;) {
+        const ssize_t moved = splice(pipe_fd, NULL, fd, NULL, SHARD_PIPE_SIZE, SPLICE_F_MOVE);
+        if (moved < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Reader Error] Failed to pass shard data to fd %d: %s\n", fd, strerror(errno));
+            return 1;
+        }
+
+        if (moved == 0) {
+            return 0;
+        }
+
+        *passed_bytes += moved;
+    }
+}
+
+// passShards: Passes shard files into fd one after another, as a single string.
+// Up to jobs shards are read (and decompressed) in parallel, each into its own pipe;
+// pipes are drained strictly in shard order.
+static int passShards(const char* spec, const shard_list_t* shards, int fd, int jobs)
+{
+    printf("[Reader] Passing %zu shards of '%s' to fd %d with %d parallel readers\n",
+        shards->count, spec, fd, jobs);
+
+    shard_reader_t readers[MAX_SHARD_JOBS];
+    size_t started = 0;
+    size_t finished = 0;
+    uint64_t passed_bytes = 0;
+    int exit_code = 0;
+
+    while (finished < shards->count) {
+        while (started < shards->count && started < finished + (size_t)jobs) {
+            if (startShardReader(shards->paths[started], &readers[started % jobs]) != 0) {
+                exit_code = 1;
+                goto cleanup;
+            }
+            ++started;
+        }
+
+        shard_reader_t* reader = &readers[finished % jobs];
+        exit_code = drainPipe(reader->read_fd, fd, &passed_bytes);
+        ++finished;
+
+        if (finishShardReader(reader) != 0 || exit_code != 0) {
+            printf("[Reader Error] Failed to pass shard '%s'\n", shards->paths[finished - 1]);
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    // Readers that ran ahead of a failed shard are no longer needed.
+    for (; finished < started; ++finished) {
+        shard_reader_t* reader = &readers[finished % jobs];
+        kill(reader->pid, SIGTERM);
+        finishShardReader(reader);
+    }
+
+    if (exit_code == 0) {
+        printf("[Reader] Passed a string of length %llu from %zu shards of '%s' to fd %d\n",
+            (unsigned long long)passed_bytes, shards->count, spec, fd);
+    }
+
+    return exit_code;
+}
+
+// readInput: Passes an input argument into fd: a single file goes through readString,
+// a directory, a pattern or a list file is expanded and its shards are passed in parallel.
+int readInput(const char* spec, int fd, int jobs)
+{
+    shard_list_t shards;
+    if (expandShards(spec, &shards) != 0) {
+        return 1;
+    }
+
+    int exit_code = 0;
+
+    if (shards.count == 0) {
+        printf("[Reader Error] No input files match '%s'\n", spec);
+        exit_code = 1;
+    } else if (shards.count == 1 && strcmp(shards.paths[0], spec) == 0) {
+        exit_code = readString(spec, fd);
+    } else {
+        exit_code = passShards(spec, &shards, fd, jobs);
+    }
+
+    freeShards(&shards);
+    return exit_code;
+}
+
+// Results are collected in chunks of this size before being written out.
+#define RESULT_CHUNK_SIZE ((size_t)64 << 10)
+
+// A result is written with a single writev unless it takes more than this many chunks (64 MiB).
+#define MAX_RESULT_CHUNKS 1024
+
+// writeChunks: Writes the first count chunks, the last of which holds last_length bytes, with one writev.
+static int writeChunks(int fd, char** chunks, int count, size_t last_length)
+{
+    static struct iovec vector[MAX_RESULT_CHUNKS];
+
+    for (int i = 0; i < count; ++i) {
+        vector[i].iov_base = chunks[i];
+        vector[i].iov_len = i == count - 1 ? last_length : RESULT_CHUNK_SIZE;
+    }
+
+    return writeVector(fd, vector, count);
+}
+
+// writeString: Reads a string from fd into output, a file to be published as file_path.
+// The string is collected in memory and written with one writev once the pipe is closed.
+int writeString(const char* file_path, int fd, atomic_output_t* output)
 {
     printf("[Writer] Started with file '%s'\n", file_path);
 
-    const int output_fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (openAtomicOutput(output, file_path) != 0) {
+        return 1;
+    }
+
+    // Chunks are allocated once and reused for the second result.
+    static char* chunks[MAX_RESULT_CHUNKS];
+    int count = 0;
+    size_t filled = RESULT_CHUNK_SIZE;
+    uint64_t length = 0;
+
+    for (;;) {
+        if (filled == RESULT_CHUNK_SIZE) {
+            if (count == MAX_RESULT_CHUNKS) {
+                if (writeChunks(output->fd, chunks, count, RESULT_CHUNK_SIZE) != 0) {
+                    goto fail;
+                }
+                count = 0;
+            }
+
+            if (chunks[count] == NULL && (chunks[count] = malloc(RESULT_CHUNK_SIZE)) == NULL) {
+                printf("[Writer Error] Failed to allocate result buffer\n");
+                goto fail;
+            }
+
+            ++count;
+            filled = 0;
+        }
+
+        const ssize_t read_bytes = read(fd, chunks[count - 1] + filled, RESULT_CHUNK_SIZE - filled);
+        if (read_bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Writer Error] Failed to read another chunk from fd %d: %s\n", fd, strerror(errno));
+            goto fail;
+        }
+
+        if (read_bytes == 0) {
+            break;
+        }
+
+        filled += (size_t)read_bytes;
+        length += (uint64_t)read_bytes;
+    }
+
+    if (writeChunks(output->fd, chunks, count, filled) != 0) {
+        goto fail;
+    }
+
+    printf("[Writer] Collected result of %llu bytes for file '%s' from input fd %d\n",
+        (unsigned long long)length, file_path, fd);
+    return 0;
+
+fail:
+    discardAtomicOutput(output);
+    return 1;
+}
+
+// isStreamOutput: Outputs that aren't regular files (standard output, pipes, /dev/fd/N, process
+// substitution) can't be replaced atomically, results are passed into them as they come.
+static bool isStreamOutput(const char* path)
+{
+    struct stat output_stat;
+    return isStandardStream(path) || (stat(path, &output_stat) == 0 && !S_ISREG(output_stat.st_mode));
+}
+
+// writeFrame: Writes a chunk of result 1 or 2 into standard output as a "<result> <length>\n"
+// header followed by the chunk itself. Every result ends with an empty frame.
+static int writeFrame(int result, const char* data, size_t length)
+{
+    char header[32];
+    const int header_length = snprintf(header, sizeof(header), "%d %zu\n", result, length);
+
+    struct iovec vector[2] = { { header, (size_t)header_length }, { (void*)data, length } };
+    return writeVector(standard_output_fd, vector, length > 0 ? 2 : 1);
+}
+
+// streamString: Passes result 1 or 2 from fd into a stream output as it comes, framed for
+// standard output and as is for anything else.
+static int streamString(const char* file_path, int result, int fd)
+{
+    printf("[Writer] Started with stream '%s'\n", file_path);
+
+    const bool framed = isStandardStream(file_path);
+    const int output_fd = framed ? standard_output_fd : open(file_path, O_WRONLY | O_CLOEXEC);
     if (output_fd == -1) {
-        printf("[Writer Error] Failed to open file '%s': %s\n", file_path, strerror(errno));
+        printf("[Writer Error] Failed to open stream '%s': %s\n", file_path, strerror(errno));
         return 1;
     }
 
     int exit_code = 0;
-
+    uint64_t length = 0;
     static char buffer[BUFFER_SIZE];
-    ssize_t read_bytes = 0;
 
-    do {
-        read_bytes = read(fd, buffer, BUFFER_SIZE);
-        if (read_bytes == -1) {
+    for (;;) {
+        const ssize_t read_bytes = read(fd, buffer, BUFFER_SIZE);
+        if (read_bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
             printf("[Writer Error] Failed to read another chunk from fd %d: %s\n", fd, strerror(errno));
             exit_code = 1;
-            goto cleanup;
+            break;
         }
 
-        if (write(output_fd, buffer, read_bytes) < 0) {
-            printf("[Writer Error] Failed to write result to file '%s': %s\n", file_path, strerror(errno));
+        struct iovec vector = { buffer, (size_t)read_bytes };
+        if (framed ? writeFrame(result, buffer, read_bytes) != 0
+                   : read_bytes > 0 && writeVector(output_fd, &vector, 1) != 0) {
             exit_code = 1;
-            goto cleanup;
+            break;
         }
-    } while (read_bytes == BUFFER_SIZE);
 
-cleanup:
-    // Close no longer needed output_fd
-    if (close(output_fd) < 0) {
-        printf("[Reader Error] Failed to close output file '%s': %s\n", file_path, strerror(errno));
-        return 1;
+        if (read_bytes == 0) {
+            break;
+        }
+
+        length += (uint64_t)read_bytes;
+    }
+
+    if (!framed) {
+        close(output_fd);
     }
 
     if (exit_code == 0) {
-        printf("[Writer] Passed result to file '%s' from input fd %d\n", file_path, fd);
+        printf("[Writer] Passed result of %llu bytes into stream '%s' from input fd %d\n",
+            (unsigned long long)length, file_path, fd);
     }
 
     return exit_code;
 }
 
+static void printUsage(void)
+{
+    printf("Usage: ./mark8-rw [--jobs=<N>] [--durability=<policy>] [--cpus=auto|<cpu_list>] [--socket=<name> [--direct [--incremental] | --follow | --sample[=<blocks>]] | --session[=<name>]] <input_1> <input_2> <output_file_1> <output_file_2>\n"
+           "       ./mark8-rw [--jobs=<N>] [--durability=<policy>] [--cpus=auto|<cpu_list>] --socket=<name> --candidates=<candidates> <reference> <output_directory>\n"
+           "Each input is a file, a directory, a glob pattern or @<list_file> of shard files.\n"
+           "Candidates are files given the same way, results of each one go to <output_directory>/<name>.1 and .2\n"
+           "Output files are replaced atomically once complete. Durability policy is one of:\n"
+           "  none   (default) no flushing, a crash may leave outputs empty or missing\n"
+           "  data   every output is flushed with fdatasync before it's published\n"
+           "  group  outputs published together are flushed with one syncfs (batches of candidates)\n"
+           "An input may be \"-\" for standard input, any input may be a pipe such as /dev/fd/N or <(...).\n"
+           "Outputs that aren't regular files get results as they come. Outputs named \"-\" go to standard\n"
+           "output as frames of \"<result> <length>\\n\" and <length> bytes, every result ends with an empty\n"
+           "frame; logs go to standard error then.\n"
+           "--sample passes <blocks> random 64 KiB blocks of each input file first (64 by default), publishes\n"
+           "the provisional results with their confidence, then passes the rest and publishes every correction.\n"
+           "--cpus pins reader-writer and its children to the CPUs, 'auto' keeps them in the cache domain\n"
+           "of the current CPU; mark8-h --cpus=auto then takes cores sharing that cache.\n");
+}
+
 void checkArgumentCount(bool arg_condition, const char* arg_name)
 {
     if (arg_condition) {
-        printf("Usage: ./prog <input_file_1> <input_file_2> <output_file_1> <output_file_2>\n");
+        printUsage();
         printf("[Error] Missing required argument %s\n", arg_name);
         exit(1);
     }
@@ -125,113 +577,1394 @@ static void closeFile(int* fd)
     }
 }
 
-int main(int argc, char** argv)
+typedef struct {
+    int jobs;
+
+    // Pipes are passed over this rendezvous socket instead of FIFOs if set.
+    const char* socket_name;
+
+    // Input and output files themselves are passed over the socket if set.
+    bool direct;
+
+    // Inputs are followed for appended data until the program is stopped.
+    bool follow;
+
+    // Sampling mode: number of random blocks of each input passed first, 0 if off.
+    uint64_t sample_blocks;
+
+    // Direct mode only: inputs are scanned from where the previous run stopped if they only grew.
+    bool incremental;
+
+    // One-vs-many mode: every candidate file is diffed against the single reference input.
+    const char* candidates;
+
+    // How output files are flushed before and after they're published.
+    durability_t durability;
+
+    // CPUs reader-writer, its decoders and shard readers run on.
+    placement_t placement;
+
+    // FIFOs are created in a private session directory if set, session_name may be NULL for a unique one.
+    bool use_session;
+    const char* session_name;
+} reader_writer_options_t;
+
+// Parses reader-writer options, positional arguments are left starting from argv[optind].
+static int parseOptions(int argc, char** argv, reader_writer_options_t* options)
 {
-    checkArgumentCount(argc < 2, "<input_file_1>");
-    checkArgumentCount(argc < 3, "<input_file_2>");
-    checkArgumentCount(argc < 4, "<output_file_1>");
-    checkArgumentCount(argc < 5, "<output_file_2>");
+    static const struct option long_options[] = {
+        { "jobs", required_argument, NULL, 'j' },
+        { "socket", required_argument, NULL, 's' },
+        { "session", optional_argument, NULL, 'S' },
+        { "direct", no_argument, NULL, 'd' },
+        { "candidates", required_argument, NULL, 'c' },
+        { "incremental", no_argument, NULL, 'i' },
+        { "follow", no_argument, NULL, 'f' },
+        { "sample", optional_argument, NULL, 'a' },
+        { "durability", required_argument, NULL, 'D' },
+        { "cpus", required_argument, NULL, 'C' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    memset(options, 0, sizeof(*options));
+
+    const long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    options->jobs = cpu_count < 1 ? 1 : cpu_count > MAX_SHARD_JOBS ? MAX_SHARD_JOBS : (int)cpu_count;
+
+    int option = 0;
+    while ((option = getopt_long(argc, argv, "j:", long_options, NULL)) != -1) {
+        switch (option) {
+        case 'j':
+            options->jobs = atoi(optarg);
+            if (options->jobs < 1 || options->jobs > MAX_SHARD_JOBS) {
+                printf("[Reader-Writer Error] Job count must be in [1, %d], got '%s'\n", MAX_SHARD_JOBS, optarg);
+                return 1;
+            }
+            break;
+        case 's':
+            options->socket_name = optarg;
+            break;
+        case 'S':
+            options->use_session = true;
+            options->session_name = optarg;
+            break;
+        case 'd':
+            options->direct = true;
+            break;
+        case 'c':
+            options->candidates = optarg;
+            break;
+        case 'i':
+            options->incremental = true;
+            break;
+        case 'f':
+            options->follow = true;
+            break;
+        case 'a':
+            options->sample_blocks = optarg == NULL ? SAMPLE_DEFAULT_BLOCKS : strtoull(optarg, NULL, 10);
+            if (options->sample_blocks == 0) {
+                printf("[Reader-Writer Error] Sample block count must be positive, got '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'D':
+            if (parseDurability(optarg, &options->durability) != 0) {
+                printf("[Reader-Writer Error] Durability must be none, data or group, got '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'C':
+            if (parsePlacement(optarg, &options->placement) != 0) {
+                printf("[Reader-Writer Error] CPUs must be 'auto' or a list such as '0-3,8', got '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            printUsage();
+            return 1;
+        }
+    }
 
-    // Create all FIFOs here.
-    if (mkfifo(INPUT_FIFO_NAME_1, 0666) < 0 && errno != EEXIST) {
-        printf("[Reader-Writer Error] Failed to create pipe '%s': %s\n",
-            INPUT_FIFO_NAME_1, strerror(errno));
+    if (options->socket_name != NULL && options->use_session) {
+        printf("[Reader-Writer Error] --socket and --session can't be used together\n");
         return 1;
     }
 
-    if (mkfifo(INPUT_FIFO_NAME_2, 0666) < 0 && errno != EEXIST) {
-        printf("[Reader-Writer Error] Failed to create pipe '%s': %s\n",
-            INPUT_FIFO_NAME_2, strerror(errno));
+    if (options->direct && options->socket_name == NULL) {
+        printf("[Reader-Writer Error] --direct needs --socket\n");
         return 1;
     }
 
-    if (mkfifo(OUTPUT_FIFO_NAME_1, 0666) < 0 && errno != EEXIST) {
-        printf("[Reader-Writer Error] Failed to create pipe '%s': %s\n",
-            OUTPUT_FIFO_NAME_1, strerror(errno));
+    if (options->follow && (options->socket_name == NULL || options->direct)) {
+        printf("[Reader-Writer Error] --follow needs --socket and can't be used with --direct\n");
         return 1;
     }
 
-    if (mkfifo(OUTPUT_FIFO_NAME_2, 0666) < 0 && errno != EEXIST) {
-        printf("[Reader-Writer Error] Failed to create pipe '%s': %s\n",
-            OUTPUT_FIFO_NAME_2, strerror(errno));
+    if (options->sample_blocks != 0 && (options->socket_name == NULL || options->direct || options->follow)) {
+        printf("[Reader-Writer Error] --sample needs --socket and can't be used with --direct or --follow\n");
         return 1;
     }
 
-    int input_fd_1 = -1;
-    int input_fd_2 = -1;
-    int output_fd_1 = -1;
-    int output_fd_2 = -1;
+    if (options->incremental && !options->direct) {
+        printf("[Reader-Writer Error] --incremental needs --direct\n");
+        return 1;
+    }
 
-    if ((input_fd_1 = open(INPUT_FIFO_NAME_1, O_WRONLY)) < 0) {
-        printf("[Reader-Writer Error] Failed to open input pipe '%s': %s\n",
-            INPUT_FIFO_NAME_1, strerror(errno));
+    if (options->candidates != NULL && (options->socket_name == NULL || options->direct || options->sample_blocks != 0)) {
+        printf("[Reader-Writer Error] --candidates needs --socket and can't be used with --direct or --sample\n");
         return 1;
     }
 
-    int exit_code = 0;
-    printf("[Reader-Writer] Opened (reader-writer -> data handler) pipe '%s' with fd: '%d'\n",
-        INPUT_FIFO_NAME_1, input_fd_1);
+    return 0;
+}
+
+// Creates all FIFOs in the current directory, existing ones are reused.
+static int createFifos(const session_t* session)
+{
+    for (int i = 0; i < SESSION_FIFO_COUNT; ++i) {
+        if (mkfifo(session->fifo_paths[i], 0666) < 0 && errno != EEXIST) {
+            printf("[Reader-Writer Error] Failed to create pipe '%s': %s\n",
+                session->fifo_paths[i], strerror(errno));
+            return 1;
+        }
+    }
 
-    if ((input_fd_2 = open(INPUT_FIFO_NAME_2, O_WRONLY)) < 0) {
+    return 0;
+}
+
+// Opens the input FIFOs, blocking until data handler opens them too.
+static int openInputFifos(const session_t* session, int* input_fd_1, int* input_fd_2)
+{
+    if ((*input_fd_1 = open(session->fifo_paths[SESSION_INPUT_1], O_WRONLY)) < 0) {
         printf("[Reader-Writer Error] Failed to open input pipe '%s': %s\n",
-            INPUT_FIFO_NAME_2, strerror(errno));
-        exit_code = 1;
-        goto cleanup;
+            session->fifo_paths[SESSION_INPUT_1], strerror(errno));
+        return 1;
     }
 
     printf("[Reader-Writer] Opened (reader-writer -> data handler) pipe '%s' with fd: '%d'\n",
-        INPUT_FIFO_NAME_2, input_fd_2);
-
-    const char* input_file_1 = argv[1];
-    const char* input_file_2 = argv[2];
+        session->fifo_paths[SESSION_INPUT_1], *input_fd_1);
 
-    exit_code = readString(input_file_1, input_fd_1)
-        || readString(input_file_2, input_fd_2);
+    if ((*input_fd_2 = open(session->fifo_paths[SESSION_INPUT_2], O_WRONLY)) < 0) {
+        printf("[Reader-Writer Error] Failed to open input pipe '%s': %s\n",
+            session->fifo_paths[SESSION_INPUT_2], strerror(errno));
+        return 1;
+    }
 
-    closeFile(&input_fd_1);
-    closeFile(&input_fd_2);
+    printf("[Reader-Writer] Opened (reader-writer -> data handler) pipe '%s' with fd: '%d'\n",
+        session->fifo_paths[SESSION_INPUT_2], *input_fd_2);
 
-    if (exit_code != 0) {
-        printf("[Reader-Writer Error] Failed to read strings, exiting...\n");
-        goto cleanup;
-    }
+    return 0;
+}
 
-    if ((output_fd_1 = open(OUTPUT_FIFO_NAME_1, O_RDONLY)) < 0) {
+// Opens the output FIFOs, blocking until data handler opens them too.
+static int openOutputFifos(const session_t* session, int* output_fd_1, int* output_fd_2)
+{
+    if ((*output_fd_1 = open(session->fifo_paths[SESSION_OUTPUT_1], O_RDONLY)) < 0) {
         printf("[Reader-Writer Error] Failed to open output pipe '%s': %s\n",
-            OUTPUT_FIFO_NAME_1, strerror(errno));
-        exit_code = 1;
-        goto cleanup;
+            session->fifo_paths[SESSION_OUTPUT_1], strerror(errno));
+        return 1;
     }
 
     printf("[Reader-Writer] Opened (data handler -> reader-writer) pipe '%s' with fd: '%d'\n",
-        OUTPUT_FIFO_NAME_1, input_fd_1);
+        session->fifo_paths[SESSION_OUTPUT_1], *output_fd_1);
 
-    if ((output_fd_2 = open(OUTPUT_FIFO_NAME_2, O_RDONLY)) < 0) {
+    if ((*output_fd_2 = open(session->fifo_paths[SESSION_OUTPUT_2], O_RDONLY)) < 0) {
         printf("[Reader-Writer Error] Failed to open output pipe '%s': %s\n",
-            OUTPUT_FIFO_NAME_2, strerror(errno));
-        exit_code = 1;
-        goto cleanup;
+            session->fifo_paths[SESSION_OUTPUT_2], strerror(errno));
+        return 1;
     }
 
     printf("[Reader-Writer] Opened (data handler -> reader-writer) pipe '%s' with fd: '%d'\n",
-        OUTPUT_FIFO_NAME_2, input_fd_2);
+        session->fifo_paths[SESSION_OUTPUT_2], *output_fd_2);
 
-    const char* output_file_1 = argv[3];
-    const char* output_file_2 = argv[4];
+    return 0;
+}
 
-    exit_code = writeString(output_file_1, output_fd_1)
-        || writeString(output_file_2, output_fd_2);
+// Creates anonymous pipes and passes data handler's ends to it over the rendezvous socket in a message of kind.
+// fds receive the reader-writer's ends: write ends of the inputs and read ends of the outputs.
+static int connectPipes(const char* socket_name, rendezvous_kind_t kind, int fds[RENDEZVOUS_FD_COUNT])
+{
+    int pipes[RENDEZVOUS_PIPE_COUNT][2];
+    int handler_fds[RENDEZVOUS_FD_COUNT];
+    clearDescriptors(handler_fds);
+    int exit_code = 0;
 
-    if (exit_code != 0) {
-        printf("[Reader-Writer Error] Failed to write strings, exiting...\n");
-        goto cleanup;
+    for (int i = 0; i < RENDEZVOUS_PIPE_COUNT; ++i) {
+        pipes[i][0] = pipes[i][1] = -1;
     }
 
-cleanup:
-    closeFile(&input_fd_1);
-    closeFile(&input_fd_2);
-    closeFile(&output_fd_1);
-    closeFile(&output_fd_2);
+    for (int i = 0; i < RENDEZVOUS_PIPE_COUNT; ++i) {
+        if (pipe(pipes[i]) < 0) {
+            printf("[Reader-Writer Error] Failed to create pipe: %s\n", strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    handler_fds[RENDEZVOUS_INPUT_1] = pipes[RENDEZVOUS_INPUT_1][0];
+    handler_fds[RENDEZVOUS_INPUT_2] = pipes[RENDEZVOUS_INPUT_2][0];
+    handler_fds[RENDEZVOUS_OUTPUT_1] = pipes[RENDEZVOUS_OUTPUT_1][1];
+    handler_fds[RENDEZVOUS_OUTPUT_2] = pipes[RENDEZVOUS_OUTPUT_2][1];
+
+    int socket_fd = connectRendezvous(socket_name);
+    if (socket_fd < 0) {
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    exit_code = awaitAdmission(socket_fd) || sendDescriptors(socket_fd, kind, 0, handler_fds);
+    closeFile(&socket_fd);
+
+    if (exit_code != 0) {
+        goto cleanup;
+    }
+
+    // Data handler has its own copies now.
+    closeFile(&pipes[RENDEZVOUS_INPUT_1][0]);
+    closeFile(&pipes[RENDEZVOUS_INPUT_2][0]);
+    closeFile(&pipes[RENDEZVOUS_OUTPUT_1][1]);
+    closeFile(&pipes[RENDEZVOUS_OUTPUT_2][1]);
+
+    fds[RENDEZVOUS_INPUT_1] = pipes[RENDEZVOUS_INPUT_1][1];
+    fds[RENDEZVOUS_INPUT_2] = pipes[RENDEZVOUS_INPUT_2][1];
+    fds[RENDEZVOUS_OUTPUT_1] = pipes[RENDEZVOUS_OUTPUT_1][0];
+    fds[RENDEZVOUS_OUTPUT_2] = pipes[RENDEZVOUS_OUTPUT_2][0];
+
+    printf("[Reader-Writer] Passed pipes to data handler over socket '@%s'\n", socket_name);
+    return 0;
+
+cleanup:
+    for (int i = 0; i < RENDEZVOUS_PIPE_COUNT; ++i) {
+        closeFile(&pipes[i][0]);
+        closeFile(&pipes[i][1]);
+    }
+
+    return exit_code;
+}
+
+// isDirectInput: Checks whether an input is a single uncompressed regular file,
+// which data handler can read by itself.
+static bool isDirectInput(const char* spec)
+{
+    struct stat input_stat;
+    if (spec[0] == '@' || strpbrk(spec, "*?[") != NULL || stat(spec, &input_stat) < 0 || !S_ISREG(input_stat.st_mode)) {
+        return false;
+    }
+
+    const int input_fd = open(spec, O_RDONLY | O_CLOEXEC);
+    if (input_fd < 0) {
+        return false;
+    }
+
+    unsigned char magic[COMPRESSION_MAGIC_LENGTH];
+    const ssize_t magic_length = pread(input_fd, magic, sizeof(magic), 0);
+    close(input_fd);
+
+    return magic_length >= 0 && detectCompression(magic, magic_length) == COMPRESSION_NONE;
+}
+
+// openIndex: Opens the presence index next to an input file, -1 if there is none.
+// Data handler checks that it still matches the file.
+static int openIndex(const char* file_path)
+{
+    char index_path[4096];
+    if (snprintf(index_path, sizeof(index_path), "%s%s", file_path, PRESENCE_INDEX_SUFFIX) >= (int)sizeof(index_path)) {
+        return -1;
+    }
+
+    const int index_fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (index_fd >= 0) {
+        printf("[Reader] Passing index '%s' along with file '%s'\n", index_path, file_path);
+    }
+
+    return index_fd;
+}
+
+// passFilesDirectly: Opens the input and output files and passes them to data handler over
+// the rendezvous socket, so that no data goes through reader-writer. Inputs that need
+// reading (shards, compressed files) are still passed through pipes.
+// Presence indexes of input files are passed along if they exist.
+// In incremental mode the state of the previous run is passed too, together with a temporary
+// file for the new state, which replaces the old one once the results are written.
+// Outputs are written aside and published only after data handler reports that they're complete.
+static int passFilesDirectly(const char* socket_name, char** files, int jobs, bool incremental, durability_t durability)
+{
+    int fds[RENDEZVOUS_FD_COUNT];
+    clearDescriptors(fds);
+    int feed_fds[2] = { -1, -1 };
+    int socket_fd = -1;
+    int exit_code = 0;
+
+    // Results and the new state are written aside and published together.
+    atomic_output_t outputs[3];
+    size_t output_count = 0;
+    char state_path[4096];
+
+    if (incremental) {
+        if (!isDirectInput(files[0]) || !isDirectInput(files[1])) {
+            printf("[Reader-Writer Error] Incremental mode needs both inputs to be uncompressed regular files\n");
+            return 1;
+        }
+
+        if (snprintf(state_path, sizeof(state_path), "%s%s", files[2], INCREMENTAL_STATE_SUFFIX) >= (int)sizeof(state_path)) {
+            printf("[Reader-Writer Error] Output path '%s' is too long\n", files[2]);
+            return 1;
+        }
+
+        if ((fds[RENDEZVOUS_STATE_IN] = open(state_path, O_RDONLY | O_CLOEXEC)) >= 0) {
+            printf("[Reader] Passing state '%s' of the previous run\n", state_path);
+        }
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        if (isDirectInput(files[i])) {
+            if ((fds[RENDEZVOUS_INPUT_1 + i] = open(files[i], O_RDONLY | O_CLOEXEC)) < 0) {
+                printf("[Reader Error] Failed to open file '%s': %s\n", files[i], strerror(errno));
+                exit_code = 1;
+                goto cleanup;
+            }
+
+            fds[RENDEZVOUS_INDEX_1 + i] = openIndex(files[i]);
+            continue;
+        }
+
+        int pipe_fds[2];
+        if (pipe(pipe_fds) < 0) {
+            printf("[Reader-Writer Error] Failed to create pipe: %s\n", strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        fds[RENDEZVOUS_INPUT_1 + i] = pipe_fds[0];
+        feed_fds[i] = pipe_fds[1];
+    }
+
+    for (int i = 0; i < (incremental ? 3 : 2); ++i) {
+        if (openAtomicOutput(&outputs[i], i < 2 ? files[2 + i] : state_path) != 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        ++output_count;
+
+        // Data handler gets a copy, the output itself stays here to be published.
+        if ((fds[i < 2 ? RENDEZVOUS_OUTPUT_1 + i : RENDEZVOUS_STATE_OUT] = fcntl(outputs[i].fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+            printf("[Writer Error] Failed to duplicate output fd: %s\n", strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    if ((socket_fd = connectRendezvous(socket_name)) < 0 || awaitAdmission(socket_fd) != 0
+        || sendDescriptors(socket_fd, RENDEZVOUS_FILES, 0, fds) != 0) {
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    printf("[Reader-Writer] Passed files to data handler over socket '@%s'\n", socket_name);
+
+    // Data handler has its own copies now.
+    for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+        closeFile(&fds[i]);
+    }
+
+    for (int i = 0; i < 2 && exit_code == 0; ++i) {
+        if (feed_fds[i] != -1) {
+            exit_code = readInput(files[i], feed_fds[i], jobs);
+            closeFile(&feed_fds[i]);
+        }
+    }
+
+    closeFile(&feed_fds[0]);
+    closeFile(&feed_fds[1]);
+
+    if (waitDecoders() != 0) {
+        exit_code = 1;
+    }
+
+    uint32_t tag = 0;
+    int handler_exit_code = 0;
+    if (receiveStatus(socket_fd, &tag, &handler_exit_code) != 0 || handler_exit_code != 0) {
+        printf("[Reader-Writer Error] Data handler failed to write results\n");
+        exit_code = 1;
+    }
+
+    // The state is only replaced together with the results it describes, and after them.
+    if (exit_code == 0) {
+        exit_code = publishAtomicOutputs(outputs, output_count, durability);
+        output_count = 0;
+
+        if (exit_code == 0) {
+            printf("[Writer] Data handler wrote results to files '%s' and '%s'\n", files[2], files[3]);
+        }
+
+        if (exit_code == 0 && incremental) {
+            printf("[Writer] Saved state to '%s'\n", state_path);
+        }
+    }
+
+cleanup:
+    for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+        closeFile(&fds[i]);
+    }
+
+    for (size_t i = 0; i < output_count; ++i) {
+        discardAtomicOutput(&outputs[i]);
+    }
+
+    closeFile(&feed_fds[0]);
+    closeFile(&feed_fds[1]);
+    closeFile(&socket_fd);
+
+    return exit_code;
+}
+
+static const char* baseName(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+static int compareBaseNames(const void* left, const void* right)
+{
+    return strcmp(baseName(*(char* const*)left), baseName(*(char* const*)right));
+}
+
+// checkCandidateNames: Results are named after candidates, so no two of them may share a file name.
+static int checkCandidateNames(const shard_list_t* candidates)
+{
+    char** sorted = malloc(candidates->count * sizeof(*sorted));
+    if (sorted == NULL) {
+        printf("[Reader-Writer Error] Failed to allocate %zu candidate names\n", candidates->count);
+        return 1;
+    }
+
+    memcpy(sorted, candidates->paths, candidates->count * sizeof(*sorted));
+    qsort(sorted, candidates->count, sizeof(*sorted), compareBaseNames);
+
+    int exit_code = 0;
+    for (size_t i = 1; i < candidates->count; ++i) {
+        if (strcmp(baseName(sorted[i - 1]), baseName(sorted[i])) == 0) {
+            printf("[Reader-Writer Error] Candidates '%s' and '%s' would share result files\n", sorted[i - 1], sorted[i]);
+            exit_code = 1;
+        }
+    }
+
+    free(sorted);
+    return exit_code;
+}
+
+// Output files of a candidate, from passing it to data handler until they're published.
+typedef struct {
+    enum { CANDIDATE_SLOT_FREE, CANDIDATE_SLOT_PASSED, CANDIDATE_SLOT_WRITTEN } state;
+    uint32_t tag;
+    char paths[2][4096];
+    atomic_output_t outputs[2];
+} candidate_slot_t;
+
+// passCandidate: Opens a candidate and its output files and passes them to data handler with the given tag.
+static int passCandidate(int socket_fd, const char* candidate, const char* output_directory, uint32_t tag,
+    candidate_slot_t* slot)
+{
+    int fds[RENDEZVOUS_FD_COUNT];
+    clearDescriptors(fds);
+    int opened = 0;
+    int exit_code = 0;
+
+    // Workers map candidates, so only plain files can be passed as is.
+    if (!isDirectInput(candidate)) {
+        printf("[Reader Error] Candidate '%s' isn't an uncompressed regular file\n", candidate);
+        return 1;
+    }
+
+    if ((fds[RENDEZVOUS_INPUT_2] = open(candidate, O_RDONLY | O_CLOEXEC)) < 0) {
+        printf("[Reader Error] Failed to open file '%s': %s\n", candidate, strerror(errno));
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    for (; opened < 2; ++opened) {
+        if (snprintf(slot->paths[opened], sizeof(slot->paths[opened]), "%s/%s.%d", output_directory, baseName(candidate), opened + 1)
+            >= (int)sizeof(slot->paths[opened])) {
+            printf("[Writer Error] Output path for candidate '%s' is too long\n", candidate);
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        if (openAtomicOutput(&slot->outputs[opened], slot->paths[opened]) != 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        fds[RENDEZVOUS_OUTPUT_1 + opened] = slot->outputs[opened].fd;
+    }
+
+    exit_code = sendDescriptors(socket_fd, RENDEZVOUS_CANDIDATE, tag, fds);
+
+cleanup:
+    closeFile(&fds[RENDEZVOUS_INPUT_2]);
+
+    if (exit_code != 0) {
+        for (int i = 0; i < opened; ++i) {
+            discardAtomicOutput(&slot->outputs[i]);
+        }
+    } else {
+        slot->state = CANDIDATE_SLOT_PASSED;
+        slot->tag = tag;
+    }
+
+    return exit_code;
+}
+
+// publishCandidates: Publishes the outputs of every written candidate with a single group flush.
+static void publishCandidates(candidate_slot_t* slots, durability_t durability, size_t* failed)
+{
+    static atomic_output_t outputs[2 * MAX_CANDIDATES_IN_FLIGHT];
+    size_t count = 0;
+
+    for (size_t i = 0; i < MAX_CANDIDATES_IN_FLIGHT; ++i) {
+        if (slots[i].state == CANDIDATE_SLOT_WRITTEN) {
+            outputs[count++] = slots[i].outputs[0];
+            outputs[count++] = slots[i].outputs[1];
+            slots[i].state = CANDIDATE_SLOT_FREE;
+        }
+    }
+
+    if (count > 0 && publishAtomicOutputs(outputs, count, durability) != 0) {
+        printf("[Writer Error] Failed to publish results of a batch of %zu candidates\n", count / 2);
+        *failed += count / 2;
+    }
+}
+
+// receiveCandidateStatus: Waits for data handler to report on one more candidate and publishes its
+// outputs, or leaves them to publishCandidates for group durability.
+// Returns 1 only if data handler is gone, a failed candidate is counted in failed.
+static int receiveCandidateStatus(int socket_fd, const shard_list_t* candidates, candidate_slot_t* slots,
+    durability_t durability, size_t* failed)
+{
+    uint32_t tag = 0;
+    int handler_exit_code = 0;
+
+    if (receiveStatus(socket_fd, &tag, &handler_exit_code) != 0) {
+        return 1;
+    }
+
+    candidate_slot_t* slot = NULL;
+    for (size_t i = 0; i < MAX_CANDIDATES_IN_FLIGHT && slot == NULL; ++i) {
+        if (slots[i].state == CANDIDATE_SLOT_PASSED && slots[i].tag == tag) {
+            slot = &slots[i];
+        }
+    }
+
+    if (slot == NULL) {
+        printf("[Reader-Writer Error] Data handler reported on unknown candidate %u\n", tag);
+        return 1;
+    }
+
+    if (handler_exit_code != 0) {
+        printf("[Reader-Writer Error] Data handler failed on candidate '%s'\n",
+            tag < candidates->count ? candidates->paths[tag] : "?");
+        discardAtomicOutput(&slot->outputs[0]);
+        discardAtomicOutput(&slot->outputs[1]);
+        slot->state = CANDIDATE_SLOT_FREE;
+        ++*failed;
+        return 0;
+    }
+
+    if (durability == DURABILITY_GROUP) {
+        slot->state = CANDIDATE_SLOT_WRITTEN;
+        return 0;
+    }
+
+    if (publishAtomicOutputs(slot->outputs, 2, durability) != 0) {
+        ++*failed;
+    }
+
+    slot->state = CANDIDATE_SLOT_FREE;
+    return 0;
+}
+
+// freeCandidateSlot: Returns a slot for one more candidate, waiting for data handler to report
+// on a previous one or publishing a batch of written ones if all slots are taken.
+static candidate_slot_t* freeCandidateSlot(int socket_fd, const shard_list_t* candidates, candidate_slot_t* slots,
+    durability_t durability, size_t* in_flight, size_t* failed)
+{
+    for (;;) {
+        size_t written = 0;
+        for (size_t i = 0; i < MAX_CANDIDATES_IN_FLIGHT; ++i) {
+            if (slots[i].state == CANDIDATE_SLOT_FREE) {
+                return &slots[i];
+            }
+
+            written += slots[i].state == CANDIDATE_SLOT_WRITTEN;
+        }
+
+        // Written candidates are left to pile up, so that one flush covers many of them.
+        if (written >= CANDIDATE_PUBLISH_BATCH || *in_flight == 0) {
+            publishCandidates(slots, durability, failed);
+            continue;
+        }
+
+        if (receiveCandidateStatus(socket_fd, candidates, slots, durability, failed) != 0) {
+            return NULL;
+        }
+
+        --*in_flight;
+    }
+}
+
+// passCandidates: One-vs-many mode. Passes the reference input to data handler once, then
+// passes every candidate with its output files, keeping a bounded number of them in flight.
+// The reference goes through a pipe unless it's a plain file, like inputs in direct mode.
+// Results of a candidate are published once data handler reports on it, in batches for group durability.
+static int passCandidates(const char* socket_name, const char* reference, const char* candidates_spec,
+    const char* output_directory, int jobs, durability_t durability)
+{
+    shard_list_t candidates = { NULL, 0 };
+    int fds[RENDEZVOUS_FD_COUNT];
+    clearDescriptors(fds);
+    int feed_fd = -1;
+    int socket_fd = -1;
+    int exit_code = 0;
+    size_t in_flight = 0;
+    size_t failed = 0;
+
+    static candidate_slot_t slots[MAX_CANDIDATES_IN_FLIGHT];
+
+    if (expandShards(candidates_spec, &candidates) != 0 || checkCandidateNames(&candidates) != 0) {
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    if (isDirectInput(reference)) {
+        if ((fds[RENDEZVOUS_INPUT_1] = open(reference, O_RDONLY | O_CLOEXEC)) < 0) {
+            printf("[Reader Error] Failed to open file '%s': %s\n", reference, strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        fds[RENDEZVOUS_INDEX_1] = openIndex(reference);
+    } else {
+        int pipe_fds[2];
+        if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+            printf("[Reader-Writer Error] Failed to create pipe: %s\n", strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        fds[RENDEZVOUS_INPUT_1] = pipe_fds[0];
+        feed_fd = pipe_fds[1];
+    }
+
+    if ((socket_fd = connectRendezvous(socket_name)) < 0 || awaitAdmission(socket_fd) != 0
+        || sendDescriptors(socket_fd, RENDEZVOUS_REFERENCE, 0, fds) != 0) {
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    closeFile(&fds[RENDEZVOUS_INPUT_1]);
+    closeFile(&fds[RENDEZVOUS_INDEX_1]);
+
+    if (feed_fd != -1) {
+        exit_code = readInput(reference, feed_fd, jobs);
+        closeFile(&feed_fd);
+
+        if (waitDecoders() != 0 || exit_code != 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    printf("[Reader-Writer] Passed reference '%s' to data handler, passing %zu candidates\n",
+        reference, candidates.count);
+
+    for (size_t i = 0; i < candidates.count; ++i) {
+        candidate_slot_t* slot = freeCandidateSlot(socket_fd, &candidates, slots, durability, &in_flight, &failed);
+        if (slot == NULL) {
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        if (passCandidate(socket_fd, candidates.paths[i], output_directory, (uint32_t)i, slot) != 0) {
+            ++failed;
+            continue;
+        }
+
+        ++in_flight;
+    }
+
+    // Workers take this as the end of candidates.
+    shutdown(socket_fd, SHUT_WR);
+
+    for (; in_flight > 0; --in_flight) {
+        if (receiveCandidateStatus(socket_fd, &candidates, slots, durability, &failed) != 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    publishCandidates(slots, durability, &failed);
+
+    printf("[Writer] Data handler wrote results of %zu candidates to '%s', %zu failed\n",
+        candidates.count - failed, output_directory, failed);
+    exit_code = failed != 0;
+
+cleanup:
+    // Outputs of candidates data handler never reported on are left unpublished.
+    for (size_t i = 0; i < MAX_CANDIDATES_IN_FLIGHT; ++i) {
+        if (slots[i].state != CANDIDATE_SLOT_FREE) {
+            discardAtomicOutput(&slots[i].outputs[0]);
+            discardAtomicOutput(&slots[i].outputs[1]);
+            slots[i].state = CANDIDATE_SLOT_FREE;
+        }
+    }
+
+    closeFile(&fds[RENDEZVOUS_INPUT_1]);
+    closeFile(&fds[RENDEZVOUS_INDEX_1]);
+    closeFile(&feed_fd);
+    closeFile(&socket_fd);
+    freeShards(&candidates);
+
+    return exit_code;
+}
+
+// Set by SIGINT and SIGTERM in follow mode: inputs are closed and the last results are awaited.
+static volatile sig_atomic_t follow_stopping = 0;
+
+static void stopFollowing(int signal_number)
+{
+    (void)signal_number;
+    follow_stopping = 1;
+}
+
+// feedAppended: Passes everything appended to a followed input file since the last call into fd.
+// Fails if the file shrank: data handler can't forget bytes it has already seen.
+static int feedAppended(const char* file_path, int input_fd, int fd, uint64_t* offset)
+{
+    struct stat input_stat;
+    if (fstat(input_fd, &input_stat) == 0 && (uint64_t)input_stat.st_size < *offset) {
+        printf("[Reader Error] File '%s' was truncated, follow mode needs append-only files\n", file_path);
+        return 1;
+    }
+
+    static char buffer[BUFFER_SIZE];
+    ssize_t read_bytes = 0;
+    uint64_t passed_bytes = 0;
+
+    // Same cyclic reading as readString, reads simply return 0 at the current end of the file.
+    while ((read_bytes = pread(input_fd, buffer, BUFFER_SIZE, (off_t)*offset)) != 0) {
+        if (read_bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Reader Error] Failed to read another chunk of file '%s': %s\n", file_path, strerror(errno));
+            return 1;
+        }
+
+        // A stop signal may interrupt a blocked write, the chunk is still passed whole.
+        for (ssize_t written = 0, result = 0; written < read_bytes; written += result) {
+            if ((result = write(fd, buffer + written, read_bytes - written)) < 0) {
+                if (errno == EINTR) {
+                    result = 0;
+                    continue;
+                }
+
+                printf("[Reader Error] Failed to write another chunk of file '%s' to pipe: '%s'\n", file_path, strerror(errno));
+                return 1;
+            }
+        }
+
+        *offset += (uint64_t)read_bytes;
+        passed_bytes += (uint64_t)read_bytes;
+    }
+
+    if (passed_bytes != 0) {
+        printf("[Reader] Passed %llu more bytes of file '%s' to fd %d\n",
+            (unsigned long long)passed_bytes, file_path, fd);
+    }
+
+    return 0;
+}
+
+// receiveFrame: Reads a frame of result 1 or 2 from an output pipe and publishes it into file_path.
+// Sets *closed when data handler closes the pipe.
+static int receiveFrame(const char* file_path, int result, int fd, durability_t durability, bool* closed)
+{
+    follow_frame_header_t header;
+    static char data[BUFFER_SIZE];
+
+    ssize_t read_bytes = 0;
+    while ((read_bytes = read(fd, &header, sizeof(header))) < 0 && errno == EINTR) {
+    }
+
+    if (read_bytes == 0) {
+        *closed = true;
+        return 0;
+    }
+
+    // Frames are written atomically, so a started frame is already in the pipe as a whole.
+    if (read_bytes != sizeof(header) || header.length > sizeof(data)
+        || (header.length > 0 && read(fd, data, header.length) != (ssize_t)header.length)) {
+        printf("[Writer Error] Broken result frame for '%s'\n", file_path);
+        return 1;
+    }
+
+    // Readers of a file see either the previous or the new result, streams get every result in turn.
+    struct iovec vector = { data, header.length };
+    int exit_code = 0;
+    if (isStandardStream(file_path)) {
+        exit_code = (header.length > 0 && writeFrame(result, data, header.length) != 0) || writeFrame(result, NULL, 0) != 0;
+    } else if (isStreamOutput(file_path)) {
+        int output_fd = open(file_path, O_WRONLY | O_CLOEXEC);
+        if (output_fd < 0) {
+            printf("[Writer Error] Failed to open stream '%s': %s\n", file_path, strerror(errno));
+        }
+
+        exit_code = output_fd < 0 || writeVector(output_fd, &vector, 1) != 0;
+        closeFile(&output_fd);
+    } else {
+        exit_code = writeAtomicFile(file_path, &vector, 1, durability);
+    }
+
+    if (exit_code != 0) {
+        return 1;
+    }
+
+    printf("[Writer] Updated file '%s' with a result of length %u\n", file_path, header.length);
+    return 0;
+}
+
+// followFiles: Follow mode. Passes the input files to data handler and then keeps passing
+// whatever is appended to them, waking up on inotify events. Every change of the results
+// replaces the output files. Runs until SIGINT or SIGTERM, then closes the inputs and
+// publishes the final results.
+static int followFiles(const char* socket_name, char** files, durability_t durability)
+{
+    int file_fds[2] = { -1, -1 };
+    int fds[RENDEZVOUS_FD_COUNT];
+    clearDescriptors(fds);
+    int inotify_fd = -1;
+    int exit_code = 0;
+    uint64_t offsets[2] = { 0, 0 };
+
+    for (int i = 0; i < 2; ++i) {
+        struct stat input_stat;
+        if ((file_fds[i] = open(files[i], O_RDONLY | O_CLOEXEC)) < 0
+            || fstat(file_fds[i], &input_stat) != 0 || !S_ISREG(input_stat.st_mode)) {
+            printf("[Reader Error] Follow mode needs regular input files, can't follow '%s'\n", files[i]);
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    if ((inotify_fd = inotify_init1(IN_CLOEXEC)) < 0) {
+        printf("[Reader-Writer Error] Failed to initialize inotify: %s\n", strerror(errno));
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        if (inotify_add_watch(inotify_fd, files[i], IN_MODIFY) < 0) {
+            printf("[Reader-Writer Error] Failed to watch file '%s': %s\n", files[i], strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    if (connectPipes(socket_name, RENDEZVOUS_FOLLOW, fds) != 0) {
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopFollowing;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Watches are set before the first pass, so no append is missed in between.
+    for (int i = 0; i < 2 && exit_code == 0; ++i) {
+        exit_code = feedAppended(files[i], file_fds[i], fds[RENDEZVOUS_INPUT_1 + i], &offsets[i]);
+    }
+
+    printf("[Reader-Writer] Following files '%s' and '%s', stop with SIGINT or SIGTERM\n", files[0], files[1]);
+
+    // Results change at most once per newly seen byte value, so output pipes never fill up
+    // and blocking writes into the input pipes can't deadlock with data handler.
+    bool closed[2] = { false, false };
+    while (exit_code == 0 && !(closed[0] && closed[1])) {
+        if (follow_stopping && fds[RENDEZVOUS_INPUT_1] != -1) {
+            printf("[Reader-Writer] Stopping, waiting for the final results\n");
+            closeFile(&fds[RENDEZVOUS_INPUT_1]);
+            closeFile(&fds[RENDEZVOUS_INPUT_2]);
+        }
+
+        struct pollfd poll_fds[3] = {
+            { fds[RENDEZVOUS_INPUT_1] != -1 ? inotify_fd : -1, POLLIN, 0 },
+            { closed[0] ? -1 : fds[RENDEZVOUS_OUTPUT_1], POLLIN, 0 },
+            { closed[1] ? -1 : fds[RENDEZVOUS_OUTPUT_2], POLLIN, 0 }
+        };
+
+        if (poll(poll_fds, 3, -1) < 0) {
+            if (errno != EINTR) {
+                printf("[Reader-Writer Error] Failed to wait for events: %s\n", strerror(errno));
+                exit_code = 1;
+            }
+            continue;
+        }
+
+        if (poll_fds[0].revents & POLLIN) {
+            // Events only say that something changed, the offsets tell what's new.
+            char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            while (read(inotify_fd, events, sizeof(events)) < 0 && errno == EINTR) {
+            }
+
+            for (int i = 0; i < 2 && exit_code == 0; ++i) {
+                exit_code = feedAppended(files[i], file_fds[i], fds[RENDEZVOUS_INPUT_1 + i], &offsets[i]);
+            }
+        }
+
+        for (int i = 0; i < 2 && exit_code == 0; ++i) {
+            if (poll_fds[1 + i].revents & (POLLIN | POLLHUP)) {
+                exit_code = receiveFrame(files[2 + i], i + 1, fds[RENDEZVOUS_OUTPUT_1 + i], durability, &closed[i]);
+            }
+        }
+    }
+
+cleanup:
+    for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+        closeFile(&fds[i]);
+    }
+
+    closeFile(&file_fds[0]);
+    closeFile(&file_fds[1]);
+    closeFile(&inotify_fd);
+
+    return exit_code;
+}
+
+// After the sample, results count as settled once the input pipes are empty and no frame came for this long.
+#define SAMPLE_SETTLE_MS 20
+
+// passBlock: Passes block of a sampled input file into fd, counting its bytes into sample if it's not NULL.
+static int passBlock(const char* file_path, int input_fd, uint64_t block, int fd, sample_t* sample)
+{
+    static char buffer[SAMPLE_BLOCK_SIZE];
+    size_t length = 0;
+
+    // Same cyclic reading as readString, a block ends early only at the end of the file.
+    while (length < SAMPLE_BLOCK_SIZE) {
+        const ssize_t read_bytes = pread(input_fd, buffer + length, SAMPLE_BLOCK_SIZE - length,
+            (off_t)(block * SAMPLE_BLOCK_SIZE + length));
+        if (read_bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Reader Error] Failed to read block %llu of file '%s': %s\n",
+                (unsigned long long)block, file_path, strerror(errno));
+            return 1;
+        }
+
+        if (read_bytes == 0) {
+            break;
+        }
+
+        length += (size_t)read_bytes;
+    }
+
+    if (sample != NULL) {
+        sampleAccount(sample, buffer, length);
+    }
+
+    for (size_t written = 0; written < length;) {
+        const ssize_t result = write(fd, buffer + written, length - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Reader Error] Failed to write block %llu of file '%s' to pipe: '%s'\n",
+                (unsigned long long)block, file_path, strerror(errno));
+            return 1;
+        }
+
+        written += (size_t)result;
+    }
+
+    return 0;
+}
+
+// receiveFrames: Publishes the result frames that come within timeout_ms (-1 waits for the first one).
+// Returns the number of frames, -1 on failure.
+static int receiveFrames(char** output_files, const int fds[RENDEZVOUS_FD_COUNT], durability_t durability,
+    bool closed[2], int timeout_ms)
+{
+    struct pollfd poll_fds[2] = {
+        { closed[0] ? -1 : fds[RENDEZVOUS_OUTPUT_1], POLLIN, 0 },
+        { closed[1] ? -1 : fds[RENDEZVOUS_OUTPUT_2], POLLIN, 0 }
+    };
+
+    int ready = 0;
+    while ((ready = poll(poll_fds, 2, timeout_ms)) < 0 && errno == EINTR) {
+    }
+
+    if (ready < 0) {
+        printf("[Reader-Writer Error] Failed to wait for results: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int frames = 0;
+    for (int i = 0; i < 2; ++i) {
+        if (poll_fds[i].revents & (POLLIN | POLLHUP)) {
+            if (receiveFrame(output_files[i], i + 1, fds[RENDEZVOUS_OUTPUT_1 + i], durability, &closed[i]) != 0) {
+                return -1;
+            }
+            frames += !closed[i];
+        }
+    }
+
+    return frames;
+}
+
+// passSampleBlocks: Passes the chosen blocks of both inputs (counting them into their samples) or
+// the other ones, in turn and in file order, which is faster to read. Frames are taken between blocks,
+// so output pipes never fill up while an input pipe is written. Returns the number of frames, -1 on failure.
+static int passSampleBlocks(char** files, const int file_fds[2], const int fds[RENDEZVOUS_FD_COUNT],
+    sample_t samples[2], bool chosen, durability_t durability, bool closed[2])
+{
+    int frames = 0;
+    const uint64_t block_count = samples[0].block_count > samples[1].block_count
+        ? samples[0].block_count
+        : samples[1].block_count;
+
+    for (uint64_t block = 0; block < block_count; ++block) {
+        for (int i = 0; i < 2; ++i) {
+            if (block >= samples[i].block_count || sampleChosen(&samples[i], block) != chosen) {
+                continue;
+            }
+
+            sample_t* sample = chosen ? &samples[i] : NULL;
+            const int received = passBlock(files[i], file_fds[i], block, fds[RENDEZVOUS_INPUT_1 + i], sample) != 0
+                ? -1
+                : receiveFrames(files + 2, fds, durability, closed, 0);
+            if (received < 0) {
+                return -1;
+            }
+
+            frames += received;
+        }
+    }
+
+    return frames;
+}
+
+// pipeEmpty: Whether data handler has read everything passed into the pipe so far.
+static bool pipeEmpty(int fd)
+{
+    int pending = 0;
+    return ioctl(fd, FIONREAD, &pending) == 0 && pending == 0;
+}
+
+static long elapsedMs(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+// reportSample: Logs how much of the inputs the provisional results come from and how much to trust them.
+// Bytes of result 1 stop being unique to input 1 only if the blocks of input 2 not read yet have them,
+// so its confidence is the chance that a further block of input 2 holds no byte value unseen so far.
+static void reportSample(char** files, const sample_t samples[2], long elapsed_ms)
+{
+    printf("[Sampler] Provisional results after %ld ms from %llu/%llu blocks of '%s' and %llu/%llu blocks of '%s'\n",
+        elapsed_ms, (unsigned long long)samples[0].sampled, (unsigned long long)samples[0].block_count, files[0],
+        (unsigned long long)samples[1].sampled, (unsigned long long)samples[1].block_count, files[1]);
+
+    presence_t seen[2];
+    sampleSeen(&samples[0], &seen[0]);
+    sampleSeen(&samples[1], &seen[1]);
+
+    for (int i = 0; i < 2; ++i) {
+        char result[128];
+        const size_t length = presenceDifference(&seen[i], &seen[1 - i], result);
+        printf("[Sampler] Result %d: %zu bytes unique to '%s' so far, confidence %.3f (new bytes expected in %.1f%% "
+               "of the unread blocks of '%s')\n",
+            i + 1, length, files[i], 1 - sampleUnseenMass(&samples[1 - i]), 100 * sampleUnseenMass(&samples[1 - i]),
+            files[1 - i]);
+    }
+}
+
+// sampleFiles: Sampling mode. Passes random blocks of both input files to data handler in follow mode
+// and publishes the provisional results it sends back, logging their confidence. Then passes the other
+// blocks, publishing every correction as it comes, and closes the inputs for the exact results.
+static int sampleFiles(const char* socket_name, char** files, uint64_t sample_blocks, durability_t durability)
+{
+    int file_fds[2] = { -1, -1 };
+    sample_t samples[2];
+    memset(samples, 0, sizeof(samples));
+    int fds[RENDEZVOUS_FD_COUNT];
+    clearDescriptors(fds);
+    int exit_code = 0;
+    bool closed[2] = { false, false };
+    char** output_files = files + 2;
+    int corrections = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const uint64_t seed = (uint64_t)start.tv_nsec ^ ((uint64_t)getpid() << 32);
+
+    for (int i = 0; i < 2; ++i) {
+        struct stat input_stat;
+        if ((file_fds[i] = open(files[i], O_RDONLY | O_CLOEXEC)) < 0
+            || fstat(file_fds[i], &input_stat) != 0 || !S_ISREG(input_stat.st_mode)) {
+            printf("[Reader Error] Sampling needs regular input files, can't sample '%s'\n", files[i]);
+            exit_code = 1;
+            goto cleanup;
+        }
+
+        if (sampleInit(&samples[i], (uint64_t)input_stat.st_size, sample_blocks, seed + (uint64_t)i) != 0) {
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    if (connectPipes(socket_name, RENDEZVOUS_FOLLOW, fds) != 0) {
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    exit_code = passSampleBlocks(files, file_fds, fds, samples, true, durability, closed) < 0;
+
+    // Data handler sends results once it has read everything there is, so the sample is settled
+    // when the pipes are empty and it has nothing more to say.
+    for (int frames = 1; exit_code == 0 && frames != 0;) {
+        frames = receiveFrames(output_files, fds, durability, closed, SAMPLE_SETTLE_MS);
+        if (closed[0] && closed[1]) {
+            printf("[Reader-Writer Error] Data handler closed the results before the inputs were passed\n");
+            frames = -1;
+        } else if (frames == 0 && !(pipeEmpty(fds[RENDEZVOUS_INPUT_1]) && pipeEmpty(fds[RENDEZVOUS_INPUT_2]))) {
+            frames = 1;
+        }
+        exit_code = frames < 0;
+    }
+
+    if (exit_code != 0) {
+        goto cleanup;
+    }
+
+    reportSample(files, samples, elapsedMs(&start));
+
+    // Refining: the other blocks, which give the exact results.
+    corrections = passSampleBlocks(files, file_fds, fds, samples, false, durability, closed);
+    exit_code = corrections < 0;
+
+    closeFile(&fds[RENDEZVOUS_INPUT_1]);
+    closeFile(&fds[RENDEZVOUS_INPUT_2]);
+
+    while (exit_code == 0 && !(closed[0] && closed[1])) {
+        const int frames = receiveFrames(output_files, fds, durability, closed, -1);
+        exit_code = frames < 0;
+        corrections += frames > 0 ? frames : 0;
+    }
+
+    if (exit_code == 0) {
+        printf("[Sampler] Exact results after %ld ms, %d corrections of the provisional ones\n",
+            elapsedMs(&start), corrections);
+    }
+
+cleanup:
+    for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+        closeFile(&fds[i]);
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        closeFile(&file_fds[i]);
+        sampleFree(&samples[i]);
+    }
+
+    return exit_code;
+}
+
+int main(int argc, char** argv)
+{
+    reader_writer_options_t options;
+    if (parseOptions(argc, argv, &options) != 0) {
+        return 1;
+    }
+
+    const int jobs = options.jobs;
+
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (options.candidates != NULL) {
+        checkArgumentCount(argc < 2, "<reference>");
+        checkArgumentCount(argc < 3, "<output_directory>");
+
+        if (applyPlacement(&options.placement, -1, "Reader-writer") != 0) {
+            return 1;
+        }
+
+        const int exit_code = passCandidates(options.socket_name, argv[1], options.candidates, argv[2], jobs, options.durability);
+        if (exit_code == 0) {
+            printf("[Reader-Writer] Done!\n");
+        }
+
+        return exit_code;
+    }
+
+    checkArgumentCount(argc < 2, "<input_1>");
+    checkArgumentCount(argc < 3, "<input_2>");
+    checkArgumentCount(argc < 4, "<output_file_1>");
+    checkArgumentCount(argc < 5, "<output_file_2>");
+
+    if (isStandardStream(argv[1]) && isStandardStream(argv[2])) {
+        printf("[Reader-Writer Error] Only one input can be standard input\n");
+        return 1;
+    }
+
+    if (options.direct && (isStreamOutput(argv[3]) || isStreamOutput(argv[4]))) {
+        printf("[Reader-Writer Error] Data handler writes outputs itself with --direct, they must be regular files\n");
+        return 1;
+    }
+
+    // Results go to standard output, so logs go to standard error.
+    if (isStandardStream(argv[3]) || isStandardStream(argv[4])) {
+        fflush(stdout);
+        standard_output_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    // Decoders and shard readers inherit the placement. Data handler finds the CPUs
+    // of reader-writer over the socket and takes cores sharing their cache.
+    if (applyPlacement(&options.placement, -1, "Reader-writer") != 0) {
+        return 1;
+    }
+
+    int input_fd_1 = -1;
+    int input_fd_2 = -1;
+    int output_fd_1 = -1;
+    int output_fd_2 = -1;
+    int exit_code = 0;
+
+    session_t session;
+    useCurrentDirectory(&session);
+
+    if (options.follow) {
+        exit_code = followFiles(options.socket_name, argv + 1, options.durability);
+        if (exit_code == 0) {
+            printf("[Reader-Writer] Done!\n");
+        }
+
+        return exit_code;
+    }
+
+    if (options.sample_blocks != 0) {
+        exit_code = sampleFiles(options.socket_name, argv + 1, options.sample_blocks, options.durability);
+        if (exit_code == 0) {
+            printf("[Reader-Writer] Done!\n");
+        }
+
+        return exit_code;
+    }
+
+    if (options.direct) {
+        exit_code = passFilesDirectly(options.socket_name, argv + 1, jobs, options.incremental, options.durability);
+        if (exit_code == 0) {
+            printf("[Reader-Writer] Done!\n");
+        }
+
+        return exit_code;
+    }
+
+    if (options.socket_name != NULL) {
+        int fds[RENDEZVOUS_FD_COUNT];
+        if (connectPipes(options.socket_name, RENDEZVOUS_PIPES, fds) != 0) {
+            return 1;
+        }
+
+        input_fd_1 = fds[RENDEZVOUS_INPUT_1];
+        input_fd_2 = fds[RENDEZVOUS_INPUT_2];
+        output_fd_1 = fds[RENDEZVOUS_OUTPUT_1];
+        output_fd_2 = fds[RENDEZVOUS_OUTPUT_2];
+    } else if ((options.use_session ? createSession(options.session_name, &session) : createFifos(&session)) != 0) {
+        return 1;
+    } else if (openInputFifos(&session, &input_fd_1, &input_fd_2) != 0) {
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    const char* input_file_1 = argv[1];
+    const char* input_file_2 = argv[2];
+
+    // Each pipe is closed right after passing its string: data handler
+    // reads the strings one after another until the end of each pipe.
+    exit_code = readInput(input_file_1, input_fd_1, jobs);
+    closeFile(&input_fd_1);
+
+    if (exit_code == 0) {
+        exit_code = readInput(input_file_2, input_fd_2, jobs);
+    }
+
+    closeFile(&input_fd_2);
+
+    // Decoders finish before the data handler gets to the results, since it
+    // consumes both strings up to the end before producing any output.
+    if (waitDecoders() != 0) {
+        exit_code = 1;
+    }
+
+    if (exit_code != 0) {
+        printf("[Reader-Writer Error] Failed to read strings, exiting...\n");
+        goto cleanup;
+    }
+
+    if (output_fd_1 == -1 && openOutputFifos(&session, &output_fd_1, &output_fd_2) != 0) {
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    char** output_files = argv + 3;
+    const int output_fds[2] = { output_fd_1, output_fd_2 };
+
+    // Results going into files are published together once both are complete,
+    // results going into streams are passed on as they come.
+    atomic_output_t outputs[2];
+    size_t output_count = 0;
+
+    for (int i = 0; i < 2 && exit_code == 0; ++i) {
+        if (isStreamOutput(output_files[i])) {
+            exit_code = streamString(output_files[i], i + 1, output_fds[i]);
+        } else if (writeString(output_files[i], output_fds[i], &outputs[output_count]) == 0) {
+            ++output_count;
+        } else {
+            exit_code = 1;
+        }
+    }
+
+    if (exit_code == 0) {
+        exit_code = publishAtomicOutputs(outputs, output_count, options.durability);
+    } else {
+        for (size_t i = 0; i < output_count; ++i) {
+            discardAtomicOutput(&outputs[i]);
+        }
+    }
+
+    if (exit_code != 0) {
+        printf("[Reader-Writer Error] Failed to write strings, exiting...\n");
+        goto cleanup;
+    }
+
+cleanup:
+    closeFile(&input_fd_1);
+    closeFile(&input_fd_2);
+    closeFile(&output_fd_1);
+    closeFile(&output_fd_2);
+
+    removeSession(&session);
 
     if (exit_code == 0) {
         printf("[Reader-Writer] Done!\n");
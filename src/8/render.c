@@ -0,0 +1,132 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "result-format.h"
+
+// Result renderer: reads results written by mark8-h --format=bitmap and renders them as text,
+// prints their counts or tests them for bytes, so that bulk jobs only pay for rendering
+// the results somebody actually looks at. Rendered text is exactly what --format=text writes.
+// Results go to stdout, so errors go to stderr here.
+
+typedef enum {
+    RENDER_TEXT,
+    RENDER_COUNT,
+    RENDER_CONTAINS
+} render_mode_t;
+
+static void printUsage(void)
+{
+    printf("Usage: ./mark8-render [--count | --contains=<bytes>] <result_file>...\n"
+           "Renders bitmap results as text, '-' reads standard input.\n"
+           "--count prints the number of bytes of each result, one per line.\n"
+           "--contains exits with 0 if every result has all the bytes, 1 if not and 2 on errors.\n");
+}
+
+// Reads a bitmap result file. Returns 0 on success.
+static int readResult(const char* path, presence_t* result)
+{
+    const bool standard_input = strcmp(path, "-") == 0;
+    const int fd = standard_input ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[Render Error] Failed to open result '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    // One byte more than a bitmap to tell a longer file from one.
+    char data[RESULT_BITMAP_LENGTH + 1];
+    size_t length = 0;
+    ssize_t bytes_read = 0;
+    while (length < sizeof(data) && (bytes_read = read(fd, data + length, sizeof(data) - length)) != 0) {
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        length += (size_t)bytes_read;
+    }
+
+    if (!standard_input) {
+        close(fd);
+    }
+
+    if (bytes_read < 0) {
+        fprintf(stderr, "[Render Error] Failed to read result '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if (parseBitmapResult(data, length, result) != 0) {
+        fprintf(stderr, "[Render Error] '%s' isn't a bitmap result\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option long_options[] = {
+        { "count", no_argument, NULL, 'c' },
+        { "contains", required_argument, NULL, 't' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    render_mode_t mode = RENDER_TEXT;
+    const char* wanted = NULL;
+
+    int option = 0;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+        case 'c':
+            mode = RENDER_COUNT;
+            break;
+        case 't':
+            mode = RENDER_CONTAINS;
+            wanted = optarg;
+            break;
+        default:
+            printUsage();
+            return 2;
+        }
+    }
+
+    if (optind == argc) {
+        printUsage();
+        return 2;
+    }
+
+    int exit_code = 0;
+    for (int i = optind; i < argc; ++i) {
+        presence_t result;
+        if (readResult(argv[i], &result) != 0) {
+            return 2;
+        }
+
+        if (mode == RENDER_CONTAINS) {
+            for (const char* byte = wanted; *byte != '\0'; ++byte) {
+                if (!presenceContains(&result, (unsigned char)*byte)) {
+                    exit_code = 1;
+                }
+            }
+            continue;
+        }
+
+        presence_t empty;
+        presenceClear(&empty);
+
+        char text[RESULT_MAX_LENGTH];
+        const size_t length = formatResult(&result, &empty, mode == RENDER_COUNT ? RESULT_COUNT : RESULT_TEXT, text);
+        if (fwrite(text, 1, length, stdout) != length) {
+            fprintf(stderr, "[Render Error] Failed to write the rendered result\n");
+            return 2;
+        }
+    }
+
+    return exit_code;
+}
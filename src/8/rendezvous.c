@@ -0,0 +1,367 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rendezvous.h"
+
+// Fills an abstract socket address: a leading zero byte followed by the name.
+static int makeAddress(const char* name, struct sockaddr_un* address, socklen_t* length)
+{
+    const size_t name_length = strlen(name);
+    if (name_length == 0 || name_length + 1 > sizeof(address->sun_path)) {
+        printf("[Rendezvous Error] Invalid socket name '%s'\n", name);
+        return 1;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path + 1, name, name_length);
+    *length = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + name_length);
+    return 0;
+}
+
+int listenRendezvous(const char* name, int backlog)
+{
+    struct sockaddr_un address;
+    socklen_t address_length = 0;
+    if (makeAddress(name, &address, &address_length) != 0) {
+        return -1;
+    }
+
+    // Sequenced packets keep message boundaries, so every receive takes exactly one message.
+    const int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        printf("[Rendezvous Error] Failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (bind(listen_fd, (struct sockaddr*)&address, address_length) != 0) {
+        printf("[Rendezvous Error] Failed to bind socket '@%s': %s\n", name,
+            errno == EADDRINUSE ? "somebody else listens on it" : strerror(errno));
+        close(listen_fd);
+        return -1;
+    }
+
+    if (listen(listen_fd, backlog) < 0) {
+        printf("[Rendezvous Error] Failed to listen on socket '@%s': %s\n", name, strerror(errno));
+        close(listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+int acceptRendezvous(const char* name)
+{
+    const int listen_fd = listenRendezvous(name, 1);
+    if (listen_fd < 0) {
+        return -1;
+    }
+
+    struct pollfd poll_fd = { listen_fd, POLLIN, 0 };
+    int ready = 0;
+    while ((ready = poll(&poll_fd, 1, RENDEZVOUS_TIMEOUT_MS)) < 0 && errno == EINTR) {
+    }
+
+    int socket_fd = -1;
+    if (ready == 0) {
+        printf("[Rendezvous Error] Nobody came to socket '@%s'\n", name);
+    } else {
+        while ((socket_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) < 0 && errno == EINTR) {
+        }
+
+        if (socket_fd < 0) {
+            printf("[Rendezvous Error] Failed to accept connection: %s\n", strerror(errno));
+        }
+    }
+
+    // The name is free again as soon as the single connection is taken.
+    close(listen_fd);
+    return socket_fd;
+}
+
+int connectRendezvous(const char* name)
+{
+    struct sockaddr_un address;
+    socklen_t address_length = 0;
+    if (makeAddress(name, &address, &address_length) != 0) {
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    long pause_us = RENDEZVOUS_RETRY_FIRST_US;
+    for (;;) {
+        const int socket_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (socket_fd < 0) {
+            printf("[Rendezvous Error] Failed to create socket: %s\n", strerror(errno));
+            return -1;
+        }
+
+        if (connect(socket_fd, (struct sockaddr*)&address, address_length) == 0) {
+            return socket_fd;
+        }
+
+        const int error = errno;
+        close(socket_fd);
+
+        // Refused means nobody listens yet (or the name is bound and about to listen).
+        if (error != ECONNREFUSED && error != EINTR && error != EAGAIN) {
+            printf("[Rendezvous Error] Failed to connect to socket '@%s': %s\n", name, strerror(error));
+            return -1;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        const long elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (elapsed_ms >= RENDEZVOUS_TIMEOUT_MS) {
+            printf("[Rendezvous Error] No data handler listens on socket '@%s'\n", name);
+            return -1;
+        }
+
+        const struct timespec pause = { 0, pause_us * 1000 };
+        nanosleep(&pause, NULL);
+
+        if (elapsed_ms >= RENDEZVOUS_RETRY_FAST_MS) {
+            pause_us = pause_us * 2 < RENDEZVOUS_RETRY_LAST_US ? pause_us * 2 : RENDEZVOUS_RETRY_LAST_US;
+        }
+    }
+}
+
+// Message header, the descriptors travel in its control data.
+typedef struct {
+    uint32_t kind;
+    uint32_t tag;
+
+    // Bit mask of the slots whose descriptors are passed, in slot order.
+    uint32_t slots;
+} rendezvous_header_t;
+
+typedef struct {
+    uint32_t tag;
+    int32_t exit_code;
+} rendezvous_status_t;
+
+#define SLOT(slot) (1U << (slot))
+
+// Bit mask of the slots a message of this kind must pass.
+static unsigned requiredSlots(uint32_t kind)
+{
+    switch (kind) {
+    case RENDEZVOUS_PIPES:
+    case RENDEZVOUS_FOLLOW:
+    case RENDEZVOUS_FILES:
+        return SLOT(RENDEZVOUS_INPUT_1) | SLOT(RENDEZVOUS_INPUT_2) | SLOT(RENDEZVOUS_OUTPUT_1) | SLOT(RENDEZVOUS_OUTPUT_2);
+    case RENDEZVOUS_REFERENCE:
+    case RENDEZVOUS_CONNECTION:
+        return SLOT(RENDEZVOUS_INPUT_1);
+    case RENDEZVOUS_CANDIDATE:
+        return SLOT(RENDEZVOUS_INPUT_2) | SLOT(RENDEZVOUS_OUTPUT_1) | SLOT(RENDEZVOUS_OUTPUT_2);
+    default:
+        return 0;
+    }
+}
+
+// Bit mask of the slots a message of this kind may pass: indexes and states come only with files.
+static unsigned allowedSlots(uint32_t kind)
+{
+    switch (kind) {
+    case RENDEZVOUS_FILES:
+        return requiredSlots(kind) | SLOT(RENDEZVOUS_INDEX_1) | SLOT(RENDEZVOUS_INDEX_2)
+            | SLOT(RENDEZVOUS_STATE_IN) | SLOT(RENDEZVOUS_STATE_OUT);
+    case RENDEZVOUS_REFERENCE:
+        return requiredSlots(kind) | SLOT(RENDEZVOUS_INDEX_1);
+    default:
+        return requiredSlots(kind);
+    }
+}
+
+void clearDescriptors(int fds[RENDEZVOUS_FD_COUNT])
+{
+    for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+        fds[i] = -1;
+    }
+}
+
+int sendDescriptors(int socket_fd, rendezvous_kind_t kind, uint32_t tag, const int fds[RENDEZVOUS_FD_COUNT])
+{
+    rendezvous_header_t header_data = { (uint32_t)kind, tag, 0 };
+    struct iovec data = { &header_data, sizeof(header_data) };
+
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int) * RENDEZVOUS_FD_COUNT)];
+    } control;
+
+    memset(&control, 0, sizeof(control));
+
+    int passed_fds[RENDEZVOUS_FD_COUNT];
+    size_t passed_count = 0;
+    for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+        if (fds[i] != -1) {
+            header_data.slots |= SLOT(i);
+            passed_fds[passed_count++] = fds[i];
+        }
+    }
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * passed_count);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * passed_count);
+    memcpy(CMSG_DATA(header), passed_fds, sizeof(int) * passed_count);
+
+    ssize_t sent = 0;
+    while ((sent = sendmsg(socket_fd, &message, MSG_NOSIGNAL)) < 0 && errno == EINTR) {
+    }
+
+    if (sent < 0) {
+        printf("[Rendezvous Error] Failed to send descriptors: %s\n", strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+// Closes the descriptors passed with a message that is rejected, so none of them leak.
+static void closeReceivedDescriptors(struct msghdr* message)
+{
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(message); header != NULL; header = CMSG_NXTHDR(message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+
+        const size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int fd = -1;
+            memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+            close(fd);
+        }
+    }
+}
+
+int receiveDescriptors(int socket_fd, rendezvous_kind_t* kind, uint32_t* tag, int fds[RENDEZVOUS_FD_COUNT])
+{
+    rendezvous_header_t header_data;
+    struct iovec data = { &header_data, sizeof(header_data) };
+
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int) * RENDEZVOUS_FD_COUNT)];
+    } control;
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    ssize_t received = 0;
+    while ((received = recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+    }
+
+    if (received == 0) {
+        *kind = RENDEZVOUS_END;
+        return 0;
+    }
+
+    if (received < 0) {
+        printf("[Rendezvous Error] Failed to receive descriptors: %s\n", strerror(errno));
+        return 1;
+    }
+
+    const bool valid_slots = received == sizeof(header_data) && requiredSlots(header_data.kind) != 0
+        && (header_data.slots & requiredSlots(header_data.kind)) == requiredSlots(header_data.kind)
+        && (header_data.slots & ~allowedSlots(header_data.kind)) == 0;
+    const unsigned slots = valid_slots ? header_data.slots : 0;
+    const size_t passed_count = (size_t)__builtin_popcount(slots);
+    const struct cmsghdr* header = slots != 0 ? CMSG_FIRSTHDR(&message) : NULL;
+
+    if ((message.msg_flags & MSG_CTRUNC) || header == NULL || header->cmsg_level != SOL_SOCKET
+        || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(int) * passed_count)) {
+        printf("[Rendezvous Error] Failed to receive descriptors: %s\n",
+            (message.msg_flags & MSG_CTRUNC) ? "too many descriptors" : "unexpected message");
+        closeReceivedDescriptors(&message);
+        return 1;
+    }
+
+    int passed_fds[RENDEZVOUS_FD_COUNT];
+    memcpy(passed_fds, CMSG_DATA(header), sizeof(int) * passed_count);
+
+    size_t passed_index = 0;
+    for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+        fds[i] = slots & (1U << i) ? passed_fds[passed_index++] : -1;
+    }
+
+    *kind = (rendezvous_kind_t)header_data.kind;
+    *tag = header_data.tag;
+    return 0;
+}
+
+int sendStatus(int socket_fd, uint32_t tag, int exit_code)
+{
+    const rendezvous_status_t status = { tag, exit_code };
+
+    ssize_t sent = 0;
+    while ((sent = send(socket_fd, &status, sizeof(status), MSG_NOSIGNAL)) < 0 && errno == EINTR) {
+    }
+
+    if (sent != sizeof(status)) {
+        printf("[Rendezvous Error] Failed to report status: %s\n", strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+int receiveStatus(int socket_fd, uint32_t* tag, int* exit_code)
+{
+    rendezvous_status_t status;
+
+    ssize_t received = 0;
+    while ((received = recv(socket_fd, &status, sizeof(status), 0)) < 0 && errno == EINTR) {
+    }
+
+    if (received != sizeof(status)) {
+        printf("[Rendezvous Error] Data handler exited without reporting status\n");
+        return 1;
+    }
+
+    *tag = status.tag;
+    *exit_code = status.exit_code;
+    return 0;
+}
+
+int awaitAdmission(int socket_fd)
+{
+    uint32_t tag = 0;
+    int status = 0;
+    if (receiveStatus(socket_fd, &tag, &status) != 0) {
+        return 1;
+    }
+
+    if (status != RENDEZVOUS_ADMITTED) {
+        printf("[Rendezvous Error] Data handler is overloaded, try again later\n");
+        return 1;
+    }
+
+    return 0;
+}
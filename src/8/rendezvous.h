@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+
+// Rendezvous of reader-writer and data handler over an abstract Unix socket.
+// Instead of opening four named FIFOs in a strict order, reader-writer creates
+// anonymous pipes and passes the data handler's ends in a single SCM_RIGHTS message.
+// In direct mode it passes the opened input and output files themselves instead,
+// and waits for the data handler to report back over the same socket.
+// In one-vs-many mode it passes the reference input once and then one message per
+// candidate; messages keep their boundaries, so several handler workers may share the socket.
+// Abstract socket names don't touch the filesystem and vanish with the socket.
+
+// What the passed descriptors are.
+typedef enum {
+    RENDEZVOUS_PIPES = 'p',
+    // Inputs may be files or pipes (for inputs that need reading), outputs are files.
+    RENDEZVOUS_FILES = 'f',
+    // One-vs-many mode: the reference input only (in the first input slot).
+    RENDEZVOUS_REFERENCE = 'r',
+    // One-vs-many mode: a candidate input (in the second input slot) and its two output files.
+    RENDEZVOUS_CANDIDATE = 'c',
+    // Follow mode: pipes as in RENDEZVOUS_PIPES, but inputs never stop growing until they're closed
+    // and every change of the results is sent as a frame (see follow_frame_header_t).
+    RENDEZVOUS_FOLLOW = 'w',
+    // Server mode: a connection accepted by the dispatcher (in the first input slot) for a pool handler.
+    RENDEZVOUS_CONNECTION = 'n',
+    // Not a message: the other side has shut down sending.
+    RENDEZVOUS_END = 0
+} rendezvous_kind_t;
+
+// Descriptor slots of a message, in this order. Slots a kind doesn't use are -1.
+enum {
+    RENDEZVOUS_INPUT_1,
+    RENDEZVOUS_INPUT_2,
+    RENDEZVOUS_OUTPUT_1,
+    RENDEZVOUS_OUTPUT_2,
+    // Optional presence index files of the inputs passed as files.
+    RENDEZVOUS_INDEX_1,
+    RENDEZVOUS_INDEX_2,
+    // Incremental mode: the state of the previous run (optional) and an empty file for the new one.
+    RENDEZVOUS_STATE_IN,
+    RENDEZVOUS_STATE_OUT,
+    RENDEZVOUS_FD_COUNT
+};
+
+// Pipe mode passes one pipe per slot of the inputs and outputs.
+#define RENDEZVOUS_PIPE_COUNT (RENDEZVOUS_OUTPUT_2 + 1)
+
+// Follow mode: a result sent over an output pipe is this header followed by length bytes.
+// Frames are small enough to be written into a pipe atomically.
+typedef struct {
+    uint32_t length;
+} follow_frame_header_t;
+
+// Gives up if the other side doesn't show up for this long.
+#define RENDEZVOUS_TIMEOUT_MS 10000
+
+// Marks every slot as unused.
+void clearDescriptors(int fds[RENDEZVOUS_FD_COUNT]);
+
+// Roles are fixed, so two programs of the same role never meet each other: the data handler
+// takes the abstract socket name and reader-writer connects to it. They can start in any order,
+// reader-writer retries until the data handler listens. Nothing can be waited on until then, so retries
+// are frequent while the handler is likely still starting, which is when both are started together,
+// and only after that they back off by doubling the pause up to the longest one.
+#define RENDEZVOUS_RETRY_FIRST_US 20
+#define RENDEZVOUS_RETRY_FAST_MS 10
+#define RENDEZVOUS_RETRY_LAST_US 5000
+
+// Data handler side: takes the name, waits for a single reader-writer and frees the name.
+// Returns the connected socket (-1 on failure).
+int acceptRendezvous(const char* name);
+
+// Takes the abstract socket name for good and returns the listening socket (-1 on failure).
+// Used by a server that accepts any number of reader-writers connecting with connectRendezvous.
+int listenRendezvous(const char* name, int backlog);
+
+// Reader-writer side: connects to the data handler at the name. Returns the connected socket (-1 on failure).
+int connectRendezvous(const char* name);
+
+// Sends the descriptors of the used (not -1) slots over a connected socket.
+// tag identifies the message in the status reported for it.
+int sendDescriptors(int socket_fd, rendezvous_kind_t kind, uint32_t tag, const int fds[RENDEZVOUS_FD_COUNT]);
+
+// Receives the next message from a connected socket, kind is RENDEZVOUS_END if there are no more.
+int receiveDescriptors(int socket_fd, rendezvous_kind_t* kind, uint32_t* tag, int fds[RENDEZVOUS_FD_COUNT]);
+
+// Before anything else is sent over a connection, the data handler admits it with a status
+// (tag 0) of RENDEZVOUS_ADMITTED, or a server rejects it with RENDEZVOUS_OVERLOADED.
+#define RENDEZVOUS_ADMITTED 0
+#define RENDEZVOUS_OVERLOADED 75
+
+// Waits for the data handler to admit the connection. Returns 0 if it's admitted.
+int awaitAdmission(int socket_fd);
+
+// Reports the exit code of the data handler for the message with tag (direct and one-vs-many modes).
+int sendStatus(int socket_fd, uint32_t tag, int exit_code);
+
+// Waits for the data handler to report an exit code. A closed socket counts as a failure.
+int receiveStatus(int socket_fd, uint32_t* tag, int* exit_code);
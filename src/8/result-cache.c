@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "result-cache.h"
+
+#define RESULT_CACHE_MAGIC 0x4350384dU /* "M8PC" */
+#define RESULT_CACHE_VERSION 1
+
+// Only the newest entries are kept, so the file stays under ~360 KiB.
+#define RESULT_CACHE_MAX_ENTRIES 4096
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+} cache_header_t;
+
+static int growEntries(result_cache_t* cache, size_t count)
+{
+    if (count <= cache->capacity) {
+        return 0;
+    }
+
+    size_t capacity = cache->capacity == 0 ? 64 : cache->capacity;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+
+    cache_entry_t* entries = realloc(cache->entries, capacity * sizeof(*entries));
+    if (entries == NULL) {
+        printf("[Result Cache Error] Failed to allocate %zu entries\n", capacity);
+        return 1;
+    }
+
+    cache->entries = entries;
+    cache->capacity = capacity;
+    return 0;
+}
+
+static int readAll(int fd, void* data, size_t length)
+{
+    char* bytes = data;
+    while (length > 0) {
+        const ssize_t result = read(fd, bytes, length);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (result <= 0) {
+            return 1;
+        }
+
+        bytes += result;
+        length -= (size_t)result;
+    }
+
+    return 0;
+}
+
+static int writeAllBytes(int fd, const void* data, size_t length)
+{
+    const char* bytes = data;
+    while (length > 0) {
+        const ssize_t result = write(fd, bytes, length);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (result < 0) {
+            return 1;
+        }
+
+        bytes += result;
+        length -= (size_t)result;
+    }
+
+    return 0;
+}
+
+// Replaces the entries with the contents of the cache file. Broken files are treated as empty.
+static int loadEntries(result_cache_t* cache)
+{
+    cache->count = 0;
+
+    const int fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            printf("[Result Cache Error] Failed to open '%s': %s, starting empty\n", cache->path, strerror(errno));
+        }
+        return 0;
+    }
+
+    int exit_code = 0;
+    cache_header_t header;
+
+    if (readAll(fd, &header, sizeof(header)) != 0
+        || header.magic != RESULT_CACHE_MAGIC
+        || header.version != RESULT_CACHE_VERSION
+        || header.count > RESULT_CACHE_MAX_ENTRIES) {
+        printf("[Result Cache] '%s' isn't a cache of this version, starting empty\n", cache->path);
+        goto cleanup;
+    }
+
+    if ((exit_code = growEntries(cache, (size_t)header.count)) != 0) {
+        goto cleanup;
+    }
+
+    if (readAll(fd, cache->entries, (size_t)header.count * sizeof(cache_entry_t)) != 0) {
+        printf("[Result Cache] '%s' is truncated, starting empty\n", cache->path);
+        goto cleanup;
+    }
+
+    cache->count = (size_t)header.count;
+
+cleanup:
+    close(fd);
+    return exit_code;
+}
+
+int resultCacheOpen(result_cache_t* cache, const char* path)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->path = path;
+
+    if (loadEntries(cache) != 0) {
+        return 1;
+    }
+
+    printf("[Result Cache] Loaded %zu entries from '%s'\n", cache->count, path);
+    return 0;
+}
+
+void resultCacheClose(result_cache_t* cache)
+{
+    free(cache->entries);
+    memset(cache, 0, sizeof(*cache));
+}
+
+int cacheKeyFromFd(int fd, cache_key_t* key)
+{
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        return 1;
+    }
+
+    // Zeroed first, so keys can be compared with memcmp.
+    memset(key, 0, sizeof(*key));
+    key->device = (uint64_t)file_stat.st_dev;
+    key->inode = (uint64_t)file_stat.st_ino;
+    key->size = (uint64_t)file_stat.st_size;
+    key->modified_seconds = (int64_t)file_stat.st_mtim.tv_sec;
+    key->modified_nanoseconds = (int64_t)file_stat.st_mtim.tv_nsec;
+    key->changed_seconds = (int64_t)file_stat.st_ctim.tv_sec;
+    key->changed_nanoseconds = (int64_t)file_stat.st_ctim.tv_nsec;
+    return 0;
+}
+
+// Index of the newest entry with key or -1.
+static long findEntry(const cache_entry_t* entries, size_t count, const cache_key_t* key)
+{
+    for (size_t i = count; i > 0; --i) {
+        if (memcmp(&entries[i - 1].key, key, sizeof(*key)) == 0) {
+            return (long)(i - 1);
+        }
+    }
+
+    return -1;
+}
+
+bool resultCacheLookup(const result_cache_t* cache, const cache_key_t* key, presence_t* presence)
+{
+    const long index = findEntry(cache->entries, cache->count, key);
+    if (index < 0) {
+        return false;
+    }
+
+    *presence = cache->entries[index].presence;
+    return true;
+}
+
+int resultCacheStore(result_cache_t* cache, const cache_key_t* key, const presence_t* presence)
+{
+    if (growEntries(cache, cache->count + 1) != 0) {
+        return 1;
+    }
+
+    cache->entries[cache->count].key = *key;
+    cache->entries[cache->count].presence = *presence;
+    ++cache->count;
+    ++cache->added;
+    return 0;
+}
+
+int resultCacheSave(result_cache_t* cache)
+{
+    if (cache->added == 0) {
+        return 0;
+    }
+
+    // Other handlers may have saved the cache since it was loaded:
+    // their entries are read back and the added ones are appended to them.
+    const size_t added = cache->added;
+    cache_entry_t* added_entries = malloc(added * sizeof(*added_entries));
+    if (added_entries == NULL) {
+        printf("[Result Cache Error] Failed to allocate %zu entries\n", added);
+        return 1;
+    }
+
+    memcpy(added_entries, cache->entries + (cache->count - added), added * sizeof(*added_entries));
+
+    int exit_code = 0;
+    int fd = -1;
+    int lock_fd = -1;
+    char temporary_path[4096];
+    char lock_path[4096];
+
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.XXXXXX", cache->path) >= (int)sizeof(temporary_path)
+        || snprintf(lock_path, sizeof(lock_path), "%s.lock", cache->path) >= (int)sizeof(lock_path)) {
+        printf("[Result Cache Error] Cache path '%s' is too long\n", cache->path);
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    // Savers are serialized from loading to renaming, otherwise the last rename drops
+    // the entries of the others. The cache file itself is replaced, so the lock is a separate file.
+    if ((lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+        printf("[Result Cache Error] Failed to open lock '%s': %s\n", lock_path, strerror(errno));
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    while (flock(lock_fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            printf("[Result Cache Error] Failed to lock '%s': %s\n", lock_path, strerror(errno));
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
+    if ((exit_code = loadEntries(cache)) != 0) {
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < added; ++i) {
+        if (findEntry(cache->entries, cache->count, &added_entries[i].key) < 0) {
+            if ((exit_code = growEntries(cache, cache->count + 1)) != 0) {
+                goto cleanup;
+            }
+            cache->entries[cache->count++] = added_entries[i];
+        }
+    }
+
+    // The oldest entries are dropped first.
+    const size_t first = cache->count > RESULT_CACHE_MAX_ENTRIES ? cache->count - RESULT_CACHE_MAX_ENTRIES : 0;
+    const cache_header_t header = { RESULT_CACHE_MAGIC, RESULT_CACHE_VERSION, cache->count - first };
+
+    if ((fd = mkstemp(temporary_path)) < 0) {
+        printf("[Result Cache Error] Failed to create '%s': %s\n", temporary_path, strerror(errno));
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    const int write_failed = writeAllBytes(fd, &header, sizeof(header))
+        || writeAllBytes(fd, cache->entries + first, (size_t)header.count * sizeof(cache_entry_t));
+    const int close_failed = close(fd);
+    fd = -1;
+
+    if (write_failed || close_failed) {
+        printf("[Result Cache Error] Failed to write '%s': %s\n", temporary_path, strerror(errno));
+        unlink(temporary_path);
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    // Readers see either the old or the new file, never a partially written one.
+    if (rename(temporary_path, cache->path) != 0) {
+        printf("[Result Cache Error] Failed to replace '%s': %s\n", cache->path, strerror(errno));
+        unlink(temporary_path);
+        exit_code = 1;
+        goto cleanup;
+    }
+
+    printf("[Result Cache] Saved %llu entries to '%s'\n", (unsigned long long)header.count, cache->path);
+    cache->added = 0;
+
+cleanup:
+    if (fd != -1) {
+        close(fd);
+    }
+
+    // Closing the lock file releases the lock.
+    if (lock_fd != -1) {
+        close(lock_fd);
+    }
+
+    free(added_entries);
+    return exit_code;
+}
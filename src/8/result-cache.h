@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "presence.h"
+
+// Identity of an input file: any write, truncation or replacement changes at least one field.
+typedef struct {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t modified_seconds;
+    int64_t modified_nanoseconds;
+    int64_t changed_seconds;
+    int64_t changed_nanoseconds;
+} cache_key_t;
+
+typedef struct {
+    cache_key_t key;
+    presence_t presence;
+} cache_entry_t;
+
+// On-disk cache of byte sets of input files, kept between runs.
+// The file is a small header followed by fixed-size entries, oldest first.
+typedef struct {
+    const char* path;
+
+    cache_entry_t* entries;
+    size_t count;
+    size_t capacity;
+
+    // The last added entries were stored in this run and aren't saved yet.
+    size_t added;
+} result_cache_t;
+
+// Loads the cache from path, a missing or unreadable file gives an empty cache.
+int resultCacheOpen(result_cache_t* cache, const char* path);
+void resultCacheClose(result_cache_t* cache);
+
+// Fills key for a regular file. Returns 1 for anything else (pipes, sockets), which can't be cached.
+int cacheKeyFromFd(int fd, cache_key_t* key);
+
+bool resultCacheLookup(const result_cache_t* cache, const cache_key_t* key, presence_t* presence);
+int resultCacheStore(result_cache_t* cache, const cache_key_t* key, const presence_t* presence);
+
+// Merges the added entries into the current file contents and atomically replaces the file.
+int resultCacheSave(result_cache_t* cache);
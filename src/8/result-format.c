@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "result-format.h"
+
+int parseResultFormat(const char* text, result_format_t* format)
+{
+    if (strcmp(text, "text") == 0) {
+        *format = RESULT_TEXT;
+    } else if (strcmp(text, "bitmap") == 0) {
+        *format = RESULT_BITMAP;
+    } else if (strcmp(text, "count") == 0) {
+        *format = RESULT_COUNT;
+    } else {
+        return 1;
+    }
+
+    return 0;
+}
+
+size_t formatResult(const presence_t* including, const presence_t* excluding, result_format_t format,
+    char buffer[RESULT_MAX_LENGTH])
+{
+    char bytes[128];
+    const size_t length = presenceDifference(including, excluding, bytes);
+
+    switch (format) {
+    case RESULT_BITMAP:
+        // Byte-addressed rather than word-addressed, so the file doesn't depend on endianness.
+        memcpy(buffer, RESULT_BITMAP_MAGIC, RESULT_BITMAP_MAGIC_LENGTH);
+        memset(buffer + RESULT_BITMAP_MAGIC_LENGTH, 0, RESULT_BITMAP_LENGTH - RESULT_BITMAP_MAGIC_LENGTH);
+        for (size_t i = 0; i < length; ++i) {
+            const unsigned char byte = (unsigned char)bytes[i];
+            buffer[RESULT_BITMAP_MAGIC_LENGTH + byte / 8] |= (char)(1 << (byte % 8));
+        }
+        return RESULT_BITMAP_LENGTH;
+    case RESULT_COUNT:
+        return (size_t)snprintf(buffer, RESULT_MAX_LENGTH, "%zu\n", length);
+    default:
+        memcpy(buffer, bytes, length);
+        return length;
+    }
+}
+
+int parseBitmapResult(const char* data, size_t length, presence_t* result)
+{
+    if (length != RESULT_BITMAP_LENGTH || memcmp(data, RESULT_BITMAP_MAGIC, RESULT_BITMAP_MAGIC_LENGTH) != 0) {
+        return 1;
+    }
+
+    presenceClear(result);
+    for (int byte = 0; byte < 256; ++byte) {
+        if ((unsigned char)data[RESULT_BITMAP_MAGIC_LENGTH + byte / 8] & (1 << (byte % 8))) {
+            result->words[byte >> 6] |= (uint64_t)1 << (byte & 63);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "presence.h"
+
+// How a byte difference result is written. Every format holds the same set of bytes:
+// the ASCII bytes of one stream missing from the other.
+typedef enum {
+    // The bytes themselves in byte order, as marks 4-7 write them.
+    RESULT_TEXT,
+    // RESULT_BITMAP_MAGIC followed by the 32-byte set, where bit b % 8 of byte b / 8 is set if byte b
+    // is in the result. Readers that only test membership never render it (see mark8-render).
+    RESULT_BITMAP,
+    // The number of bytes in the result as a decimal line.
+    RESULT_COUNT
+} result_format_t;
+
+#define RESULT_BITMAP_MAGIC "M8B1"
+#define RESULT_BITMAP_MAGIC_LENGTH 4
+#define RESULT_BITMAP_LENGTH (RESULT_BITMAP_MAGIC_LENGTH + 32)
+
+// A result of any format is at most this long.
+#define RESULT_MAX_LENGTH 128
+
+// Parses "text", "bitmap" or "count". Returns 0 on success.
+int parseResultFormat(const char* text, result_format_t* format);
+
+// Writes the result of including against excluding in the format into buffer. Returns its length.
+size_t formatResult(const presence_t* including, const presence_t* excluding, result_format_t format,
+    char buffer[RESULT_MAX_LENGTH]);
+
+// Reads the set of a bitmap result back. Returns 0 if data is a bitmap result.
+int parseBitmapResult(const char* data, size_t length, presence_t* result);
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sampler.h"
+
+static uint64_t nextRandom(uint64_t* state)
+{
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+int sampleInit(sample_t* sample, uint64_t size, uint64_t blocks, uint64_t seed)
+{
+    memset(sample, 0, sizeof(*sample));
+    sample->block_count = (size + SAMPLE_BLOCK_SIZE - 1) / SAMPLE_BLOCK_SIZE;
+
+    sample->chosen = calloc(sample->block_count / 8 + 1, 1);
+    if (sample->chosen == NULL) {
+        printf("[Sampler Error] Failed to allocate a map of %llu blocks\n", (unsigned long long)sample->block_count);
+        return 1;
+    }
+
+    if (blocks >= sample->block_count) {
+        memset(sample->chosen, 0xFF, sample->block_count / 8 + 1);
+        sample->chosen_count = sample->block_count;
+        return 0;
+    }
+
+    // Blocks are drawn until enough distinct ones are met, at most twice as many draws on average
+    // when half of the blocks are chosen.
+    uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    while (sample->chosen_count < blocks) {
+        const uint64_t block = nextRandom(&state) % sample->block_count;
+        if (!sampleChosen(sample, block)) {
+            sample->chosen[block / 8] |= (unsigned char)(1 << (block % 8));
+            ++sample->chosen_count;
+        }
+    }
+
+    return 0;
+}
+
+void sampleFree(sample_t* sample)
+{
+    free(sample->chosen);
+    sample->chosen = NULL;
+}
+
+bool sampleChosen(const sample_t* sample, uint64_t block)
+{
+    return (sample->chosen[block / 8] >> (block % 8)) & 1;
+}
+
+void sampleAccount(sample_t* sample, const char* data, size_t length)
+{
+    presence_t block;
+    presenceClear(&block);
+    presenceAdd(&block, data, length);
+
+    for (int byte = 0; byte < 256; ++byte) {
+        sample->byte_blocks[byte] += presenceContains(&block, (unsigned char)byte);
+    }
+
+    ++sample->sampled;
+}
+
+void sampleSeen(const sample_t* sample, presence_t* seen)
+{
+    presenceClear(seen);
+    for (int byte = 0; byte < 256; ++byte) {
+        if (sample->byte_blocks[byte] != 0) {
+            seen->words[byte >> 6] |= (uint64_t)1 << (byte & 63);
+        }
+    }
+}
+
+double sampleUnseenMass(const sample_t* sample)
+{
+    if (sample->sampled >= sample->block_count) {
+        return 0;
+    }
+
+    if (sample->sampled == 0) {
+        return 1;
+    }
+
+    int singletons = 0;
+    for (int byte = 0; byte < 256; ++byte) {
+        singletons += sample->byte_blocks[byte] == 1;
+    }
+
+    return (double)(singletons + 1) / (double)(sample->sampled + 1);
+}
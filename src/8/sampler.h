@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "presence.h"
+
+// Sampling mode of reader-writer: random blocks of each input are passed first, so a provisional
+// difference is ready after reading a small part of huge inputs. The rest of the blocks follow
+// to refine it into the exact one. A sample keeps which blocks were chosen and how many sampled
+// blocks every byte value was met in, which is what its confidence is estimated from.
+
+// Inputs are sampled and read in blocks of this size.
+#define SAMPLE_BLOCK_SIZE (64 * 1024)
+
+// Blocks sampled per input by default.
+#define SAMPLE_DEFAULT_BLOCKS 64
+
+typedef struct {
+    uint64_t block_count;
+
+    // Bitmap of the chosen blocks and their number.
+    unsigned char* chosen;
+    uint64_t chosen_count;
+
+    // Chosen blocks counted so far.
+    uint64_t sampled;
+
+    // Sampled blocks every byte value was met in.
+    uint32_t byte_blocks[256];
+} sample_t;
+
+// Chooses min(blocks, block count) distinct blocks of an input of size bytes at random. Returns 0 on success.
+int sampleInit(sample_t* sample, uint64_t size, uint64_t blocks, uint64_t seed);
+void sampleFree(sample_t* sample);
+
+bool sampleChosen(const sample_t* sample, uint64_t block);
+
+// Counts the byte values of a chosen block.
+void sampleAccount(sample_t* sample, const char* data, size_t length);
+
+// Byte values met in the sampled blocks.
+void sampleSeen(const sample_t* sample, presence_t* seen);
+
+// Good-Turing estimate of the chance that one more random block holds a byte value not met so far:
+// the number of byte values met in exactly one sampled block over the number of sampled blocks,
+// both plus one, so that it isn't 0 before every block is sampled. 0 once they are.
+double sampleUnseenMass(const sample_t* sample);
@@ -0,0 +1,590 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "atomic-output.h"
+#include "rendezvous.h"
+#include "server.h"
+
+// Connections waiting to be accepted at most, reader-writers beyond it wait in connect().
+#define SERVER_BACKLOG 128
+
+// With a wait limit or metrics the dispatcher wakes up at least this often.
+#define SERVER_TICK_MS 100
+#define METRICS_INTERVAL_MS 1000
+
+// Latency percentiles are taken over this many most recent connections.
+#define LATENCY_SAMPLES 4096
+
+typedef struct {
+    pid_t pid;
+
+    // Dispatcher end of the socket pair connections and statuses go over, -1 once the handler is gone.
+    int channel_fd;
+
+    // Whether the handler has a connection it hasn't reported back on yet, and since when.
+    bool busy;
+    double started_ms;
+
+    unsigned long handled;
+    unsigned long failed;
+} pool_handler_t;
+
+typedef struct {
+    int fd;
+    uid_t client;
+    double accepted_ms;
+} pending_connection_t;
+
+typedef struct {
+    double values[LATENCY_SAMPLES];
+    unsigned long count;
+    double max;
+} latency_samples_t;
+
+typedef struct {
+    const server_options_t* options;
+    server_handler_t handler;
+    void* context;
+
+    int listen_fd;
+    pool_handler_t* handlers;
+    int running;
+
+    // Accepted connections in the order they came.
+    pending_connection_t* pending;
+    int pending_count;
+    int pending_max;
+
+    // Clients take turns by user id, this one was served last.
+    uid_t last_client;
+    bool served_any;
+
+    unsigned long accepted;
+    unsigned long rejected;
+    unsigned long expired;
+    latency_samples_t wait;
+    latency_samples_t service;
+} server_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void requestStop(int signal_number)
+{
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+// Helper function that closes a file descriptor and sets it to -1 only if it's not equal to -1.
+static void closeFile(int* fd)
+{
+    if (*fd != -1) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+static double nowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000 + (double)now.tv_nsec / 1000000;
+}
+
+static void recordLatency(latency_samples_t* samples, double value)
+{
+    samples->values[samples->count++ % LATENCY_SAMPLES] = value;
+    if (value > samples->max) {
+        samples->max = value;
+    }
+}
+
+static int compareDoubles(const void* left, const void* right)
+{
+    const double a = *(const double*)left;
+    const double b = *(const double*)right;
+    return (a > b) - (a < b);
+}
+
+// latencyPercentiles: Fills the percentiles of the recent samples, zeros if there are none.
+static void latencyPercentiles(const latency_samples_t* samples, const double* percents, double* values, int count)
+{
+    const size_t recent = samples->count < LATENCY_SAMPLES ? samples->count : LATENCY_SAMPLES;
+    static double sorted[LATENCY_SAMPLES];
+    memcpy(sorted, samples->values, recent * sizeof(double));
+    qsort(sorted, recent, sizeof(double), compareDoubles);
+
+    for (int i = 0; i < count; ++i) {
+        values[i] = recent == 0 ? 0 : sorted[(size_t)(percents[i] / 100 * (double)(recent - 1))];
+    }
+}
+
+// runPoolHandler: Handles the connections the dispatcher passes one after another
+// and reports each exit code back, until the dispatcher closes the channel.
+static int runPoolHandler(int channel_fd, server_handler_t handler, void* context)
+{
+    for (;;) {
+        int fds[RENDEZVOUS_FD_COUNT];
+        rendezvous_kind_t kind = RENDEZVOUS_END;
+        uint32_t tag = 0;
+
+        if (receiveDescriptors(channel_fd, &kind, &tag, fds) != 0) {
+            return 1;
+        }
+
+        if (kind == RENDEZVOUS_END) {
+            return 0;
+        }
+
+        if (kind != RENDEZVOUS_CONNECTION) {
+            printf("[Server Error] Unexpected message '%c' from the dispatcher\n", (char)kind);
+            for (int i = 0; i < RENDEZVOUS_FD_COUNT; ++i) {
+                closeFile(&fds[i]);
+            }
+            return 1;
+        }
+
+        const int exit_code = handler(fds[RENDEZVOUS_INPUT_1], context);
+        fflush(stdout);
+
+        if (sendStatus(channel_fd, tag, exit_code) != 0) {
+            return 1;
+        }
+    }
+}
+
+// startHandler: Forks the handler at index with a fresh channel. Returns 0 on success.
+static int startHandler(server_t* server, int index)
+{
+    int channel_fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, channel_fds) != 0) {
+        printf("[Server Error] Failed to create handler channel: %s\n", strerror(errno));
+        return 1;
+    }
+
+    fflush(stdout);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        printf("[Server Error] Failed to start handler: %s\n", strerror(errno));
+        close(channel_fds[0]);
+        close(channel_fds[1]);
+        return 1;
+    }
+
+    if (pid == 0) {
+        // Only the handler's own channel stays open: a handler holding the listening socket, queued
+        // connections or other handlers' channels would keep them alive after the dispatcher drops them.
+        close(server->listen_fd);
+        close(channel_fds[0]);
+        for (int i = 0; i < server->options->workers; ++i) {
+            closeFile(&server->handlers[i].channel_fd);
+        }
+        for (int i = 0; i < server->pending_count; ++i) {
+            close(server->pending[i].fd);
+        }
+
+        // Interrupting the terminal stops the dispatcher, handlers finish their connections first.
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_DFL);
+
+        const int exit_code = pinWorker(server->options->placement, index)
+            || runPoolHandler(channel_fds[1], server->handler, server->context);
+        fflush(stdout);
+        _exit(exit_code);
+    }
+
+    close(channel_fds[1]);
+
+    pool_handler_t* pool_handler = &server->handlers[index];
+    pool_handler->pid = pid;
+    pool_handler->channel_fd = channel_fds[0];
+    pool_handler->busy = false;
+    ++server->running;
+    return 0;
+}
+
+// collectStatus: Takes the status of the connection of a handler whose channel is ready.
+// Returns 1 if the handler is gone, its connection is lost then and the slot is no longer busy.
+static int collectStatus(server_t* server, pool_handler_t* pool_handler, short events)
+{
+    if ((events & POLLIN) && pool_handler->busy) {
+        uint32_t tag = 0;
+        int exit_code = 0;
+
+        if (receiveStatus(pool_handler->channel_fd, &tag, &exit_code) == 0) {
+            pool_handler->busy = false;
+            ++pool_handler->handled;
+            pool_handler->failed += exit_code != 0;
+            recordLatency(&server->service, nowMs() - pool_handler->started_ms);
+            return 0;
+        }
+    }
+
+    closeFile(&pool_handler->channel_fd);
+    pool_handler->busy = false;
+
+    int status = 0;
+    while (waitpid(pool_handler->pid, &status, 0) < 0 && errno == EINTR) {
+    }
+
+    --server->running;
+    return 1;
+}
+
+// rejectConnection: Tells the reader-writer the server is overloaded and drops its connection.
+static void rejectConnection(int connection_fd)
+{
+    // The reader-writer may already be gone, then there's nobody to tell.
+    sendStatus(connection_fd, 0, RENDEZVOUS_OVERLOADED);
+    close(connection_fd);
+}
+
+static int clientPending(const server_t* server, uid_t client)
+{
+    int count = 0;
+    for (int i = 0; i < server->pending_count; ++i) {
+        count += server->pending[i].client == client;
+    }
+    return count;
+}
+
+static void removePending(server_t* server, int index)
+{
+    memmove(&server->pending[index], &server->pending[index + 1],
+        (size_t)(server->pending_count - index - 1) * sizeof(*server->pending));
+    --server->pending_count;
+}
+
+// admitConnections: Accepts every waiting connection and queues it, or rejects it if the queue
+// or the client's share of it is full.
+static void admitConnections(server_t* server)
+{
+    for (;;) {
+        const int connection_fd = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (connection_fd < 0) {
+            if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+                printf("[Server Error] Failed to accept connection: %s\n", strerror(errno));
+            }
+            return;
+        }
+
+        struct ucred credentials;
+        socklen_t length = sizeof(credentials);
+        const uid_t client = getsockopt(connection_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0
+            ? credentials.uid
+            : (uid_t)-1;
+
+        ++server->accepted;
+
+        if (server->pending_count >= server->options->queue_depth
+            || clientPending(server, client) >= server->options->client_depth) {
+            ++server->rejected;
+            rejectConnection(connection_fd);
+            continue;
+        }
+
+        const pending_connection_t connection = { connection_fd, client, nowMs() };
+        server->pending[server->pending_count++] = connection;
+        if (server->pending_count > server->pending_max) {
+            server->pending_max = server->pending_count;
+        }
+    }
+}
+
+// expireConnections: Rejects the queued connections that waited longer than allowed.
+static void expireConnections(server_t* server)
+{
+    if (server->options->max_wait_ms == 0) {
+        return;
+    }
+
+    const double deadline = nowMs() - server->options->max_wait_ms;
+
+    // Connections are queued in order, so the expired ones are at the front.
+    while (server->pending_count > 0 && server->pending[0].accepted_ms <= deadline) {
+        ++server->expired;
+        rejectConnection(server->pending[0].fd);
+        removePending(server, 0);
+    }
+}
+
+// pickPending: Returns the oldest queued connection of the client next after the last served one.
+static int pickPending(const server_t* server)
+{
+    int next = -1;
+    int first = -1;
+
+    // Connections are scanned in order and only a smaller user id replaces the pick,
+    // so every pick is the oldest connection of its client.
+    for (int i = 0; i < server->pending_count; ++i) {
+        const uid_t client = server->pending[i].client;
+
+        if (first == -1 || client < server->pending[first].client) {
+            first = i;
+        }
+
+        if ((!server->served_any || client > server->last_client)
+            && (next == -1 || client < server->pending[next].client)) {
+            next = i;
+        }
+    }
+
+    return next != -1 ? next : first;
+}
+
+// dispatchConnections: Passes queued connections to idle handlers.
+static void dispatchConnections(server_t* server, uint32_t* tag)
+{
+    for (int i = 0; i < server->options->workers && server->pending_count > 0; ++i) {
+        pool_handler_t* pool_handler = &server->handlers[i];
+        if (pool_handler->channel_fd == -1 || pool_handler->busy) {
+            continue;
+        }
+
+        const int picked = pickPending(server);
+        const pending_connection_t connection = server->pending[picked];
+        removePending(server, picked);
+
+        server->last_client = connection.client;
+        server->served_any = true;
+
+        int fds[RENDEZVOUS_FD_COUNT];
+        clearDescriptors(fds);
+        fds[RENDEZVOUS_INPUT_1] = connection.fd;
+
+        // A failed send drops the connection, its reader-writer sees the socket closed.
+        if (sendDescriptors(pool_handler->channel_fd, RENDEZVOUS_CONNECTION, ++*tag, fds) == 0) {
+            pool_handler->busy = true;
+            pool_handler->started_ms = nowMs();
+            recordLatency(&server->wait, pool_handler->started_ms - connection.accepted_ms);
+        }
+
+        close(connection.fd);
+    }
+}
+
+// formatMetrics: Prints the queue and latency metrics as "<name> <value>" lines. Returns the length.
+static int formatMetrics(const server_t* server, char* text, size_t size)
+{
+    static const double percents[] = { 50, 99 };
+    double wait[2];
+    double service[2];
+    latencyPercentiles(&server->wait, percents, wait, 2);
+    latencyPercentiles(&server->service, percents, service, 2);
+
+    int busy = 0;
+    unsigned long handled = 0;
+    unsigned long failed = 0;
+    for (int i = 0; i < server->options->workers; ++i) {
+        busy += server->handlers[i].busy;
+        handled += server->handlers[i].handled;
+        failed += server->handlers[i].failed;
+    }
+
+    const int length = snprintf(text, size,
+        "queue_depth %d\nqueue_depth_max %d\nhandlers %d\nhandlers_busy %d\n"
+        "connections_accepted %lu\nconnections_rejected %lu\nconnections_expired %lu\n"
+        "connections_handled %lu\nconnections_failed %lu\n"
+        "wait_ms_p50 %.3f\nwait_ms_p99 %.3f\nwait_ms_max %.3f\n"
+        "service_ms_p50 %.3f\nservice_ms_p99 %.3f\nservice_ms_max %.3f\n",
+        server->pending_count, server->pending_max, server->running, busy,
+        server->accepted, server->rejected, server->expired, handled, failed,
+        wait[0], wait[1], server->wait.max, service[0], service[1], server->service.max);
+
+    return length < 0 ? 0 : length >= (int)size ? (int)size - 1 : length;
+}
+
+// writeMetrics: Replaces the metrics file, readers never see it half-written.
+static void writeMetrics(const server_t* server)
+{
+    char text[1024];
+    struct iovec vector = { text, (size_t)formatMetrics(server, text, sizeof(text)) };
+
+    // A failed write is retried with fresh metrics on the next tick.
+    writeAtomicFile(server->options->metrics_path, &vector, 1, DURABILITY_NONE);
+}
+
+int runServer(const server_options_t* options, server_handler_t handler, void* context)
+{
+    const int workers = options->workers;
+    int exit_code = 1;
+
+    static server_t server;
+    memset(&server, 0, sizeof(server));
+    server.options = options;
+    server.handler = handler;
+    server.context = context;
+    server.listen_fd = -1;
+    server.handlers = calloc((size_t)workers, sizeof(*server.handlers));
+    server.pending = calloc((size_t)options->queue_depth, sizeof(*server.pending));
+    struct pollfd* poll_fds = calloc((size_t)workers + 1, sizeof(*poll_fds));
+
+    if (server.handlers == NULL || server.pending == NULL || poll_fds == NULL) {
+        printf("[Server Error] Failed to allocate %d handlers\n", workers);
+        goto cleanup;
+    }
+
+    for (int i = 0; i < workers; ++i) {
+        server.handlers[i].channel_fd = -1;
+    }
+
+    // Readiness comes from poll(), accepting must not block on a reader-writer that gave up.
+    if ((server.listen_fd = listenRendezvous(options->name, SERVER_BACKLOG)) < 0
+        || fcntl(server.listen_fd, F_SETFL, O_NONBLOCK) != 0 || applyPlacement(options->placement, -1, "Server") != 0) {
+        goto cleanup;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    for (int i = 0; i < workers; ++i) {
+        startHandler(&server, i);
+    }
+
+    if (server.running == 0) {
+        goto cleanup;
+    }
+
+    printf("[Server] Serving socket '@%s' with %d handlers, up to %d queued connections (%d per client)\n",
+        options->name, server.running, options->queue_depth, options->client_depth);
+    fflush(stdout);
+
+    exit_code = 0;
+    uint32_t tag = 0;
+    double metrics_ms = 0;
+    const int timeout_ms = options->max_wait_ms != 0 || options->metrics_path != NULL ? SERVER_TICK_MS : -1;
+
+    while (server.running > 0) {
+        // Once stopped, new reader-writers are refused and the queued ones are still served.
+        if (stop_requested && server.listen_fd != -1) {
+            closeFile(&server.listen_fd);
+            printf("[Server] Stopping, %d connections are still queued\n", server.pending_count);
+            fflush(stdout);
+        }
+
+        int busy = 0;
+        for (int i = 0; i < workers; ++i) {
+            busy += server.handlers[i].busy;
+        }
+
+        if (server.listen_fd == -1 && server.pending_count == 0 && busy == 0) {
+            break;
+        }
+
+        poll_fds[0].fd = server.listen_fd;
+        poll_fds[0].events = POLLIN;
+        for (int i = 0; i < workers; ++i) {
+            poll_fds[i + 1].fd = server.handlers[i].channel_fd;
+            poll_fds[i + 1].events = POLLIN;
+        }
+
+        if (poll(poll_fds, (nfds_t)workers + 1, timeout_ms) < 0 && errno != EINTR) {
+            printf("[Server Error] Failed to wait for connections: %s\n", strerror(errno));
+            exit_code = 1;
+            break;
+        }
+
+        for (int i = 0; i < workers; ++i) {
+            const bool was_busy = server.handlers[i].busy;
+            if (poll_fds[i + 1].revents == 0 || collectStatus(&server, &server.handlers[i], poll_fds[i + 1].revents) == 0) {
+                continue;
+            }
+
+            printf("[Server Error] Handler %d exited%s, restarting it\n", i,
+                was_busy ? " in the middle of a connection" : "");
+            startHandler(&server, i);
+        }
+
+        if (server.listen_fd != -1 && (poll_fds[0].revents & POLLIN)) {
+            admitConnections(&server);
+        }
+
+        expireConnections(&server);
+        dispatchConnections(&server, &tag);
+
+        if (options->metrics_path != NULL && nowMs() - metrics_ms >= METRICS_INTERVAL_MS) {
+            writeMetrics(&server);
+            metrics_ms = nowMs();
+        }
+    }
+
+    // Without handlers left nobody would ever serve the queue.
+    for (int i = 0; i < server.pending_count; ++i) {
+        rejectConnection(server.pending[i].fd);
+    }
+    server.pending_count = 0;
+
+    // Closing the sending side lets every handler exit.
+    for (int i = 0; i < workers; ++i) {
+        if (server.handlers[i].channel_fd != -1) {
+            shutdown(server.handlers[i].channel_fd, SHUT_WR);
+        }
+    }
+
+    while (server.running > 0) {
+        for (int i = 0; i < workers; ++i) {
+            poll_fds[i].fd = server.handlers[i].channel_fd;
+            poll_fds[i].events = POLLIN;
+        }
+
+        if (poll(poll_fds, (nfds_t)workers, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("[Server Error] Failed to wait for handlers: %s\n", strerror(errno));
+            exit_code = 1;
+            break;
+        }
+
+        for (int i = 0; i < workers; ++i) {
+            if (poll_fds[i].revents != 0) {
+                collectStatus(&server, &server.handlers[i], poll_fds[i].revents);
+            }
+        }
+    }
+
+    for (int i = 0; i < workers; ++i) {
+        printf("[Server] Handler %d handled %lu connections, %lu of them failed\n",
+            i, server.handlers[i].handled, server.handlers[i].failed);
+    }
+
+    char metrics[1024];
+    formatMetrics(&server, metrics, sizeof(metrics));
+    printf("[Server] Metrics:\n%s", metrics);
+
+    if (options->metrics_path != NULL) {
+        writeMetrics(&server);
+    }
+
+cleanup:
+    closeFile(&server.listen_fd);
+
+    if (server.handlers != NULL) {
+        for (int i = 0; i < workers; ++i) {
+            closeFile(&server.handlers[i].channel_fd);
+        }
+    }
+
+    free(server.handlers);
+    free(server.pending);
+    free(poll_fds);
+    return exit_code;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "placement.h"
+
+// Server mode: one dispatcher process owns the rendezvous socket name and accepts any number
+// of reader-writers meeting it there. Every accepted connection is passed to one of a pool
+// of forked handler processes that share nothing but the dispatcher: each one has its own
+// engine, cache handle and CPU, and handles one connection at a time.
+//
+// Accepted connections wait in the dispatcher's queue until a handler is idle. The queue is
+// bounded in total and per client (the user id of the reader-writer), and clients take turns,
+// so one client flooding the server doesn't starve the others. A connection that doesn't fit
+// or waits too long is rejected at once with RENDEZVOUS_OVERLOADED instead of piling up.
+
+typedef struct {
+    // Abstract socket name the server owns.
+    const char* name;
+
+    // Number of handler processes.
+    int workers;
+
+    // CPUs of the dispatcher, handlers are pinned to one of them each.
+    placement_t* placement;
+
+    // Connections waiting for a handler at most, in total and per client.
+    int queue_depth;
+    int client_depth;
+
+    // Connections waiting longer are rejected, 0 lets them wait for as long as it takes.
+    int max_wait_ms;
+
+    // Queue and latency metrics are rewritten into this file every second if set.
+    const char* metrics_path;
+} server_options_t;
+
+#define SERVER_DEFAULT_QUEUE_DEPTH 64
+
+// Handles one accepted connection and closes it. Returns the exit code of the request.
+typedef int (*server_handler_t)(int socket_fd, void* context);
+
+// Serves connections until SIGINT or SIGTERM, then finishes the queued ones. Returns 0 on success.
+int runServer(const server_options_t* options, server_handler_t handler, void* context);
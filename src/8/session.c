@@ -0,0 +1,270 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "session.h"
+
+#define SESSION_CLAIMED_NAME "claimed"
+
+// Data handler rescans sessions at least this often, even without directory events.
+#define SESSION_RESCAN_INTERVAL_MS 1000
+
+static const char* const fifo_names[SESSION_FIFO_COUNT] = {
+    INPUT_FIFO_NAME_1, INPUT_FIFO_NAME_2, OUTPUT_FIFO_NAME_1, OUTPUT_FIFO_NAME_2
+};
+
+void useCurrentDirectory(session_t* session)
+{
+    session->directory[0] = '\0';
+    for (int i = 0; i < SESSION_FIFO_COUNT; ++i) {
+        snprintf(session->fifo_paths[i], SESSION_PATH_LENGTH, "%s", fifo_names[i]);
+    }
+}
+
+static int setSessionDirectory(session_t* session, const char* base, const char* name)
+{
+    if ((size_t)snprintf(session->directory, SESSION_PATH_LENGTH, "%s/%s", base, name) >= SESSION_PATH_LENGTH) {
+        printf("[Session Error] Session path '%s/%s' is too long\n", base, name);
+        return 1;
+    }
+
+    for (int i = 0; i < SESSION_FIFO_COUNT; ++i) {
+        snprintf(session->fifo_paths[i], SESSION_PATH_LENGTH, "%.*s/%s",
+            SESSION_PATH_LENGTH - 64, session->directory, fifo_names[i]);
+    }
+
+    return 0;
+}
+
+// Finds (and creates if needed) the directory all sessions of this user live in.
+static int getSessionBase(char* base, size_t size)
+{
+    const char* runtime_directory = getenv("XDG_RUNTIME_DIR");
+    if (runtime_directory != NULL && runtime_directory[0] != '\0') {
+        snprintf(base, size, "%s/mark8", runtime_directory);
+    } else {
+        snprintf(base, size, "/tmp/mark8-%d", (int)getuid());
+    }
+
+    if (mkdir(base, 0700) < 0 && errno != EEXIST) {
+        printf("[Session Error] Failed to create session directory '%s': %s\n", base, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+static int isValidName(const char* name)
+{
+    return name[0] != '\0' && name[0] != '.' && strchr(name, '/') == NULL;
+}
+
+int createSession(const char* name, session_t* session)
+{
+    char base[SESSION_PATH_LENGTH];
+    if (getSessionBase(base, sizeof(base)) != 0) {
+        return 1;
+    }
+
+    char generated_name[64];
+    if (name == NULL) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        snprintf(generated_name, sizeof(generated_name), "%d-%lx%09ld",
+            (int)getpid(), (unsigned long)now.tv_sec, now.tv_nsec);
+        name = generated_name;
+    } else if (!isValidName(name)) {
+        printf("[Session Error] Invalid session name '%s'\n", name);
+        return 1;
+    }
+
+    // FIFOs are made in a hidden directory first: handlers skip names starting with a dot.
+    char hidden_name[SESSION_PATH_LENGTH];
+    snprintf(hidden_name, sizeof(hidden_name), ".%s", name);
+
+    session_t hidden;
+    if (setSessionDirectory(&hidden, base, hidden_name) != 0 || setSessionDirectory(session, base, name) != 0) {
+        return 1;
+    }
+
+    if (mkdir(hidden.directory, 0700) < 0) {
+        printf("[Session Error] Failed to create session directory '%s': %s\n", hidden.directory, strerror(errno));
+        return 1;
+    }
+
+    for (int i = 0; i < SESSION_FIFO_COUNT; ++i) {
+        if (mkfifo(hidden.fifo_paths[i], 0600) < 0) {
+            printf("[Session Error] Failed to create pipe '%s': %s\n", hidden.fifo_paths[i], strerror(errno));
+            removeSession(&hidden);
+            return 1;
+        }
+    }
+
+    // rename() replaces only an empty directory: a published session holds its FIFOs, so publishing
+    // over it fails and two reader-writers can't share a name (one being created is kept apart by the
+    // mkdir() above). Handlers are kept apart by the "claimed" file made with O_EXCL, not by this.
+    if (rename(hidden.directory, session->directory) < 0) {
+        printf("[Session Error] Failed to publish session '%s': %s\n", session->directory, strerror(errno));
+        removeSession(&hidden);
+        return 1;
+    }
+
+    printf("[Session] Created session '%s'\n", session->directory);
+    return 0;
+}
+
+// Tries to claim the session name in base. Returns 0 on success, 1 if it isn't there and 2 if it's taken.
+static int tryClaim(const char* base, const char* name, session_t* session)
+{
+    if (setSessionDirectory(session, base, name) != 0) {
+        return 1;
+    }
+
+    char claimed_path[SESSION_PATH_LENGTH + 16];
+    snprintf(claimed_path, sizeof(claimed_path), "%s/%s", session->directory, SESSION_CLAIMED_NAME);
+
+    const int claimed_fd = open(claimed_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (claimed_fd < 0) {
+        return errno == EEXIST ? 2 : 1;
+    }
+
+    close(claimed_fd);
+    return 0;
+}
+
+static int tryClaimAny(const char* base, session_t* session)
+{
+    DIR* directory = opendir(base);
+    if (directory == NULL) {
+        return 1;
+    }
+
+    int exit_code = 1;
+    const struct dirent* entry = NULL;
+
+    while (exit_code != 0 && (entry = readdir(directory)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        // Unnamed sessions of reader-writers that died without cleaning up are removed.
+        int owner = 0;
+        char separator = 0;
+        if (sscanf(entry->d_name, "%d%c", &owner, &separator) == 2 && separator == '-'
+            && kill(owner, 0) < 0 && errno == ESRCH) {
+            if (setSessionDirectory(session, base, entry->d_name) == 0) {
+                removeSession(session);
+            }
+            continue;
+        }
+
+        exit_code = tryClaim(base, entry->d_name, session) != 0;
+    }
+
+    closedir(directory);
+    return exit_code;
+}
+
+int claimSession(const char* name, session_t* session)
+{
+    if (name != NULL && !isValidName(name)) {
+        printf("[Session Error] Invalid session name '%s'\n", name);
+        return 1;
+    }
+
+    char base[SESSION_PATH_LENGTH];
+    if (getSessionBase(base, sizeof(base)) != 0) {
+        return 1;
+    }
+
+    // The watch is set up before scanning, so a session published in between isn't missed.
+    const int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, base, IN_MOVED_TO | IN_CREATE) < 0) {
+        printf("[Session Error] Failed to watch session directory '%s': %s\n", base, strerror(errno));
+        if (inotify_fd >= 0) {
+            close(inotify_fd);
+        }
+        return 1;
+    }
+
+    printf("[Session] Waiting for %s%s%s in '%s'\n",
+        name != NULL ? "session '" : "a session", name != NULL ? name : "", name != NULL ? "'" : "", base);
+
+    for (;;) {
+        const int claim_result = name != NULL ? tryClaim(base, name, session) : tryClaimAny(base, session);
+        if (claim_result == 0) {
+            break;
+        }
+
+        // Only the claim tells a taken session from one published right after the attempt.
+        if (claim_result == 2) {
+            printf("[Session Error] Session '%s' is already claimed\n", name);
+            close(inotify_fd);
+            return 1;
+        }
+
+        struct pollfd poll_fd = { inotify_fd, POLLIN, 0 };
+        if (poll(&poll_fd, 1, SESSION_RESCAN_INTERVAL_MS) > 0) {
+            static char events[4096];
+            while (read(inotify_fd, events, sizeof(events)) > 0) {
+            }
+        }
+    }
+
+    close(inotify_fd);
+    printf("[Session] Claimed session '%s'\n", session->directory);
+    return 0;
+}
+
+// Deletes the FIFOs, the claim and the directory itself.
+static void deleteSessionFiles(const session_t* session)
+{
+    for (int i = 0; i < SESSION_FIFO_COUNT; ++i) {
+        unlink(session->fifo_paths[i]);
+    }
+
+    char claimed_path[SESSION_PATH_LENGTH + 16];
+    snprintf(claimed_path, sizeof(claimed_path), "%s/%s", session->directory, SESSION_CLAIMED_NAME);
+    unlink(claimed_path);
+
+    rmdir(session->directory);
+}
+
+void removeSession(const session_t* session)
+{
+    if (session->directory[0] == '\0') {
+        return;
+    }
+
+    const char* slash = strrchr(session->directory, '/');
+    if (slash == NULL || slash[1] == '.') {
+        deleteSessionFiles(session);
+        return;
+    }
+
+    // The session is hidden first: otherwise a handler could claim it
+    // again between deleting the claim and removing the directory.
+    char base[SESSION_PATH_LENGTH];
+    char hidden_name[SESSION_PATH_LENGTH];
+    snprintf(base, sizeof(base), "%.*s", (int)(slash - session->directory), session->directory);
+    snprintf(hidden_name, sizeof(hidden_name), ".%.*s", SESSION_PATH_LENGTH - 2, slash + 1);
+
+    session_t hidden;
+    if (setSessionDirectory(&hidden, base, hidden_name) == 0 && rename(session->directory, hidden.directory) == 0) {
+        deleteSessionFiles(&hidden);
+    } else {
+        deleteSessionFiles(session);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+
+// Session: a private directory holding one set of FIFOs, so that many
+// reader-writer and data handler pairs can run on one machine at once.
+// Sessions live in $XDG_RUNTIME_DIR/mark8 (or /tmp/mark8-<uid> without it)
+// and are named "<reader-writer pid>-<random suffix>" unless named explicitly.
+//
+// Reader-writer creates the FIFOs in a hidden directory and renames it into place,
+// so a session is never seen half-made. Data handler claims a session by creating
+// its "claimed" file with O_EXCL: every session is taken by exactly one handler.
+
+#define SESSION_PATH_LENGTH 4096
+
+enum {
+    SESSION_INPUT_1,
+    SESSION_INPUT_2,
+    SESSION_OUTPUT_1,
+    SESSION_OUTPUT_2,
+    SESSION_FIFO_COUNT
+};
+
+typedef struct {
+    // Empty for FIFOs in the current directory.
+    char directory[SESSION_PATH_LENGTH];
+    char fifo_paths[SESSION_FIFO_COUNT][SESSION_PATH_LENGTH];
+} session_t;
+
+// FIFOs with the fixed names from common.h in the current directory.
+void useCurrentDirectory(session_t* session);
+
+// Reader-writer side: creates the session with all FIFOs. name may be NULL for a unique name.
+int createSession(const char* name, session_t* session);
+
+// Data handler side: waits for the named session (or any unclaimed one if name is NULL) and claims it.
+int claimSession(const char* name, session_t* session);
+
+// Removes the session directory together with its FIFOs. Does nothing for the current directory.
+void removeSession(const session_t* session);
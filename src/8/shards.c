@@ -0,0 +1,140 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "shards.h"
+
+static int appendShard(shard_list_t* shards, size_t* capacity, const char* path)
+{
+    if (shards->count == *capacity) {
+        const size_t new_capacity = *capacity == 0 ? 16 : *capacity * 2;
+        char** paths = realloc(shards->paths, new_capacity * sizeof(*paths));
+        if (paths == NULL) {
+            printf("[Shards Error] Failed to allocate %zu shard paths\n", new_capacity);
+            return 1;
+        }
+
+        shards->paths = paths;
+        *capacity = new_capacity;
+    }
+
+    if ((shards->paths[shards->count] = strdup(path)) == NULL) {
+        printf("[Shards Error] Failed to copy shard path '%s'\n", path);
+        return 1;
+    }
+
+    ++shards->count;
+    return 0;
+}
+
+static int expandListFile(const char* list_path, shard_list_t* shards, size_t* capacity)
+{
+    FILE* list = fopen(list_path, "r");
+    if (list == NULL) {
+        printf("[Shards Error] Failed to open list file '%s': %s\n", list_path, strerror(errno));
+        return 1;
+    }
+
+    int exit_code = 0;
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t length = 0;
+
+    while ((length = getline(&line, &line_size, list)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+
+        if ((exit_code = appendShard(shards, capacity, line)) != 0) {
+            break;
+        }
+    }
+
+    if (exit_code == 0 && ferror(list)) {
+        printf("[Shards Error] Failed to read list file '%s'\n", list_path);
+        exit_code = 1;
+    }
+
+    free(line);
+    fclose(list);
+    return exit_code;
+}
+
+static int expandPattern(const char* pattern, shard_list_t* shards, size_t* capacity)
+{
+    glob_t matches;
+    const int result = glob(pattern, 0, NULL, &matches);
+
+    if (result == GLOB_NOMATCH) {
+        return 0;
+    }
+
+    if (result != 0) {
+        printf("[Shards Error] Failed to expand pattern '%s'\n", pattern);
+        return 1;
+    }
+
+    int exit_code = 0;
+    for (size_t i = 0; i < matches.gl_pathc && exit_code == 0; ++i) {
+        struct stat file_stat;
+        if (stat(matches.gl_pathv[i], &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+            exit_code = appendShard(shards, capacity, matches.gl_pathv[i]);
+        }
+    }
+
+    globfree(&matches);
+    return exit_code;
+}
+
+int expandShards(const char* spec, shard_list_t* shards)
+{
+    shards->paths = NULL;
+    shards->count = 0;
+
+    size_t capacity = 0;
+    int exit_code = 0;
+    struct stat file_stat;
+
+    if (spec[0] == '@') {
+        exit_code = expandListFile(spec + 1, shards, &capacity);
+    } else if (stat(spec, &file_stat) == 0 && S_ISDIR(file_stat.st_mode)) {
+        char* pattern = NULL;
+        if (asprintf(&pattern, "%s/*", spec) < 0) {
+            printf("[Shards Error] Failed to allocate pattern for directory '%s'\n", spec);
+            return 1;
+        }
+
+        exit_code = expandPattern(pattern, shards, &capacity);
+        free(pattern);
+    } else if (strpbrk(spec, "*?[") != NULL) {
+        exit_code = expandPattern(spec, shards, &capacity);
+    } else {
+        exit_code = appendShard(shards, &capacity, spec);
+    }
+
+    if (exit_code != 0) {
+        freeShards(shards);
+    }
+
+    return exit_code;
+}
+
+void freeShards(shard_list_t* shards)
+{
+    for (size_t i = 0; i < shards->count; ++i) {
+        free(shards->paths[i]);
+    }
+
+    free(shards->paths);
+    shards->paths = NULL;
+    shards->count = 0;
+}
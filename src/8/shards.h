@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+
+// Shard files one input argument expands into, in the order they are concatenated.
+typedef struct {
+    char** paths;
+    size_t count;
+} shard_list_t;
+
+// Expands an input argument into shard files:
+// - "@<list_file>" - paths listed in list_file, one per line (empty lines and lines starting with '#' are skipped);
+// - a directory - all regular files in it, sorted by name;
+// - a pattern containing '*', '?' or '[' - matching regular files, sorted by name;
+// - anything else - the file itself.
+int expandShards(const char* spec, shard_list_t* shards);
+void freeShards(shard_list_t* shards);
@@ -0,0 +1,380 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "diff-engine.h"
+#include "spill.h"
+
+// Bounds for the number of partitions: each partition costs two open files.
+#define SPILL_MAX_PARTITIONS 256
+
+// Partitions that don't fit into memory are split again into this many parts,
+// with a different hash seed on every level.
+#define SPILL_REPARTITION_FANOUT 8
+#define SPILL_MAX_DEPTH 6
+
+#define SPILL_DEFAULT_MEMORY_LIMIT ((size_t)256 << 20)
+
+// Token sets allocate their arena by 1 MiB blocks, so smaller limits can't be met.
+#define SPILL_MIN_MEMORY_LIMIT ((size_t)4 << 20)
+
+#define SPILL_MIN_BUFFER_SIZE ((size_t)4 << 10)
+#define SPILL_MAX_BUFFER_SIZE ((size_t)1 << 20)
+
+// Returned by sinks when the in-memory sets grow over the memory limit.
+#define SPILL_OVERFLOW 2
+
+typedef struct {
+    spill_file_t* files;
+    size_t count;
+    uint64_t seed;
+} spill_router_t;
+
+typedef struct {
+    diff_engine_t base;
+
+    const char* directory;
+    size_t memory_limit;
+    size_t partition_count;
+
+    tokenizer_t tokenizers[2];
+    spill_file_t* partitions[2];
+    spill_router_t routers[2];
+
+    token_set_t sets[2];
+    char* read_buffer;
+    size_t read_buffer_size;
+
+    // Result 1 goes straight to its output, result 2 waits in a temporary file
+    // until the output of result 1 is closed.
+    token_writer_t writers[2];
+    int result_2_fd;
+    bool computed;
+
+    size_t repartitions;
+    size_t peak_memory;
+} spill_engine_t;
+
+// Size of an append buffer, all partition buffers together stay within the memory limit.
+static size_t spillBufferSize(size_t memory_limit, size_t partition_count)
+{
+    size_t size = memory_limit / (4 * partition_count);
+
+    if (size < SPILL_MIN_BUFFER_SIZE) {
+        size = SPILL_MIN_BUFFER_SIZE;
+    }
+
+    if (size > SPILL_MAX_BUFFER_SIZE) {
+        size = SPILL_MAX_BUFFER_SIZE;
+    }
+
+    return size;
+}
+
+static int openPartitions(spill_file_t* files, size_t count, const char* directory, size_t buffer_size)
+{
+    for (size_t i = 0; i < count; ++i) {
+        files[i].fd = -1;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (spillFileOpen(&files[i], directory, buffer_size) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void closePartitions(spill_file_t* files, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        spillFileClose(&files[i]);
+    }
+}
+
+// Routes a token to its partition: high hash bits are used, since token sets
+// index their slots by the low bits of the same hash.
+static int routeToken(void* context, const char* token, size_t length)
+{
+    spill_router_t* router = context;
+    const uint64_t hash = hashToken(token, length, router->seed);
+    return spillFileAppend(&router->files[(hash >> 32) % router->count], token, length);
+}
+
+typedef struct {
+    token_set_t* set;
+    const token_set_t* other;
+    size_t memory_limit;
+} bounded_insert_t;
+
+static int insertBounded(void* context, const char* token, size_t length)
+{
+    bounded_insert_t* insert = context;
+
+    if (tokenSetInsert(insert->set, token, length, hashToken(token, length, 0)) != 0) {
+        return 1;
+    }
+
+    if (tokenSetMemoryUsage(insert->set) + tokenSetMemoryUsage(insert->other) > insert->memory_limit) {
+        return SPILL_OVERFLOW;
+    }
+
+    return 0;
+}
+
+static int diffPartitions(spill_engine_t* engine, spill_file_t* partition_1, spill_file_t* partition_2, int depth);
+
+// Splits a pair of partitions that doesn't fit into memory and diffs the parts.
+static int repartition(spill_engine_t* engine, spill_file_t* partition_1, spill_file_t* partition_2, int depth)
+{
+    ++engine->repartitions;
+
+    spill_file_t parts[2][SPILL_REPARTITION_FANOUT];
+    memset(parts, 0, sizeof(parts));
+    for (size_t j = 0; j < SPILL_REPARTITION_FANOUT; ++j) {
+        parts[0][j].fd = -1;
+        parts[1][j].fd = -1;
+    }
+
+    const size_t buffer_size = spillBufferSize(engine->memory_limit, SPILL_REPARTITION_FANOUT);
+
+    int exit_code = openPartitions(parts[0], SPILL_REPARTITION_FANOUT, engine->directory, buffer_size)
+        || openPartitions(parts[1], SPILL_REPARTITION_FANOUT, engine->directory, buffer_size);
+
+    spill_file_t* sources[2] = { partition_1, partition_2 };
+    for (int i = 0; i < 2 && exit_code == 0; ++i) {
+        spill_router_t router = { parts[i], SPILL_REPARTITION_FANOUT, (uint64_t)depth + 1 };
+        exit_code = spillFileForEach(sources[i], &engine->read_buffer, &engine->read_buffer_size,
+            routeToken, &router);
+
+        for (size_t j = 0; j < SPILL_REPARTITION_FANOUT && exit_code == 0; ++j) {
+            exit_code = spillFileFinish(&parts[i][j]);
+        }
+    }
+
+    for (size_t j = 0; j < SPILL_REPARTITION_FANOUT && exit_code == 0; ++j) {
+        exit_code = diffPartitions(engine, &parts[0][j], &parts[1][j], depth + 1);
+    }
+
+    closePartitions(parts[0], SPILL_REPARTITION_FANOUT);
+    closePartitions(parts[1], SPILL_REPARTITION_FANOUT);
+
+    return exit_code;
+}
+
+// Loads a pair of partitions into the token sets and writes both differences.
+static int diffPartitions(spill_engine_t* engine, spill_file_t* partition_1, spill_file_t* partition_2, int depth)
+{
+    tokenSetClear(&engine->sets[0]);
+    tokenSetClear(&engine->sets[1]);
+
+    // Past the depth limit partitions are most likely made of a few huge tokens,
+    // splitting them further won't help, so the memory limit is exceeded instead.
+    const size_t memory_limit = depth < SPILL_MAX_DEPTH ? engine->memory_limit : SIZE_MAX;
+    if (depth == SPILL_MAX_DEPTH) {
+        printf("[Spill Engine] Partition pair of %llu and %llu bytes doesn't fit into %zu bytes, "
+               "exceeding the memory limit\n",
+            (unsigned long long)partition_1->bytes, (unsigned long long)partition_2->bytes,
+            engine->memory_limit);
+    }
+
+    spill_file_t* partitions[2] = { partition_1, partition_2 };
+    for (int i = 0; i < 2; ++i) {
+        bounded_insert_t insert = { &engine->sets[i], &engine->sets[1 - i], memory_limit };
+
+        const int result = spillFileForEach(partitions[i], &engine->read_buffer, &engine->read_buffer_size,
+            insertBounded, &insert);
+        if (result == SPILL_OVERFLOW) {
+            return repartition(engine, partition_1, partition_2, depth);
+        }
+
+        if (result != 0) {
+            return 1;
+        }
+    }
+
+    const size_t memory = tokenSetMemoryUsage(&engine->sets[0]) + tokenSetMemoryUsage(&engine->sets[1]);
+    if (memory > engine->peak_memory) {
+        engine->peak_memory = memory;
+    }
+
+    return writeSetDifference(&engine->sets[0], &engine->sets[1], &engine->writers[0])
+        || writeSetDifference(&engine->sets[1], &engine->sets[0], &engine->writers[1]);
+}
+
+static int spillEngineConsume(diff_engine_t* engine, int stream, const char* data, size_t length)
+{
+    spill_engine_t* spill_engine = (spill_engine_t*)engine;
+    return tokenizerFeed(&spill_engine->tokenizers[stream], data, length,
+        routeToken, &spill_engine->routers[stream]);
+}
+
+static int spillEngineFinish(diff_engine_t* engine, int stream)
+{
+    spill_engine_t* spill_engine = (spill_engine_t*)engine;
+
+    if (tokenizerFinish(&spill_engine->tokenizers[stream], routeToken, &spill_engine->routers[stream]) != 0) {
+        return 1;
+    }
+
+    // Append buffers aren't needed anymore, release their memory for token sets.
+    for (size_t i = 0; i < spill_engine->partition_count; ++i) {
+        if (spillFileFinish(&spill_engine->partitions[stream][i]) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int copyFile(int input_fd, int output_fd)
+{
+    static char buffer[BUFFER_SIZE];
+
+    if (lseek(input_fd, 0, SEEK_SET) < 0) {
+        printf("[Spill Engine Error] Failed to rewind result file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    ssize_t read_bytes = 0;
+    while ((read_bytes = read(input_fd, buffer, sizeof(buffer))) != 0) {
+        if (read_bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Spill Engine Error] Failed to read result file: %s\n", strerror(errno));
+            return 1;
+        }
+
+        if (writeAll(output_fd, buffer, read_bytes) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int spillEngineEmit(diff_engine_t* engine, int result, int fd)
+{
+    spill_engine_t* spill_engine = (spill_engine_t*)engine;
+
+    if (result == 1) {
+        if (!spill_engine->computed) {
+            printf("[Spill Engine Error] Result 2 requested before result 1\n");
+            return 1;
+        }
+
+        return copyFile(spill_engine->result_2_fd, fd);
+    }
+
+    tokenWriterInit(&spill_engine->writers[0], fd);
+    tokenWriterInit(&spill_engine->writers[1], spill_engine->result_2_fd);
+
+    uint64_t spilled_bytes = 0;
+    for (size_t i = 0; i < spill_engine->partition_count; ++i) {
+        spilled_bytes += spill_engine->partitions[0][i].bytes + spill_engine->partitions[1][i].bytes;
+
+        if (diffPartitions(spill_engine, &spill_engine->partitions[0][i], &spill_engine->partitions[1][i], 0) != 0) {
+            return 1;
+        }
+
+        // Partition files are consumed, free the disk space early.
+        spillFileClose(&spill_engine->partitions[0][i]);
+        spillFileClose(&spill_engine->partitions[1][i]);
+    }
+
+    if (flushTokens(&spill_engine->writers[0]) != 0 || flushTokens(&spill_engine->writers[1]) != 0) {
+        return 1;
+    }
+
+    spill_engine->computed = true;
+
+    printf("[Spill Engine] Diffed %zu partitions of %llu spilled bytes, %zu repartitions, "
+           "peak token set memory %zu of %zu bytes\n",
+        spill_engine->partition_count, (unsigned long long)spilled_bytes,
+        spill_engine->repartitions, spill_engine->peak_memory, spill_engine->memory_limit);
+
+    return 0;
+}
+
+static void spillEngineDestroy(diff_engine_t* engine)
+{
+    spill_engine_t* spill_engine = (spill_engine_t*)engine;
+
+    for (int i = 0; i < 2; ++i) {
+        tokenizerFree(&spill_engine->tokenizers[i]);
+        tokenSetFree(&spill_engine->sets[i]);
+
+        if (spill_engine->partitions[i] != NULL) {
+            closePartitions(spill_engine->partitions[i], spill_engine->partition_count);
+            free(spill_engine->partitions[i]);
+        }
+    }
+
+    if (spill_engine->result_2_fd != -1) {
+        close(spill_engine->result_2_fd);
+    }
+
+    free(spill_engine->read_buffer);
+    free(spill_engine);
+}
+
+diff_engine_t* createSpillEngine(const diff_engine_options_t* options)
+{
+    spill_engine_t* engine = calloc(1, sizeof(*engine));
+    if (engine == NULL) {
+        printf("[Engine Error] Failed to allocate spill engine\n");
+        return NULL;
+    }
+
+    engine->base.consume = spillEngineConsume;
+    engine->base.finish = spillEngineFinish;
+    engine->base.emit = spillEngineEmit;
+    engine->base.destroy = spillEngineDestroy;
+    engine->result_2_fd = -1;
+
+    engine->directory = options->spill_directory;
+    engine->memory_limit = options->memory_limit != 0 ? options->memory_limit : SPILL_DEFAULT_MEMORY_LIMIT;
+    if (engine->memory_limit < SPILL_MIN_MEMORY_LIMIT) {
+        printf("[Spill Engine] Memory limit raised to the minimum of %zu bytes\n", SPILL_MIN_MEMORY_LIMIT);
+        engine->memory_limit = SPILL_MIN_MEMORY_LIMIT;
+    }
+
+    engine->partition_count = options->spill_partitions;
+    if (engine->partition_count > SPILL_MAX_PARTITIONS) {
+        printf("[Spill Engine] Partition count lowered to the maximum of %d\n", SPILL_MAX_PARTITIONS);
+        engine->partition_count = SPILL_MAX_PARTITIONS;
+    }
+
+    const size_t buffer_size = spillBufferSize(engine->memory_limit, engine->partition_count);
+
+    for (int i = 0; i < 2; ++i) {
+        tokenizerInit(&engine->tokenizers[i], options->tokenizer_mode, options->ngram_length);
+
+        engine->partitions[i] = calloc(engine->partition_count, sizeof(spill_file_t));
+        if (engine->partitions[i] == NULL
+            || openPartitions(engine->partitions[i], engine->partition_count, engine->directory, buffer_size) != 0
+            || tokenSetInit(&engine->sets[i], 0) != 0) {
+            printf("[Engine Error] Failed to set up spill partitions\n");
+            spillEngineDestroy(&engine->base);
+            return NULL;
+        }
+
+        engine->routers[i].files = engine->partitions[i];
+        engine->routers[i].count = engine->partition_count;
+        engine->routers[i].seed = 0;
+    }
+
+    engine->result_2_fd = createTemporaryFile(engine->directory);
+    if (engine->result_2_fd < 0) {
+        spillEngineDestroy(&engine->base);
+        return NULL;
+    }
+
+    return &engine->base;
+}
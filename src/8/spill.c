@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "diff-engine.h"
+#include "spill.h"
+
+size_t parseSize(const char* text)
+{
+    char* end = NULL;
+    unsigned long long size = strtoull(text, &end, 10);
+
+    switch (*end) {
+    case 'G':
+    case 'g':
+        size *= 1024;
+        // fall through
+    case 'M':
+    case 'm':
+        size *= 1024;
+        // fall through
+    case 'K':
+    case 'k':
+        size *= 1024;
+        ++end;
+        break;
+    default:
+        break;
+    }
+
+    return *end == '\0' ? (size_t)size : 0;
+}
+
+int createTemporaryFile(const char* directory)
+{
+    if (directory == NULL) {
+        directory = getenv("TMPDIR");
+    }
+
+    if (directory == NULL || *directory == '\0') {
+        directory = "/tmp";
+    }
+
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/mark8-spill-XXXXXX", directory) >= (int)sizeof(path)) {
+        printf("[Spill Error] Spill directory path '%s' is too long\n", directory);
+        return -1;
+    }
+
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("[Spill Error] Failed to create temporary file in '%s': %s\n", directory, strerror(errno));
+        return -1;
+    }
+
+    // Nobody needs the name: the file lives until its descriptor is closed.
+    unlink(path);
+    return fd;
+}
+
+int spillFileOpen(spill_file_t* file, const char* directory, size_t buffer_size)
+{
+    memset(file, 0, sizeof(*file));
+
+    file->buffer = malloc(buffer_size);
+    if (file->buffer == NULL) {
+        printf("[Spill Error] Failed to allocate spill buffer of %zu bytes\n", buffer_size);
+        file->fd = -1;
+        return 1;
+    }
+
+    file->capacity = buffer_size;
+    file->fd = createTemporaryFile(directory);
+    return file->fd < 0;
+}
+
+void spillFileClose(spill_file_t* file)
+{
+    if (file->fd != -1) {
+        close(file->fd);
+        file->fd = -1;
+    }
+
+    free(file->buffer);
+    file->buffer = NULL;
+}
+
+static int flushSpill(spill_file_t* file)
+{
+    if (writeAll(file->fd, file->buffer, file->length) != 0) {
+        printf("[Spill Error] Failed to write %zu bytes to spill file\n", file->length);
+        return 1;
+    }
+
+    file->length = 0;
+    return 0;
+}
+
+int spillFileAppend(spill_file_t* file, const char* token, size_t length)
+{
+    if (length > UINT32_MAX) {
+        printf("[Spill Error] Token of %zu bytes is too long\n", length);
+        return 1;
+    }
+
+    const uint32_t header = (uint32_t)length;
+    const size_t record_size = sizeof(header) + length;
+
+    if (file->length + record_size > file->capacity && flushSpill(file) != 0) {
+        return 1;
+    }
+
+    if (record_size > file->capacity) {
+        // Record is bigger than the whole buffer, bypass it.
+        if (writeAll(file->fd, (const char*)&header, sizeof(header)) != 0
+            || writeAll(file->fd, token, length) != 0) {
+            return 1;
+        }
+    } else {
+        memcpy(file->buffer + file->length, &header, sizeof(header));
+        memcpy(file->buffer + file->length + sizeof(header), token, length);
+        file->length += record_size;
+    }
+
+    file->bytes += record_size;
+    ++file->records;
+    return 0;
+}
+
+int spillFileFinish(spill_file_t* file)
+{
+    if (file->buffer == NULL) {
+        return 0;
+    }
+
+    const int result = flushSpill(file);
+
+    free(file->buffer);
+    file->buffer = NULL;
+    file->capacity = 0;
+
+    return result;
+}
+
+int spillFileForEach(spill_file_t* file, char** read_buffer, size_t* read_buffer_size,
+    token_sink_t sink, void* context)
+{
+    if (lseek(file->fd, 0, SEEK_SET) < 0) {
+        printf("[Spill Error] Failed to rewind spill file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    size_t begin = 0;
+    size_t end = 0;
+    uint64_t remaining = file->bytes;
+
+    while (begin < end || remaining > 0) {
+        uint32_t length = 0;
+        size_t available = end - begin;
+
+        if (available >= sizeof(length)) {
+            memcpy(&length, *read_buffer + begin, sizeof(length));
+        }
+
+        const size_t needed = available >= sizeof(length) ? sizeof(length) + length : sizeof(length);
+        if (available >= needed) {
+            const int result = sink(context, *read_buffer + begin + sizeof(length), length);
+            if (result != 0) {
+                return result;
+            }
+
+            begin += needed;
+            continue;
+        }
+
+        // Record is incomplete: move it to the front and read more.
+        if (available > 0) {
+            memmove(*read_buffer, *read_buffer + begin, available);
+        }
+
+        begin = 0;
+        end = available;
+
+        if (needed > *read_buffer_size) {
+            size_t size = *read_buffer_size == 0 ? BUFFER_SIZE : *read_buffer_size;
+            while (size < needed) {
+                size *= 2;
+            }
+
+            char* buffer = realloc(*read_buffer, size);
+            if (buffer == NULL) {
+                printf("[Spill Error] Failed to grow read buffer to %zu bytes\n", size);
+                return 1;
+            }
+
+            *read_buffer = buffer;
+            *read_buffer_size = size;
+        }
+
+        if (remaining == 0) {
+            printf("[Spill Error] Spill file ends in the middle of a record\n");
+            return 1;
+        }
+
+        const ssize_t read_result = read(file->fd, *read_buffer + end, *read_buffer_size - end);
+        if (read_result <= 0) {
+            if (read_result < 0 && errno == EINTR) {
+                continue;
+            }
+
+            printf("[Spill Error] Failed to read spill file: %s\n",
+                read_result < 0 ? strerror(errno) : "unexpected end of file");
+            return 1;
+        }
+
+        end += read_result;
+        remaining -= read_result;
+    }
+
+    return 0;
+}
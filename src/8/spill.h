@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tokenizer.h"
+
+// Anonymous temporary file of length-prefixed token records.
+// Appends are buffered, the file is unlinked right after creation,
+// so it disappears together with its last descriptor.
+typedef struct {
+    int fd;
+
+    char* buffer;
+    size_t length;
+    size_t capacity;
+
+    uint64_t bytes;
+    uint64_t records;
+} spill_file_t;
+
+// Parses a size with an optional K, M or G suffix. Returns 0 on failure.
+size_t parseSize(const char* text);
+
+// Creates a spill file in directory (TMPDIR or /tmp if NULL) with an append buffer of buffer_size.
+int spillFileOpen(spill_file_t* file, const char* directory, size_t buffer_size);
+void spillFileClose(spill_file_t* file);
+
+int spillFileAppend(spill_file_t* file, const char* token, size_t length);
+
+// Flushes pending records and drops the append buffer.
+int spillFileFinish(spill_file_t* file);
+
+// Passes every record of a finished file to sink in append order.
+// read_buffer is a scratch buffer grown as needed to fit the longest record.
+int spillFileForEach(spill_file_t* file, char** read_buffer, size_t* read_buffer_size,
+    token_sink_t sink, void* context);
+
+// Creates an anonymous temporary file for raw data.
+int createTemporaryFile(const char* directory);
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diff-engine.h"
+
+typedef struct {
+    diff_engine_t base;
+
+    tokenizer_t tokenizers[2];
+    token_set_t sets[2];
+} token_engine_t;
+
+static int insertToken(void* context, const char* token, size_t length)
+{
+    token_set_t* set = context;
+    return tokenSetInsert(set, token, length, hashToken(token, length, 0));
+}
+
+static int tokenEngineConsume(diff_engine_t* engine, int stream, const char* data, size_t length)
+{
+    token_engine_t* token_engine = (token_engine_t*)engine;
+    return tokenizerFeed(&token_engine->tokenizers[stream], data, length,
+        insertToken, &token_engine->sets[stream]);
+}
+
+static int tokenEngineFinish(diff_engine_t* engine, int stream)
+{
+    token_engine_t* token_engine = (token_engine_t*)engine;
+    if (tokenizerFinish(&token_engine->tokenizers[stream], insertToken, &token_engine->sets[stream]) != 0) {
+        return 1;
+    }
+
+    // Both streams usually come from the same domain, so the finished stream's
+    // cardinality is the best guess for the other one: presizing its set saves
+    // the rehashes a growing table would do.
+    token_set_t* other = &token_engine->sets[1 - stream];
+    if (other->count == 0) {
+        return tokenSetReserve(other, token_engine->sets[stream].count);
+    }
+
+    return 0;
+}
+
+int writeSetDifference(const token_set_t* including, const token_set_t* excluding, token_writer_t* writer)
+{
+    token_set_iterator_t iterator;
+    tokenSetIterate(including, &iterator);
+
+    const token_record_t* record = NULL;
+    while ((record = tokenSetIteratorNext(&iterator)) != NULL) {
+        if (!tokenSetContains(excluding, record->data, record->length, record->hash)
+            && writeToken(writer, record->data, record->length) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int tokenEngineEmit(diff_engine_t* engine, int result, int fd)
+{
+    token_engine_t* token_engine = (token_engine_t*)engine;
+
+    printf("[Token Engine] Result %d: %zu and %zu distinct tokens, %zu bytes of sets\n",
+        result + 1, token_engine->sets[0].count, token_engine->sets[1].count,
+        tokenSetMemoryUsage(&token_engine->sets[0]) + tokenSetMemoryUsage(&token_engine->sets[1]));
+
+    static token_writer_t writer;
+    tokenWriterInit(&writer, fd);
+
+    return writeSetDifference(&token_engine->sets[result], &token_engine->sets[1 - result], &writer)
+        || flushTokens(&writer);
+}
+
+static void tokenEngineDestroy(diff_engine_t* engine)
+{
+    token_engine_t* token_engine = (token_engine_t*)engine;
+
+    for (int i = 0; i < 2; ++i) {
+        tokenizerFree(&token_engine->tokenizers[i]);
+        tokenSetFree(&token_engine->sets[i]);
+    }
+
+    free(token_engine);
+}
+
+diff_engine_t* createTokenEngine(const diff_engine_options_t* options)
+{
+    token_engine_t* engine = calloc(1, sizeof(*engine));
+    if (engine == NULL) {
+        printf("[Engine Error] Failed to allocate token engine\n");
+        return NULL;
+    }
+
+    engine->base.consume = tokenEngineConsume;
+    engine->base.finish = tokenEngineFinish;
+    engine->base.emit = tokenEngineEmit;
+    engine->base.destroy = tokenEngineDestroy;
+
+    for (int i = 0; i < 2; ++i) {
+        tokenizerInit(&engine->tokenizers[i], options->tokenizer_mode, options->ngram_length);
+
+        if (tokenSetInit(&engine->sets[i], options->expected_tokens) != 0) {
+            tokenEngineDestroy(&engine->base);
+            return NULL;
+        }
+    }
+
+    return &engine->base;
+}
@@ -0,0 +1,292 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "token-set.h"
+
+// Size of a regular arena block, longer tokens get a dedicated block.
+#define TOKEN_ARENA_BLOCK_SIZE (1 << 20)
+
+// Minimal slot array size, must be a power of two.
+#define TOKEN_SET_MIN_CAPACITY 16
+
+// Load factor is kept below 3/4 to keep linear probe sequences short.
+#define TOKEN_SET_LOAD_NUMERATOR 3
+#define TOKEN_SET_LOAD_DENOMINATOR 4
+
+uint64_t hashToken(const char* token, size_t length, uint64_t seed)
+{
+    // MurmurHash64A: processes the token by 8-byte words.
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    uint64_t h = seed ^ (length * m);
+
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t k;
+        memcpy(&k, token + i, sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char* tail = (const unsigned char*)token + i;
+    switch (length & 7) {
+    case 7:
+        h ^= (uint64_t)tail[6] << 48;
+        // fall through
+    case 6:
+        h ^= (uint64_t)tail[5] << 40;
+        // fall through
+    case 5:
+        h ^= (uint64_t)tail[4] << 32;
+        // fall through
+    case 4:
+        h ^= (uint64_t)tail[3] << 24;
+        // fall through
+    case 3:
+        h ^= (uint64_t)tail[2] << 16;
+        // fall through
+    case 2:
+        h ^= (uint64_t)tail[1] << 8;
+        // fall through
+    case 1:
+        h ^= (uint64_t)tail[0];
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+// Smallest power of two capacity holding expected_count tokens under the load factor.
+static size_t capacityFor(size_t expected_count)
+{
+    const size_t required = expected_count / TOKEN_SET_LOAD_NUMERATOR * TOKEN_SET_LOAD_DENOMINATOR + 1;
+
+    size_t capacity = TOKEN_SET_MIN_CAPACITY;
+    while (capacity < required) {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+int tokenSetInit(token_set_t* set, size_t expected_count)
+{
+    memset(set, 0, sizeof(*set));
+
+    set->capacity = capacityFor(expected_count);
+    set->slots = calloc(set->capacity, sizeof(*set->slots));
+    if (set->slots == NULL) {
+        printf("[Token Set Error] Failed to allocate %zu slots\n", set->capacity);
+        set->capacity = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+void tokenSetFree(token_set_t* set)
+{
+    token_arena_block_t* block = set->first_block;
+    while (block != NULL) {
+        token_arena_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
+
+void tokenSetClear(token_set_t* set)
+{
+    memset(set->slots, 0, set->capacity * sizeof(*set->slots));
+    set->count = 0;
+
+    if (set->first_block == NULL) {
+        return;
+    }
+
+    token_arena_block_t* block = set->first_block->next;
+    while (block != NULL) {
+        token_arena_block_t* next = block->next;
+        set->arena_bytes -= sizeof(*block) + block->capacity;
+        free(block);
+        block = next;
+    }
+
+    set->first_block->next = NULL;
+    set->first_block->used = 0;
+    set->last_block = set->first_block;
+}
+
+// Rehashes all records into a slot array of the given capacity.
+static int rehash(token_set_t* set, size_t capacity)
+{
+    token_record_t** slots = calloc(capacity, sizeof(*slots));
+    if (slots == NULL) {
+        printf("[Token Set Error] Failed to allocate %zu slots\n", capacity);
+        return 1;
+    }
+
+    const size_t mask = capacity - 1;
+    for (size_t i = 0; i < set->capacity; ++i) {
+        token_record_t* record = set->slots[i];
+        if (record == NULL) {
+            continue;
+        }
+
+        size_t index = record->hash & mask;
+        while (slots[index] != NULL) {
+            index = (index + 1) & mask;
+        }
+
+        slots[index] = record;
+    }
+
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+    return 0;
+}
+
+int tokenSetReserve(token_set_t* set, size_t expected_count)
+{
+    const size_t capacity = capacityFor(expected_count);
+    if (capacity <= set->capacity) {
+        return 0;
+    }
+
+    return rehash(set, capacity);
+}
+
+static size_t recordSize(size_t length)
+{
+    const size_t size = offsetof(token_record_t, data) + length;
+    return (size + 7) & ~(size_t)7;
+}
+
+static token_record_t* allocateRecord(token_set_t* set, size_t length)
+{
+    const size_t size = recordSize(length);
+
+    token_arena_block_t* block = set->last_block;
+    if (block == NULL || block->used + size > block->capacity) {
+        const size_t capacity = size > TOKEN_ARENA_BLOCK_SIZE ? size : TOKEN_ARENA_BLOCK_SIZE;
+
+        block = malloc(sizeof(*block) + capacity);
+        if (block == NULL) {
+            printf("[Token Set Error] Failed to allocate arena block of %zu bytes\n", capacity);
+            return NULL;
+        }
+
+        block->next = NULL;
+        block->used = 0;
+        block->capacity = capacity;
+
+        if (set->last_block != NULL) {
+            set->last_block->next = block;
+        } else {
+            set->first_block = block;
+        }
+
+        set->last_block = block;
+        set->arena_bytes += sizeof(*block) + capacity;
+    }
+
+    token_record_t* record = (token_record_t*)(block->data + block->used);
+    block->used += size;
+    return record;
+}
+
+// Returns the slot holding the token or the empty slot where it belongs.
+static size_t findSlot(const token_set_t* set, const char* token, size_t length, uint64_t hash)
+{
+    const size_t mask = set->capacity - 1;
+    size_t index = hash & mask;
+
+    for (;;) {
+        const token_record_t* record = set->slots[index];
+        if (record == NULL
+            || (record->hash == hash && record->length == length
+                && memcmp(record->data, token, length) == 0)) {
+            return index;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+int tokenSetInsert(token_set_t* set, const char* token, size_t length, uint64_t hash)
+{
+    if (length > UINT32_MAX) {
+        printf("[Token Set Error] Token of %zu bytes is too long\n", length);
+        return 1;
+    }
+
+    if ((set->count + 1) * TOKEN_SET_LOAD_DENOMINATOR > set->capacity * TOKEN_SET_LOAD_NUMERATOR
+        && rehash(set, set->capacity * 2) != 0) {
+        return 1;
+    }
+
+    const size_t index = findSlot(set, token, length, hash);
+    if (set->slots[index] != NULL) {
+        return 0;
+    }
+
+    token_record_t* record = allocateRecord(set, length);
+    if (record == NULL) {
+        return 1;
+    }
+
+    record->hash = hash;
+    record->length = (uint32_t)length;
+    memcpy(record->data, token, length);
+
+    set->slots[index] = record;
+    ++set->count;
+    return 0;
+}
+
+bool tokenSetContains(const token_set_t* set, const char* token, size_t length, uint64_t hash)
+{
+    return set->slots[findSlot(set, token, length, hash)] != NULL;
+}
+
+size_t tokenSetMemoryUsage(const token_set_t* set)
+{
+    return set->capacity * sizeof(*set->slots) + set->arena_bytes;
+}
+
+void tokenSetIterate(const token_set_t* set, token_set_iterator_t* iterator)
+{
+    iterator->block = set->first_block;
+    iterator->offset = 0;
+}
+
+const token_record_t* tokenSetIteratorNext(token_set_iterator_t* iterator)
+{
+    while (iterator->block != NULL && iterator->offset >= iterator->block->used) {
+        iterator->block = iterator->block->next;
+        iterator->offset = 0;
+    }
+
+    if (iterator->block == NULL) {
+        return NULL;
+    }
+
+    const token_record_t* record = (const token_record_t*)(iterator->block->data + iterator->offset);
+    iterator->offset += recordSize(record->length);
+    return record;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Token bytes are stored in an arena right after this header,
+// records are laid out in insertion order.
+typedef struct {
+    uint64_t hash;
+    uint32_t length;
+    char data[];
+} token_record_t;
+
+typedef struct token_arena_block {
+    struct token_arena_block* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} token_arena_block_t;
+
+// Hash set of tokens: open addressing with linear probing over an array of
+// record pointers. Records are bump-allocated from arena blocks, so there's
+// no per-token malloc and iteration follows insertion order.
+typedef struct {
+    token_record_t** slots;
+    size_t capacity;
+    size_t count;
+
+    token_arena_block_t* first_block;
+    token_arena_block_t* last_block;
+    size_t arena_bytes;
+} token_set_t;
+
+// Hashes a token, seed allows independent hash functions over the same token.
+uint64_t hashToken(const char* token, size_t length, uint64_t seed);
+
+// Initializes an empty set sized for expected_count distinct tokens (may be 0).
+int tokenSetInit(token_set_t* set, size_t expected_count);
+void tokenSetFree(token_set_t* set);
+
+// Clears the set keeping its slot array and first arena block for reuse.
+void tokenSetClear(token_set_t* set);
+
+// Grows the slot array so that expected_count tokens fit without rehashing.
+int tokenSetReserve(token_set_t* set, size_t expected_count);
+
+// Inserts a token with precomputed hashToken(token, length, 0) hash.
+// Returns 0 on success (including the case when the token is already present).
+int tokenSetInsert(token_set_t* set, const char* token, size_t length, uint64_t hash);
+
+bool tokenSetContains(const token_set_t* set, const char* token, size_t length, uint64_t hash);
+
+// Approximate amount of memory held by the set.
+size_t tokenSetMemoryUsage(const token_set_t* set);
+
+// Iterates records in insertion order.
+typedef struct {
+    const token_arena_block_t* block;
+    size_t offset;
+} token_set_iterator_t;
+
+void tokenSetIterate(const token_set_t* set, token_set_iterator_t* iterator);
+
+// Returns NULL after the last record.
+const token_record_t* tokenSetIteratorNext(token_set_iterator_t* iterator);
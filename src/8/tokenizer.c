@@ -0,0 +1,211 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tokenizer.h"
+
+int parseTokenizerSpec(const char* spec, tokenizer_mode_t* mode, size_t* ngram_length)
+{
+    *ngram_length = 0;
+
+    if (strcmp(spec, "bytes") == 0) {
+        *mode = TOKENIZER_BYTES;
+        return 0;
+    }
+
+    if (strcmp(spec, "words") == 0) {
+        *mode = TOKENIZER_WORDS;
+        return 0;
+    }
+
+    if (strcmp(spec, "lines") == 0) {
+        *mode = TOKENIZER_LINES;
+        return 0;
+    }
+
+    static const char ngrams_prefix[] = "ngrams:";
+    if (strncmp(spec, ngrams_prefix, sizeof(ngrams_prefix) - 1) == 0) {
+        char* end = NULL;
+        const unsigned long length = strtoul(spec + sizeof(ngrams_prefix) - 1, &end, 10);
+        if (*end != '\0' || length == 0 || length > TOKENIZER_MAX_NGRAM_LENGTH) {
+            return 1;
+        }
+
+        *mode = TOKENIZER_NGRAMS;
+        *ngram_length = length;
+        return 0;
+    }
+
+    return 1;
+}
+
+void tokenizerInit(tokenizer_t* tokenizer, tokenizer_mode_t mode, size_t ngram_length)
+{
+    tokenizer->mode = mode;
+    tokenizer->ngram_length = mode == TOKENIZER_NGRAMS ? ngram_length : 1;
+    tokenizer->carry = NULL;
+    tokenizer->carry_length = 0;
+    tokenizer->carry_capacity = 0;
+}
+
+void tokenizerFree(tokenizer_t* tokenizer)
+{
+    free(tokenizer->carry);
+    tokenizer->carry = NULL;
+    tokenizer->carry_length = 0;
+    tokenizer->carry_capacity = 0;
+}
+
+// Appends data to the carry buffer, growing it geometrically.
+static int appendCarry(tokenizer_t* tokenizer, const char* data, size_t length)
+{
+    if (tokenizer->carry_length + length > tokenizer->carry_capacity) {
+        size_t capacity = tokenizer->carry_capacity == 0 ? 64 : tokenizer->carry_capacity;
+        while (capacity < tokenizer->carry_length + length) {
+            capacity *= 2;
+        }
+
+        char* carry = realloc(tokenizer->carry, capacity);
+        if (carry == NULL) {
+            printf("[Tokenizer Error] Failed to grow carry buffer to %zu bytes\n", capacity);
+            return 1;
+        }
+
+        tokenizer->carry = carry;
+        tokenizer->carry_capacity = capacity;
+    }
+
+    memcpy(tokenizer->carry + tokenizer->carry_length, data, length);
+    tokenizer->carry_length += length;
+    return 0;
+}
+
+static bool isDelimiter(tokenizer_mode_t mode, unsigned char c)
+{
+    if (mode == TOKENIZER_LINES) {
+        return c == '\n';
+    }
+
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Words and lines: tokens are maximal runs of non-delimiter bytes.
+// Empty tokens are skipped.
+static int feedDelimited(tokenizer_t* tokenizer, const char* data, size_t length,
+    token_sink_t sink, void* context)
+{
+    size_t start = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+        if (!isDelimiter(tokenizer->mode, (unsigned char)data[i])) {
+            continue;
+        }
+
+        int result = 0;
+        if (tokenizer->carry_length > 0) {
+            // Token started in one of the previous chunks.
+            if (appendCarry(tokenizer, data + start, i - start) != 0) {
+                return 1;
+            }
+
+            result = sink(context, tokenizer->carry, tokenizer->carry_length);
+            tokenizer->carry_length = 0;
+        } else if (i > start) {
+            result = sink(context, data + start, i - start);
+        }
+
+        if (result != 0) {
+            return result;
+        }
+
+        start = i + 1;
+    }
+
+    return appendCarry(tokenizer, data + start, length - start);
+}
+
+// N-grams: every window of N consecutive bytes of the stream is a token.
+// Last N - 1 bytes are carried over to form windows crossing chunk borders.
+static int feedNgrams(tokenizer_t* tokenizer, const char* data, size_t length,
+    token_sink_t sink, void* context)
+{
+    const size_t n = tokenizer->ngram_length;
+    int result = 0;
+
+    // Windows that start inside the carry and end inside data.
+    if (tokenizer->carry_length > 0) {
+        char window[2 * TOKENIZER_MAX_NGRAM_LENGTH];
+        const size_t taken = length < n - 1 ? length : n - 1;
+
+        memcpy(window, tokenizer->carry, tokenizer->carry_length);
+        memcpy(window + tokenizer->carry_length, data, taken);
+
+        const size_t window_length = tokenizer->carry_length + taken;
+        for (size_t i = 0; i < tokenizer->carry_length && i + n <= window_length; ++i) {
+            if ((result = sink(context, window + i, n)) != 0) {
+                return result;
+            }
+        }
+    }
+
+    // Windows fully inside data.
+    for (size_t i = 0; i + n <= length; ++i) {
+        if ((result = sink(context, data + i, n)) != 0) {
+            return result;
+        }
+    }
+
+    // Keep the last N - 1 bytes of the stream.
+    if (length >= n - 1) {
+        tokenizer->carry_length = 0;
+        return appendCarry(tokenizer, data + length - (n - 1), n - 1);
+    }
+
+    if (appendCarry(tokenizer, data, length) != 0) {
+        return 1;
+    }
+
+    if (tokenizer->carry_length > n - 1) {
+        const size_t excess = tokenizer->carry_length - (n - 1);
+        memmove(tokenizer->carry, tokenizer->carry + excess, n - 1);
+        tokenizer->carry_length = n - 1;
+    }
+
+    return 0;
+}
+
+int tokenizerFeed(tokenizer_t* tokenizer, const char* data, size_t length,
+    token_sink_t sink, void* context)
+{
+    switch (tokenizer->mode) {
+    case TOKENIZER_BYTES:
+        for (size_t i = 0; i < length; ++i) {
+            const int result = sink(context, data + i, 1);
+            if (result != 0) {
+                return result;
+            }
+        }
+        return 0;
+    case TOKENIZER_WORDS:
+    case TOKENIZER_LINES:
+        return feedDelimited(tokenizer, data, length, sink, context);
+    case TOKENIZER_NGRAMS:
+        return feedNgrams(tokenizer, data, length, sink, context);
+    }
+
+    return 1;
+}
+
+int tokenizerFinish(tokenizer_t* tokenizer, token_sink_t sink, void* context)
+{
+    int result = 0;
+
+    // An n-gram carry is a stream tail shorter than N, so it's not a token.
+    if (tokenizer->mode != TOKENIZER_NGRAMS && tokenizer->carry_length > 0) {
+        result = sink(context, tokenizer->carry, tokenizer->carry_length);
+    }
+
+    tokenizer->carry_length = 0;
+    return result;
+}
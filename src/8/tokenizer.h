@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef enum {
+    TOKENIZER_BYTES,
+    TOKENIZER_WORDS,
+    TOKENIZER_LINES,
+    TOKENIZER_NGRAMS
+} tokenizer_mode_t;
+
+// Upper bound for n-gram length, keeps the crossing-window buffer on the stack.
+#define TOKENIZER_MAX_NGRAM_LENGTH 256
+
+// Receives every token produced by a tokenizer.
+// Token memory is only valid during the call.
+// Non-zero return value aborts tokenizing and is passed back to the caller.
+typedef int (*token_sink_t)(void* context, const char* token, size_t length);
+
+// Streaming tokenizer: chunks may split tokens at arbitrary positions,
+// the unfinished tail of a chunk is carried over to the next one.
+typedef struct {
+    tokenizer_mode_t mode;
+    size_t ngram_length;
+
+    char* carry;
+    size_t carry_length;
+    size_t carry_capacity;
+} tokenizer_t;
+
+// Parses tokenizer specification: "bytes", "words", "lines" or "ngrams:<N>".
+// Returns 0 on success.
+int parseTokenizerSpec(const char* spec, tokenizer_mode_t* mode, size_t* ngram_length);
+
+void tokenizerInit(tokenizer_t* tokenizer, tokenizer_mode_t mode, size_t ngram_length);
+void tokenizerFree(tokenizer_t* tokenizer);
+
+// Splits another chunk of the stream into tokens and passes them to sink.
+int tokenizerFeed(tokenizer_t* tokenizer, const char* data, size_t length,
+    token_sink_t sink, void* context);
+
+// Flushes the carried over token (if any) at the end of the stream.
+int tokenizerFinish(tokenizer_t* tokenizer, token_sink_t sink, void* context);
@@ -0,0 +1,813 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+
+// Benchmark of the IPC transports data can take between reader-writer and data handler.
+// A sender process and a forked receiver exchange messages of a given size through each
+// transport, every message is written and read in chunks as in readString and writeString.
+// Throughput: the sender streams messages for a while and the receiver counts them.
+// Latency: the sender sends a message, the receiver reads it whole and answers with a byte.
+
+#define DEFAULT_DURATION_MS 300
+#define MAX_SIZES 16
+
+// Latency samples kept per measurement.
+#define MAX_SAMPLES 1000000
+
+// Capacity of enlarged pipes, the default limit of /proc/sys/fs/pipe-max-size.
+#define BIG_PIPE_SIZE (1 << 20)
+
+// Capacity of a shared-memory ring.
+#define RING_SIZE ((size_t)4 << 20)
+
+// Messages are at most this large.
+#define MAX_MESSAGE_SIZE ((size_t)1 << 30)
+
+typedef enum {
+    TRANSPORT_PIPE,
+    TRANSPORT_FIFO,
+    TRANSPORT_BIG_PIPE,
+    TRANSPORT_VMSPLICE,
+    TRANSPORT_SOCKET,
+    TRANSPORT_SHM,
+    TRANSPORT_COUNT
+} transport_t;
+
+static const char* const transport_names[TRANSPORT_COUNT] = {
+    "pipe", "fifo", "bigpipe", "vmsplice", "socket", "shm"
+};
+
+// Single-producer single-consumer byte ring in shared memory. Positions only grow, a side that
+// has to wait sleeps on a futex that the other side bumps after every move of its position.
+typedef struct {
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    _Atomic uint32_t head_moves;
+    _Atomic uint32_t tail_moves;
+    _Atomic uint32_t waiters;
+    _Atomic uint32_t closed;
+    char data[];
+} shm_ring_t;
+
+// One side of a transport: where it sends to and receives from.
+typedef struct {
+    int send_fd;
+    int receive_fd;
+    shm_ring_t* send_ring;
+    shm_ring_t* receive_ring;
+    bool use_vmsplice;
+} endpoint_t;
+
+static size_t chunk_size = BUFFER_SIZE;
+
+static double nowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void futexWait(_Atomic uint32_t* word, uint32_t value)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+static void futexWake(_Atomic uint32_t* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Waits until the other side moves its position (moves changes from the value seen by ready).
+static void ringWait(shm_ring_t* ring, _Atomic uint32_t* moves, bool (*ready)(shm_ring_t*))
+{
+    // A short spin catches the other side while it's running, then the side sleeps.
+    for (int spin = 0; spin < 256; ++spin) {
+        if (ready(ring)) {
+            return;
+        }
+    }
+
+    atomic_fetch_add(&ring->waiters, 1);
+    const uint32_t seen = atomic_load(moves);
+    if (!ready(ring)) {
+        futexWait(moves, seen);
+    }
+    atomic_fetch_sub(&ring->waiters, 1);
+}
+
+static void ringMoved(shm_ring_t* ring, _Atomic uint32_t* moves)
+{
+    atomic_fetch_add(moves, 1);
+    if (atomic_load(&ring->waiters) != 0) {
+        futexWake(moves);
+    }
+}
+
+static bool ringHasSpace(shm_ring_t* ring)
+{
+    return atomic_load(&ring->head) - atomic_load(&ring->tail) < RING_SIZE;
+}
+
+static bool ringHasData(shm_ring_t* ring)
+{
+    return atomic_load(&ring->head) != atomic_load(&ring->tail) || atomic_load(&ring->closed);
+}
+
+static void ringWrite(shm_ring_t* ring, const char* data, size_t length)
+{
+    while (length > 0) {
+        while (!ringHasSpace(ring)) {
+            ringWait(ring, &ring->tail_moves, ringHasSpace);
+        }
+
+        const uint64_t head = atomic_load(&ring->head);
+        const size_t space = RING_SIZE - (size_t)(head - atomic_load(&ring->tail));
+        const size_t offset = head % RING_SIZE;
+        size_t part = length < space ? length : space;
+        part = part < RING_SIZE - offset ? part : RING_SIZE - offset;
+
+        memcpy(ring->data + offset, data, part);
+        atomic_store(&ring->head, head + part);
+        ringMoved(ring, &ring->head_moves);
+
+        data += part;
+        length -= part;
+    }
+}
+
+// Reads up to length bytes, returns 0 once the ring is closed and drained.
+static size_t ringRead(shm_ring_t* ring, char* buffer, size_t length)
+{
+    while (!ringHasData(ring)) {
+        ringWait(ring, &ring->head_moves, ringHasData);
+    }
+
+    const uint64_t tail = atomic_load(&ring->tail);
+    const size_t available = (size_t)(atomic_load(&ring->head) - tail);
+    const size_t offset = tail % RING_SIZE;
+    size_t part = length < available ? length : available;
+    part = part < RING_SIZE - offset ? part : RING_SIZE - offset;
+
+    memcpy(buffer, ring->data + offset, part);
+    atomic_store(&ring->tail, tail + part);
+    ringMoved(ring, &ring->tail_moves);
+
+    return part;
+}
+
+static shm_ring_t* createRing(void)
+{
+    shm_ring_t* ring = mmap(NULL, sizeof(shm_ring_t) + RING_SIZE, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        printf("[Transport Bench Error] Failed to map ring: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    return ring;
+}
+
+// sendBytes: Sends length bytes in chunks of chunk_size, as readString passes a file into a pipe.
+static int sendBytes(endpoint_t* endpoint, const char* data, size_t length)
+{
+    while (length > 0) {
+        const size_t chunk = length < chunk_size ? length : chunk_size;
+
+        if (endpoint->send_ring != NULL) {
+            ringWrite(endpoint->send_ring, data, chunk);
+            data += chunk;
+            length -= chunk;
+            continue;
+        }
+
+        struct iovec vector = { (void*)data, chunk };
+        const ssize_t written = endpoint->use_vmsplice
+            ? vmsplice(endpoint->send_fd, &vector, 1, 0)
+            : write(endpoint->send_fd, data, chunk);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            printf("[Transport Bench Error] Failed to send: %s\n", strerror(errno));
+            return 1;
+        }
+
+        data += written;
+        length -= (size_t)written;
+    }
+
+    return 0;
+}
+
+// receiveBytes: Receives what's available up to length bytes, as writeString reads a pipe.
+// Returns 0 at the end of the stream and -1 on failure.
+static ssize_t receiveBytes(endpoint_t* endpoint, char* buffer, size_t length)
+{
+    if (endpoint->receive_ring != NULL) {
+        return (ssize_t)ringRead(endpoint->receive_ring, buffer, length);
+    }
+
+    ssize_t read_bytes = 0;
+    while ((read_bytes = read(endpoint->receive_fd, buffer, length)) < 0 && errno == EINTR) {
+    }
+
+    if (read_bytes < 0) {
+        printf("[Transport Bench Error] Failed to receive: %s\n", strerror(errno));
+    }
+
+    return read_bytes;
+}
+
+static int receiveExactly(endpoint_t* endpoint, char* buffer, size_t length)
+{
+    while (length > 0) {
+        const ssize_t read_bytes = receiveBytes(endpoint, buffer, length < chunk_size ? length : chunk_size);
+        if (read_bytes <= 0) {
+            return 1;
+        }
+
+        buffer += read_bytes;
+        length -= (size_t)read_bytes;
+    }
+
+    return 0;
+}
+
+static void closeSending(endpoint_t* endpoint)
+{
+    if (endpoint->send_ring != NULL) {
+        atomic_store(&endpoint->send_ring->closed, 1);
+        ringMoved(endpoint->send_ring, &endpoint->send_ring->head_moves);
+    } else if (endpoint->send_fd == endpoint->receive_fd && endpoint->send_fd != -1) {
+        shutdown(endpoint->send_fd, SHUT_WR);
+    } else if (endpoint->send_fd != -1) {
+        close(endpoint->send_fd);
+    }
+
+    endpoint->send_fd = -1;
+}
+
+// dropEndpoint: Closes descriptors of the other side inherited over fork, its rings are left as they are.
+static void dropEndpoint(endpoint_t* endpoint)
+{
+    if (endpoint->send_fd != -1) {
+        close(endpoint->send_fd);
+    }
+
+    if (endpoint->receive_fd != -1 && endpoint->receive_fd != endpoint->send_fd) {
+        close(endpoint->receive_fd);
+    }
+
+    endpoint->send_fd = -1;
+    endpoint->receive_fd = -1;
+    endpoint->send_ring = NULL;
+    endpoint->receive_ring = NULL;
+}
+
+static void closeEndpoint(endpoint_t* endpoint)
+{
+    closeSending(endpoint);
+
+    if (endpoint->receive_fd != -1) {
+        close(endpoint->receive_fd);
+    }
+
+    endpoint->receive_fd = -1;
+}
+
+typedef struct {
+    transport_t transport;
+    endpoint_t endpoints[2];
+    shm_ring_t* rings[2];
+    char directory[64];
+    char fifo_paths[2][96];
+} transport_pair_t;
+
+// createPair: Creates a transport between the sender (endpoint 0) and the receiver (endpoint 1).
+// FIFOs are only created here and opened by openEndpoint after fork.
+static int createPair(transport_t transport, transport_pair_t* pair)
+{
+    memset(pair, 0, sizeof(*pair));
+    pair->transport = transport;
+
+    for (int i = 0; i < 2; ++i) {
+        pair->endpoints[i].send_fd = -1;
+        pair->endpoints[i].receive_fd = -1;
+    }
+
+    switch (transport) {
+    case TRANSPORT_PIPE:
+    case TRANSPORT_BIG_PIPE:
+    case TRANSPORT_VMSPLICE: {
+        int forward[2];
+        int backward[2];
+        if (pipe(forward) < 0 || pipe(backward) < 0) {
+            printf("[Transport Bench Error] Failed to create pipe: %s\n", strerror(errno));
+            return 1;
+        }
+
+        if (transport == TRANSPORT_BIG_PIPE
+            && (fcntl(forward[1], F_SETPIPE_SZ, BIG_PIPE_SIZE) < 0 || fcntl(backward[1], F_SETPIPE_SZ, BIG_PIPE_SIZE) < 0)) {
+            printf("[Transport Bench Error] Failed to enlarge pipe: %s\n", strerror(errno));
+            return 1;
+        }
+
+        pair->endpoints[0] = (endpoint_t) { forward[1], backward[0], NULL, NULL, transport == TRANSPORT_VMSPLICE };
+        pair->endpoints[1] = (endpoint_t) { backward[1], forward[0], NULL, NULL, false };
+        return 0;
+    }
+    case TRANSPORT_FIFO:
+        snprintf(pair->directory, sizeof(pair->directory), "/tmp/mark8-tbench-XXXXXX");
+        if (mkdtemp(pair->directory) == NULL) {
+            printf("[Transport Bench Error] Failed to create temporary directory: %s\n", strerror(errno));
+            return 1;
+        }
+
+        for (int i = 0; i < 2; ++i) {
+            snprintf(pair->fifo_paths[i], sizeof(pair->fifo_paths[i]), "%s/%d.fifo", pair->directory, i);
+            if (mkfifo(pair->fifo_paths[i], 0600) < 0) {
+                printf("[Transport Bench Error] Failed to create FIFO: %s\n", strerror(errno));
+                return 1;
+            }
+        }
+        return 0;
+    case TRANSPORT_SOCKET: {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+            printf("[Transport Bench Error] Failed to create socket pair: %s\n", strerror(errno));
+            return 1;
+        }
+
+        pair->endpoints[0] = (endpoint_t) { sockets[0], sockets[0], NULL, NULL, false };
+        pair->endpoints[1] = (endpoint_t) { sockets[1], sockets[1], NULL, NULL, false };
+        return 0;
+    }
+    case TRANSPORT_SHM:
+        if ((pair->rings[0] = createRing()) == NULL || (pair->rings[1] = createRing()) == NULL) {
+            return 1;
+        }
+
+        pair->endpoints[0] = (endpoint_t) { -1, -1, pair->rings[0], pair->rings[1], false };
+        pair->endpoints[1] = (endpoint_t) { -1, -1, pair->rings[1], pair->rings[0], false };
+        return 0;
+    case TRANSPORT_COUNT:
+        break;
+    }
+
+    return 1;
+}
+
+// openEndpoint: Called after fork by both sides, closes the other side's descriptors or opens FIFOs.
+static int openEndpoint(transport_pair_t* pair, int side)
+{
+    endpoint_t* endpoint = &pair->endpoints[side];
+
+    if (pair->transport != TRANSPORT_FIFO) {
+        dropEndpoint(&pair->endpoints[1 - side]);
+        return 0;
+    }
+
+    // The receiver opens the forward FIFO first, so both sides open them in the same order.
+    if (side == 0) {
+        endpoint->send_fd = open(pair->fifo_paths[0], O_WRONLY);
+        endpoint->receive_fd = open(pair->fifo_paths[1], O_RDONLY);
+    } else {
+        endpoint->receive_fd = open(pair->fifo_paths[0], O_RDONLY);
+        endpoint->send_fd = open(pair->fifo_paths[1], O_WRONLY);
+    }
+
+    if (endpoint->send_fd < 0 || endpoint->receive_fd < 0) {
+        printf("[Transport Bench Error] Failed to open FIFOs: %s\n", strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+static void destroyPair(transport_pair_t* pair)
+{
+    closeEndpoint(&pair->endpoints[0]);
+
+    for (int i = 0; i < 2; ++i) {
+        if (pair->rings[i] != NULL) {
+            munmap(pair->rings[i], sizeof(shm_ring_t) + RING_SIZE);
+        }
+
+        if (pair->fifo_paths[i][0] != '\0') {
+            unlink(pair->fifo_paths[i]);
+        }
+    }
+
+    if (pair->directory[0] != '\0') {
+        rmdir(pair->directory);
+    }
+}
+
+typedef enum {
+    BENCH_THROUGHPUT,
+    BENCH_LATENCY
+} bench_kind_t;
+
+// Receiver side: counts bytes until the end of the stream and reports the count back,
+// or answers every message of message_size bytes with one byte.
+static int runReceiver(endpoint_t* endpoint, bench_kind_t kind, size_t message_size, char* buffer)
+{
+    if (kind == BENCH_THROUGHPUT) {
+        uint64_t total = 0;
+        ssize_t read_bytes = 0;
+        while ((read_bytes = receiveBytes(endpoint, buffer, chunk_size)) > 0) {
+            total += (uint64_t)read_bytes;
+        }
+
+        return read_bytes < 0 || sendBytes(endpoint, (const char*)&total, sizeof(total)) != 0;
+    }
+
+    while (receiveExactly(endpoint, buffer, message_size) == 0) {
+        if (sendBytes(endpoint, buffer, 1) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+typedef struct {
+    double bytes_per_second;
+    uint64_t messages;
+    double* samples_ns;
+    size_t sample_count;
+} bench_result_t;
+
+// Sender side of a measurement running for duration_ns.
+static int runSender(endpoint_t* endpoint, bench_kind_t kind, size_t message_size, char* buffer,
+    double duration_ns, bench_result_t* result)
+{
+    const double start = nowNs();
+    uint64_t messages = 0;
+
+    if (kind == BENCH_THROUGHPUT) {
+        do {
+            if (sendBytes(endpoint, buffer, message_size) != 0) {
+                return 1;
+            }
+            ++messages;
+        } while ((messages & 15) != 0 || nowNs() - start < duration_ns);
+
+        closeSending(endpoint);
+
+        uint64_t total = 0;
+        if (receiveExactly(endpoint, (char*)&total, sizeof(total)) != 0 || total != messages * message_size) {
+            printf("[Transport Bench Error] Receiver got %llu bytes of %llu\n",
+                (unsigned long long)total, (unsigned long long)(messages * message_size));
+            return 1;
+        }
+
+        result->messages = messages;
+        result->bytes_per_second = total / ((nowNs() - start) / 1e9);
+        return 0;
+    }
+
+    char answer = 0;
+    result->sample_count = 0;
+
+    while (result->sample_count < MAX_SAMPLES && (result->sample_count < 16 || nowNs() - start < duration_ns)) {
+        const double sent = nowNs();
+        if (sendBytes(endpoint, buffer, message_size) != 0 || receiveExactly(endpoint, &answer, 1) != 0) {
+            return 1;
+        }
+
+        result->samples_ns[result->sample_count++] = nowNs() - sent;
+    }
+
+    closeSending(endpoint);
+    result->messages = result->sample_count;
+    return 0;
+}
+
+// Runs one measurement in a fresh pair of processes.
+static int measure(transport_t transport, bench_kind_t kind, size_t message_size, char* buffer,
+    double duration_ns, bench_result_t* result)
+{
+    transport_pair_t pair;
+    if (createPair(transport, &pair) != 0) {
+        destroyPair(&pair);
+        return 1;
+    }
+
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid < 0) {
+        printf("[Transport Bench Error] Failed to fork: %s\n", strerror(errno));
+        destroyPair(&pair);
+        return 1;
+    }
+
+    if (pid == 0) {
+        const int exit_code = openEndpoint(&pair, 1) || runReceiver(&pair.endpoints[1], kind, message_size, buffer);
+        fflush(stdout);
+        _exit(exit_code);
+    }
+
+    int exit_code = openEndpoint(&pair, 0) || runSender(&pair.endpoints[0], kind, message_size, buffer, duration_ns, result);
+
+    // The receiver stops at the end of its stream, which ends with the sender's side.
+    closeEndpoint(&pair.endpoints[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("[Transport Bench Error] Receiver failed\n");
+        exit_code = 1;
+    }
+
+    destroyPair(&pair);
+    return exit_code;
+}
+
+static int compareDoubles(const void* left, const void* right)
+{
+    const double a = *(const double*)left;
+    const double b = *(const double*)right;
+    return (a > b) - (a < b);
+}
+
+static double percentile(const double* sorted, size_t count, double fraction)
+{
+    size_t index = (size_t)(fraction * count + 0.5);
+    index = index == 0 ? 0 : index - 1;
+    return sorted[index < count ? index : count - 1];
+}
+
+// Prints how many round trips fall into each power-of-two range of microseconds.
+static void printHistogram(const double* sorted, size_t count)
+{
+    size_t i = 0;
+    for (double bound = 1; i < count; bound *= 2) {
+        size_t bucket = 0;
+        while (i < count && sorted[i] / 1e3 < bound) {
+            ++bucket;
+            ++i;
+        }
+
+        if (bucket > 0) {
+            printf("[Transport Bench]     < %8.0f us: %zu\n", bound, bucket);
+        }
+    }
+}
+
+static const char* formatSize(size_t size, char* text, size_t text_size)
+{
+    if (size >= ((size_t)1 << 20) && size % ((size_t)1 << 20) == 0) {
+        snprintf(text, text_size, "%zu MiB", size >> 20);
+    } else if (size >= 1024 && size % 1024 == 0) {
+        snprintf(text, text_size, "%zu KiB", size >> 10);
+    } else {
+        snprintf(text, text_size, "%zu B", size);
+    }
+
+    return text;
+}
+
+// Parses a size with an optional K, M or G suffix (powers of 1024).
+static int parseSize(const char* text, size_t* size)
+{
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || value == 0) {
+        return 1;
+    }
+
+    unsigned shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+    } else if (*end == 'G' || *end == 'g') {
+        shift = 30;
+    } else if (*end != '\0') {
+        return 1;
+    }
+
+    if ((shift != 0 && *++end != '\0') || value > (MAX_MESSAGE_SIZE >> shift)) {
+        return 1;
+    }
+
+    *size = (size_t)value << shift;
+    return 0;
+}
+
+static int parseSizes(char* text, size_t* sizes, int* count)
+{
+    *count = 0;
+    for (char* token = strtok(text, ","); token != NULL; token = strtok(NULL, ",")) {
+        if (*count == MAX_SIZES || parseSize(token, &sizes[*count]) != 0) {
+            return 1;
+        }
+        ++*count;
+    }
+
+    return *count == 0;
+}
+
+static int selectTransports(const char* list, bool* selected)
+{
+    for (int i = 0; i < TRANSPORT_COUNT; ++i) {
+        selected[i] = list == NULL;
+    }
+
+    if (list == NULL) {
+        return 0;
+    }
+
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", list);
+
+    for (char* token = strtok(copy, ","); token != NULL; token = strtok(NULL, ",")) {
+        int i = 0;
+        while (i < TRANSPORT_COUNT && strcmp(transport_names[i], token) != 0) {
+            ++i;
+        }
+
+        if (i == TRANSPORT_COUNT) {
+            printf("[Transport Bench Error] Unknown transport '%s'\n", token);
+            return 1;
+        }
+
+        selected[i] = true;
+    }
+
+    return 0;
+}
+
+static void printUsage(void)
+{
+    printf("Usage: ./mark8-tbench [--transports=<t1,t2,...>] [--sizes=<s1,s2,...>] [--chunk=<size>]\n"
+           "                      [--mode=throughput|latency|both] [--duration-ms=<N>] [--histogram]\n"
+           "Transports: pipe, fifo, bigpipe (1 MiB pipe), vmsplice, socket, shm (shared-memory ring).\n"
+           "Sizes are message sizes with an optional K, M or G suffix, 1,64,4K,64K,1M,16M by default.\n"
+           "Messages are written and read in chunks of %d bytes unless --chunk is given.\n",
+        BUFFER_SIZE);
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option long_options[] = {
+        { "transports", required_argument, NULL, 't' },
+        { "sizes", required_argument, NULL, 's' },
+        { "chunk", required_argument, NULL, 'c' },
+        { "mode", required_argument, NULL, 'm' },
+        { "duration-ms", required_argument, NULL, 'd' },
+        { "histogram", no_argument, NULL, 'H' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    const char* transport_list = NULL;
+    bool throughput = true;
+    bool latency = true;
+    bool histogram = false;
+    int duration_ms = DEFAULT_DURATION_MS;
+
+    char default_sizes[] = "1,64,4K,64K,1M,16M";
+    size_t sizes[MAX_SIZES];
+    int size_count = 0;
+    parseSizes(default_sizes, sizes, &size_count);
+
+    int option = 0;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+        case 't':
+            transport_list = optarg;
+            break;
+        case 's':
+            if (parseSizes(optarg, sizes, &size_count) != 0) {
+                printf("[Transport Bench Error] Invalid sizes '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'c':
+            if (parseSize(optarg, &chunk_size) != 0) {
+                printf("[Transport Bench Error] Invalid chunk size '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'm':
+            throughput = strcmp(optarg, "latency") != 0;
+            latency = strcmp(optarg, "throughput") != 0;
+            if (strcmp(optarg, "throughput") != 0 && strcmp(optarg, "latency") != 0 && strcmp(optarg, "both") != 0) {
+                printf("[Transport Bench Error] Unknown mode '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'd':
+            if ((duration_ms = atoi(optarg)) < 1) {
+                printf("[Transport Bench Error] Invalid duration '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'H':
+            histogram = true;
+            break;
+        default:
+            printUsage();
+            return 1;
+        }
+    }
+
+    bool selected[TRANSPORT_COUNT];
+    if (optind != argc || selectTransports(transport_list, selected) != 0) {
+        printUsage();
+        return 1;
+    }
+
+    // A receiver that fails leaves the sender writing into a closed pipe.
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t max_size = chunk_size;
+    for (int i = 0; i < size_count; ++i) {
+        max_size = sizes[i] > max_size ? sizes[i] : max_size;
+    }
+
+    // Page-aligned, so that vmsplice maps whole pages.
+    char* buffer = NULL;
+    double* samples = malloc(MAX_SAMPLES * sizeof(double));
+    if (posix_memalign((void**)&buffer, 4096, max_size) != 0 || samples == NULL) {
+        printf("[Transport Bench Error] Failed to allocate buffers of %zu bytes\n", max_size);
+        free(samples);
+        return 1;
+    }
+
+    memset(buffer, 'x', max_size);
+
+    int exit_code = 0;
+    char size_text[32];
+
+    for (int t = 0; t < TRANSPORT_COUNT; ++t) {
+        if (!selected[t]) {
+            continue;
+        }
+
+        for (int s = 0; s < size_count; ++s) {
+            formatSize(sizes[s], size_text, sizeof(size_text));
+            bench_result_t result = { 0, 0, samples, 0 };
+
+            if (throughput) {
+                if (measure(t, BENCH_THROUGHPUT, sizes[s], buffer, duration_ms * 1e6, &result) != 0) {
+                    printf("[Transport Bench Error] %s, %s messages: throughput failed\n", transport_names[t], size_text);
+                    exit_code = 1;
+                } else {
+                    printf("[Transport Bench] %-8s %8s: %10.1f MiB/s, %.0f messages/s\n", transport_names[t], size_text,
+                        result.bytes_per_second / (1 << 20), result.bytes_per_second / sizes[s]);
+                }
+            }
+
+            if (latency) {
+                if (measure(t, BENCH_LATENCY, sizes[s], buffer, duration_ms * 1e6, &result) != 0) {
+                    printf("[Transport Bench Error] %s, %s messages: latency failed\n", transport_names[t], size_text);
+                    exit_code = 1;
+                    continue;
+                }
+
+                qsort(samples, result.sample_count, sizeof(double), compareDoubles);
+                printf("[Transport Bench] %-8s %8s: round trip p50 %.2f us, p99 %.2f us, p999 %.2f us, max %.2f us, %zu samples\n",
+                    transport_names[t], size_text, percentile(samples, result.sample_count, 0.5) / 1e3,
+                    percentile(samples, result.sample_count, 0.99) / 1e3,
+                    percentile(samples, result.sample_count, 0.999) / 1e3,
+                    samples[result.sample_count - 1] / 1e3, result.sample_count);
+
+                if (histogram) {
+                    printHistogram(samples, result.sample_count);
+                }
+            }
+        }
+    }
+
+    free(buffer);
+    free(samples);
+
+    return exit_code;
+}